@@ -0,0 +1,120 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "istgt_crc32c.h"
+
+/* throughput of each CRC32C implementation usable on this CPU */
+
+#define BENCH_BUFSIZE (1024 * 1024)
+#define BENCH_BYTES (1024ULL * 1024 * 1024)
+
+static const size_t bench_lens[] = {48, 512, 4096, 65536, BENCH_BUFSIZE};
+static const size_t offload_lens[] = {262144, 524288, BENCH_BUFSIZE};
+
+/* wall clock, the helper threads run beside the caller */
+static double bench_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+  const char* name;
+  const char* def;
+  uint8_t* buf;
+  uint32_t ref[64];
+  uint32_t crc;
+  clock_t start;
+  double wstart;
+  double sec;
+  size_t len;
+  size_t n, i;
+  int workers;
+  int impl;
+  int bad;
+
+  buf = malloc(BENCH_BUFSIZE + 8);
+  if (buf == NULL)
+    return 1;
+  srand(1);
+  for (i = 0; i < BENCH_BUFSIZE + 8; i++) {
+    buf[i] = (uint8_t) rand();
+  }
+  istgt_init_crc32c();
+  def = istgt_crc32c_name();
+
+  /* results of the first implementation are the reference */
+  bad = 0;
+  for (impl = 0; (name = istgt_crc32c_impl_name(impl)) != NULL; impl++) {
+    if (istgt_select_crc32c(name) < 0) {
+      printf("%-8s not supported\n", name);
+      continue;
+    }
+    /* odd offsets and lengths across the block sizes */
+    for (i = 0; i < 64; i++) {
+      len = (i * 12289 + i * i * 37) % (BENCH_BUFSIZE - 8);
+      crc = istgt_crc32c(buf + (i & 7), len);
+      if (impl == 0) {
+        ref[i] = crc;
+      } else if (crc != ref[i]) {
+        printf("%-8s mismatch len=%zu\n", name, len);
+        bad = 1;
+      }
+    }
+    for (i = 0; i < sizeof bench_lens / sizeof bench_lens[0]; i++) {
+      len = bench_lens[i];
+      crc = 0;
+      start = clock();
+      for (n = 0; n < BENCH_BYTES / 16 / len + 1; n++) {
+        crc ^= istgt_crc32c(buf, len);
+      }
+      sec = (double) (clock() - start) / CLOCKS_PER_SEC;
+      printf("%-8s %8zu bytes %8.2f GB/s%s (%08x)\n",
+             name,
+             len,
+             sec > 0 ? (double) n * len / sec / 1e9 : 0.0,
+             strcmp(name, def) == 0 ? " *" : "",
+             crc);
+    }
+  }
+  istgt_select_crc32c(def);
+
+  /* digests split across helper threads, checked against the plain one */
+  for (workers = 1; workers <= 4; workers *= 2) {
+    if (istgt_crc32c_start_workers(workers, 1) < 0) {
+      bad = 1;
+      break;
+    }
+    for (i = 0; i < 64; i++) {
+      len = (i * 12289 + i * i * 37) % (BENCH_BUFSIZE - 8);
+      istgt_crc32c_stop_workers();
+      crc = istgt_crc32c(buf + (i & 7), len);
+      istgt_crc32c_start_workers(workers, 1);
+      if (istgt_crc32c(buf + (i & 7), len) != crc) {
+        printf("offload/%d mismatch len=%zu\n", workers, len);
+        bad = 1;
+      }
+    }
+    for (i = 0; i < sizeof offload_lens / sizeof offload_lens[0]; i++) {
+      len = offload_lens[i];
+      crc = 0;
+      wstart = bench_now();
+      for (n = 0; n < BENCH_BYTES / 16 / len + 1; n++) {
+        crc ^= istgt_crc32c(buf, len);
+      }
+      sec = bench_now() - wstart;
+      printf("offload/%d %8zu bytes %8.2f GB/s (%08x)\n",
+             workers,
+             len,
+             sec > 0 ? (double) n * len / sec / 1e9 : 0.0,
+             crc);
+    }
+    istgt_crc32c_stop_workers();
+  }
+  free(buf);
+  return bad;
+}
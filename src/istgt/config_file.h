@@ -24,6 +24,34 @@ static const char* CONFIG_FILE[] = {
     "  # 0=disabled, 1-256=improves large writing",
     "  MaxR2T 64",
     "",
+    "  # upper limit of task buffers in use and kept for reuse (MB)",
+    "  # a command over it gets TASK SET FULL, 0=unlimited without reuse",
+    "  PoolMemory 256",
+    "",
+    "  # event loop threads serving all connections",
+    "  # 0=one thread per connection, also used if a LU has QueueDepth 0",
+    "  ReactorThreads 4",
+    "  # Epoll=readiness and send/recv, Uring=io_uring (Linux 6.0 or later)",
+    "  ReactorEngine Epoll",
+    "  # accept threads, each with its own SO_REUSEPORT socket per portal",
+    "  Acceptors 1",
+    "  # run queued tasks of a LU on the reactor of its first session",
+    "  RunToCompletion No",
+    "  # log commands per second of each reactor every N seconds, 0=off",
+    "  ReactorStatsInterval 0",
+    "  # microseconds to poll queues and sockets before sleeping, 0=disabled",
+    "  # backs off while idle, trades CPU time for wakeup latency",
+    "  BusyPoll 0",
+    "  # pin reactor #N to the N-th CPU of the list, e.g. 0-7",
+    "  ReactorCPUs None",
+    "  # serve connections near their NIC queue (SO_INCOMING_CPU)",
+    "  IncomingCPU No",
+    "",
+    "  # helper threads for DataDigest of large segments, 0=disabled",
+    "  # segments of DigestOffloadLength bytes or more are split across them",
+    "  DigestThreads 0",
+    "  DigestOffloadLength 262144",
+    "",
     "  # iSCSI initial parameters negotiate with initiators",
     "  # NOTE: incorrect values might crash",
     "  MaxOutstandingR2T 16",
@@ -63,6 +91,15 @@ static const char* CONFIG_FILE[] = {
     "  #UnitInquiry 'FreeBSD' 'iSCSI Disk' '0123' '10000001'",
     "  # Queuing 0=disabled, 1-255=enabled with specified depth.",
     "  QueueDepth 128",
+    "  # executor threads for queued commands, 1-64 (default 4)",
+    "  LUWorkers 4",
+    "  # READ/WRITE run on the connection thread while fewer than N commands",
+    "  # are in progress on the LUN, 0=always queued (default 1)",
+    "  InlineDepth 1",
+    "  # BusyPoll for the LU threads and the connections of this LU",
+    "  #BusyPoll 50",
+    "  # LU threads on these CPUs, Auto=NUMA node of the LUN0 device",
+    "  #CPUs Auto",
     "",
     "  # LogicalVolume for this unit on LUN0",
     "  # for file extent",
@@ -74,6 +111,11 @@ static const char* CONFIG_FILE[] = {
     "  # FormFactor 0=not reported, 1=5.25, 2=3.5, 3=2.5, 4=1.8, 5=less 1.8 "
     "inch",
     "  LUN0 Option FormFactor 2",
+    "  # IOEngine Sync=pread/pwrite, Uring=io_uring (Linux only)",
+    "  #LUN0 Option IOEngine Uring",
+    "  # WriteCache write-back buffer for small writes, None=write through",
+    "  # written back within a second, SYNCHRONIZE CACHE and FUA wait for it",
+    "  #LUN0 Option WriteCache 64MB",
     "",
     "  # for 2.5inch, SSD",
     "  #LUN0 Option RPM 1",
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2008-2010 Daisuke Aoyama <aoyama@peach.ne.jp>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+
+#ifdef __linux__
+/* pthread_setaffinity_np() and cpu_set_t */
+#define _GNU_SOURCE
+#endif /* __linux__ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "istgt_affinity.h"
+#include "istgt_core.h"
+#include "istgt_misc.h"
+#include "istgt_platform.h"
+
+#ifdef ISTGT_USE_AFFINITY
+#include <dirent.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#endif /* ISTGT_USE_AFFINITY */
+
+void istgt_cpuset_zero(ISTGT_CPUSET* set) {
+  memset(set, 0, sizeof *set);
+}
+
+void istgt_cpuset_add(ISTGT_CPUSET* set, int cpu) {
+  if (cpu < 0 || cpu >= ISTGT_MAX_CPUS || istgt_cpuset_isset(set, cpu))
+    return;
+  set->mask[cpu / 64] |= UINT64_C(1) << (cpu % 64);
+  set->ncpus++;
+}
+
+int istgt_cpuset_isset(const ISTGT_CPUSET* set, int cpu) {
+  if (cpu < 0 || cpu >= ISTGT_MAX_CPUS)
+    return 0;
+  return (set->mask[cpu / 64] >> (cpu % 64)) & 1;
+}
+
+/* n-th CPU of set counted round, -1 if empty */
+int istgt_cpuset_nth(const ISTGT_CPUSET* set, int n) {
+  int cpu;
+
+  if (set->ncpus == 0)
+    return -1;
+  n %= set->ncpus;
+  for (cpu = 0; cpu < ISTGT_MAX_CPUS; cpu++) {
+    if (istgt_cpuset_isset(set, cpu) && n-- == 0)
+      return cpu;
+  }
+  return -1;
+}
+
+/* "0-3,8,10-11" as in cpulist of sysfs and taskset -c */
+int istgt_cpuset_parse(ISTGT_CPUSET* set, const char* list) {
+  const char* p;
+  char* end;
+  long first, last;
+
+  istgt_cpuset_zero(set);
+  p = list;
+  while (*p != '\0') {
+    while (isspace((unsigned char) *p) || *p == ',')
+      p++;
+    if (*p == '\0')
+      break;
+    if (!isdigit((unsigned char) *p))
+      return -1;
+    first = strtol(p, &end, 10);
+    last = first;
+    p = end;
+    if (*p == '-') {
+      p++;
+      if (!isdigit((unsigned char) *p))
+        return -1;
+      last = strtol(p, &end, 10);
+      p = end;
+    }
+    if (first > last || last >= ISTGT_MAX_CPUS)
+      return -1;
+    for (; first <= last; first++) {
+      istgt_cpuset_add(set, (int) first);
+    }
+    if (*p != '\0' && *p != ',' && !isspace((unsigned char) *p))
+      return -1;
+  }
+  return set->ncpus > 0 ? 0 : -1;
+}
+
+#ifdef ISTGT_USE_AFFINITY
+
+static int istgt_read_sysfs(const char* path, char* buf, size_t len) {
+  FILE* fp;
+  char* p;
+
+  fp = fopen(path, "r");
+  if (fp == NULL)
+    return -1;
+  p = fgets(buf, (int) len, fp);
+  fclose(fp);
+  if (p == NULL)
+    return -1;
+  buf[strcspn(buf, "\n")] = '\0';
+  return 0;
+}
+
+/* CPUs of NUMA node */
+int istgt_cpuset_node(ISTGT_CPUSET* set, int node) {
+  char path[MAX_TMPBUF];
+  char buf[MAX_TMPBUF];
+
+  istgt_cpuset_zero(set);
+  if (node < 0)
+    return -1;
+  snprintf(
+      path, sizeof path, "/sys/devices/system/node/node%d/cpulist", node);
+  if (istgt_read_sysfs(path, buf, sizeof buf) < 0)
+    return -1;
+  return istgt_cpuset_parse(set, buf);
+}
+
+/* NUMA node of CPU, -1 if unknown */
+int istgt_cpu_node(int cpu) {
+  char path[MAX_TMPBUF];
+  struct dirent* dp;
+  DIR* dir;
+  int node;
+
+  if (cpu < 0)
+    return -1;
+  snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d", cpu);
+  dir = opendir(path);
+  if (dir == NULL)
+    return -1;
+  node = -1;
+  while ((dp = readdir(dir)) != NULL) {
+    if (strncmp(dp->d_name, "node", 4) == 0 &&
+        isdigit((unsigned char) dp->d_name[4])) {
+      node = (int) strtol(dp->d_name + 4, NULL, 10);
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+}
+
+/*
+ * NUMA node of the device holding path (a block device itself or a file on
+ * it), -1 if unknown. NVMe namespaces and partitions have numa_node one or
+ * two levels above their block device.
+ */
+int istgt_file_node(const char* path) {
+  static const char* const attrs[] = {
+      "device/numa_node",
+      "device/device/numa_node",
+      "../device/numa_node",
+      "../device/device/numa_node",
+  };
+  char sysfs[MAX_TMPBUF];
+  char buf[MAX_TMPBUF];
+  struct stat st;
+  dev_t dev;
+  size_t i;
+  int node;
+
+  if (stat(path, &st) < 0)
+    return -1;
+  dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+  for (i = 0; i < sizeof attrs / sizeof attrs[0]; i++) {
+    snprintf(sysfs,
+             sizeof sysfs,
+             "/sys/dev/block/%u:%u/%s",
+             major(dev),
+             minor(dev),
+             attrs[i]);
+    if (istgt_read_sysfs(sysfs, buf, sizeof buf) < 0)
+      continue;
+    node = (int) strtol(buf, NULL, 10);
+    /* -1 is reported by single node systems */
+    return node >= 0 ? node : -1;
+  }
+  return -1;
+}
+
+/* bind the calling thread to set */
+int istgt_set_affinity(const ISTGT_CPUSET* set) {
+  cpu_set_t cpus;
+  int cpu;
+
+  CPU_ZERO(&cpus);
+  for (cpu = 0; cpu < ISTGT_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+    if (istgt_cpuset_isset(set, cpu)) {
+      CPU_SET(cpu, &cpus);
+    }
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus) == 0
+             ? 0
+             : -1;
+}
+
+#else /* !ISTGT_USE_AFFINITY */
+
+int istgt_cpuset_node(ISTGT_CPUSET* set, int node) {
+  UNUSED(node);
+
+  istgt_cpuset_zero(set);
+  return -1;
+}
+
+int istgt_cpu_node(int cpu) {
+  UNUSED(cpu);
+
+  return -1;
+}
+
+int istgt_file_node(const char* path) {
+  UNUSED(path);
+
+  return -1;
+}
+
+int istgt_set_affinity(const ISTGT_CPUSET* set) {
+  UNUSED(set);
+
+  errno = ENOTSUP;
+  return -1;
+}
+
+#endif /* ISTGT_USE_AFFINITY */
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2008-2010 Daisuke Aoyama <aoyama@peach.ne.jp>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef ISTGT_AFFINITY_H
+#define ISTGT_AFFINITY_H
+
+#include <stdint.h>
+#include "istgt_platform.h"
+
+#ifdef __linux__
+#define ISTGT_USE_AFFINITY 1
+#endif /* __linux__ */
+
+#define ISTGT_MAX_CPUS 1024
+
+/* CPU numbers as in sched_setaffinity(2) and /sys/devices/system/cpu */
+typedef struct istgt_cpuset_t {
+  int ncpus;
+  uint64_t mask[ISTGT_MAX_CPUS / 64];
+} ISTGT_CPUSET;
+
+void istgt_cpuset_zero(ISTGT_CPUSET* set);
+void istgt_cpuset_add(ISTGT_CPUSET* set, int cpu);
+int istgt_cpuset_isset(const ISTGT_CPUSET* set, int cpu);
+int istgt_cpuset_nth(const ISTGT_CPUSET* set, int n);
+int istgt_cpuset_parse(ISTGT_CPUSET* set, const char* list);
+int istgt_cpuset_node(ISTGT_CPUSET* set, int node);
+
+int istgt_cpu_node(int cpu);
+int istgt_file_node(const char* path);
+int istgt_set_affinity(const ISTGT_CPUSET* set);
+
+#endif /* ISTGT_AFFINITY_H */
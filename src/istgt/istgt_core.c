@@ -47,6 +47,7 @@
 #include "istgt_lu.h"
 #include "istgt_misc.h"
 #include "istgt_platform.h"
+#include "istgt_pool.h"
 #include "istgt_proto.h"
 #include "istgt_sock.h"
 
@@ -296,7 +297,7 @@ static void istgt_destroy_portal_group_array(ISTGT_Ptr istgt) {
   MTX_UNLOCK(&istgt->mutex);
 }
 
-static int istgt_open_portal_group(PORTAL_GROUP* pgp) {
+static int istgt_open_portal_group(PORTAL_GROUP* pgp, int shared) {
   int port;
   int sock;
   int i;
@@ -309,7 +310,11 @@ static int istgt_open_portal_group(PORTAL_GROUP* pgp) {
                      pgp->portals[i]->port,
                      pgp->portals[i]->tag);
       port = (int) strtol(pgp->portals[i]->port, NULL, 0);
-      sock = istgt_listen(pgp->portals[i]->host, port);
+      if (shared) {
+        sock = istgt_listen_shared(pgp->portals[i]->host, port);
+      } else {
+        sock = istgt_listen(pgp->portals[i]->host, port);
+      }
       if (sock < 0) {
         ISTGT_ERRLOG("listen error %.64s:%d\n", pgp->portals[i]->host, port);
         return -1;
@@ -327,7 +332,8 @@ static int istgt_open_all_portals(ISTGT_Ptr istgt) {
   ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "istgt_open_portal\n");
   MTX_LOCK(&istgt->mutex);
   for (i = 0; i < istgt->nportal_group; i++) {
-    rc = istgt_open_portal_group(&istgt->portal_group[i]);
+    rc = istgt_open_portal_group(&istgt->portal_group[i],
+                                 istgt->Acceptors > 1);
     if (rc < 0) {
       MTX_UNLOCK(&istgt->mutex);
       return -1;
@@ -570,6 +576,13 @@ static int istgt_init(ISTGT_Ptr istgt) {
   int timeout;
   int nopininterval;
   int maxr2t;
+  int PoolMemory;
+  int ReactorThreads;
+  int Acceptors;
+  int ReactorStatsInterval;
+  int BusyPoll;
+  int DigestThreads;
+  int DigestOffloadLength;
   int rc;
   int i;
 
@@ -841,6 +854,146 @@ static int istgt_init(ISTGT_Ptr istgt) {
   istgt->maxr2t = maxr2t;
   ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "MaxR2T %d\n", istgt->maxr2t);
 
+  PoolMemory = istgt_get_intval(sp, "PoolMemory");
+  if (PoolMemory < 0) {
+    PoolMemory = DEFAULT_POOLMEMORY;
+  }
+  istgt->PoolMemory = PoolMemory;
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "PoolMemory %dMB\n", istgt->PoolMemory);
+
+  ReactorThreads = istgt_get_intval(sp, "ReactorThreads");
+  if (ReactorThreads < 0) {
+    ReactorThreads = DEFAULT_REACTORTHREADS;
+  }
+  if (ReactorThreads > MAX_REACTOR_THREADS) {
+    ISTGT_ERRLOG("ReactorThreads(%d) > %d\n",
+                 ReactorThreads,
+                 MAX_REACTOR_THREADS);
+    return -1;
+  }
+  istgt->ReactorThreads = ReactorThreads;
+  ISTGT_TRACELOG(
+      ISTGT_TRACE_DEBUG, "ReactorThreads %d\n", istgt->ReactorThreads);
+
+  val = istgt_get_val(sp, "ReactorEngine");
+  if (val == NULL || strcasecmp(val, "Epoll") == 0) {
+    istgt->ReactorEngine = ISTGT_REACTOR_ENGINE_EPOLL;
+  } else if (strcasecmp(val, "Uring") == 0) {
+    istgt->ReactorEngine = ISTGT_REACTOR_ENGINE_URING;
+  } else {
+    ISTGT_ERRLOG("unknown ReactorEngine(%s)\n", val);
+    return -1;
+  }
+  ISTGT_TRACELOG(
+      ISTGT_TRACE_DEBUG, "ReactorEngine %d\n", istgt->ReactorEngine);
+
+  Acceptors = istgt_get_intval(sp, "Acceptors");
+  if (Acceptors < 1) {
+    Acceptors = DEFAULT_ACCEPTORS;
+  }
+  if (Acceptors > MAX_ACCEPTORS) {
+    ISTGT_ERRLOG("Acceptors(%d) > %d\n", Acceptors, MAX_ACCEPTORS);
+    return -1;
+  }
+#ifndef SO_REUSEPORT
+  if (Acceptors > 1) {
+    ISTGT_ERRLOG("Acceptors(%d) needs SO_REUSEPORT\n", Acceptors);
+    return -1;
+  }
+#endif /* SO_REUSEPORT */
+  istgt->Acceptors = Acceptors;
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "Acceptors %d\n", istgt->Acceptors);
+
+  val = istgt_get_val(sp, "RunToCompletion");
+  if (val == NULL) {
+    istgt->RunToCompletion = DEFAULT_RUNTOCOMPLETION;
+  } else if (strcasecmp(val, "Yes") == 0) {
+    istgt->RunToCompletion = 1;
+  } else if (strcasecmp(val, "No") == 0) {
+    istgt->RunToCompletion = 0;
+  } else {
+    ISTGT_ERRLOG("unknown value %s\n", val);
+    return -1;
+  }
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
+                 "RunToCompletion %s\n",
+                 istgt->RunToCompletion ? "Yes" : "No");
+
+  ReactorStatsInterval = istgt_get_intval(sp, "ReactorStatsInterval");
+  if (ReactorStatsInterval < 0) {
+    ReactorStatsInterval = DEFAULT_REACTORSTATSINTERVAL;
+  }
+  istgt->ReactorStatsInterval = ReactorStatsInterval;
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
+                 "ReactorStatsInterval %d\n",
+                 istgt->ReactorStatsInterval);
+
+  BusyPoll = istgt_get_intval(sp, "BusyPoll");
+  if (BusyPoll < 0) {
+    BusyPoll = DEFAULT_BUSYPOLL;
+  }
+  if (BusyPoll > MAX_BUSYPOLL) {
+    ISTGT_ERRLOG("BusyPoll(%d) > %d\n", BusyPoll, MAX_BUSYPOLL);
+    return -1;
+  }
+  istgt->BusyPoll = BusyPoll;
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "BusyPoll %dus\n", istgt->BusyPoll);
+
+  istgt_cpuset_zero(&istgt->ReactorCPUs);
+  val = istgt_get_val(sp, "ReactorCPUs");
+  if (val != NULL && strcasecmp(val, "None") != 0) {
+    if (istgt_cpuset_parse(&istgt->ReactorCPUs, val) < 0) {
+      ISTGT_ERRLOG("invalid ReactorCPUs(%s)\n", val);
+      return -1;
+    }
+  }
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
+                 "ReactorCPUs %s\n",
+                 val != NULL ? val : "None");
+
+  val = istgt_get_val(sp, "IncomingCPU");
+  if (val == NULL) {
+    istgt->IncomingCPU = DEFAULT_INCOMINGCPU;
+  } else if (strcasecmp(val, "Yes") == 0) {
+    istgt->IncomingCPU = 1;
+  } else if (strcasecmp(val, "No") == 0) {
+    istgt->IncomingCPU = 0;
+  } else {
+    ISTGT_ERRLOG("unknown value %s\n", val);
+    return -1;
+  }
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
+                 "IncomingCPU %s\n",
+                 istgt->IncomingCPU ? "Yes" : "No");
+
+  DigestThreads = istgt_get_intval(sp, "DigestThreads");
+  if (DigestThreads < 0) {
+    DigestThreads = DEFAULT_DIGESTTHREADS;
+  }
+  if (DigestThreads > MAX_DIGEST_THREADS) {
+    ISTGT_ERRLOG(
+        "DigestThreads(%d) > %d\n", DigestThreads, MAX_DIGEST_THREADS);
+    return -1;
+  }
+  istgt->DigestThreads = DigestThreads;
+  ISTGT_TRACELOG(
+      ISTGT_TRACE_DEBUG, "DigestThreads %d\n", istgt->DigestThreads);
+
+  DigestOffloadLength = istgt_get_intval(sp, "DigestOffloadLength");
+  if (DigestOffloadLength < 0) {
+    DigestOffloadLength = DEFAULT_DIGESTOFFLOADLENGTH;
+  }
+  if (DigestOffloadLength < ISCSI_ALIGNMENT) {
+    ISTGT_ERRLOG("DigestOffloadLength(%d) < %d\n",
+                 DigestOffloadLength,
+                 ISCSI_ALIGNMENT);
+    return -1;
+  }
+  istgt->DigestOffloadLength = DigestOffloadLength;
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
+                 "DigestOffloadLength %d\n",
+                 istgt->DigestOffloadLength);
+
   val = istgt_get_val(sp, "DiscoveryAuthMethod");
   if (val == NULL) {
     istgt->no_discovery_auth = 0;
@@ -919,6 +1072,13 @@ static int istgt_init(ISTGT_Ptr istgt) {
     return -1;
   }
 
+  /* task and buffer pool */
+  rc = istgt_pool_init((size_t) istgt->PoolMemory * 1024 * 1024);
+  if (rc < 0) {
+    ISTGT_ERRLOG("pool_init() failed\n");
+    return -1;
+  }
+
   rc = istgt_build_portal_group_array(istgt);
   if (rc < 0) {
     ISTGT_ERRLOG("istgt_build_portal_array() failed\n");
@@ -957,6 +1117,7 @@ static void istgt_shutdown(ISTGT_Ptr istgt) {
   istgt_control_pipe_destroy(&istgt->sig_pipe);
 
   xfree(istgt->nodebase);
+  istgt_pool_shutdown();
 
   (void) pthread_mutex_destroy(&istgt->state_mutex);
   (void) pthread_mutex_destroy(&istgt->mutex);
@@ -979,6 +1140,218 @@ static int istgt_stop_loop(ISTGT_Ptr istgt) {
   return 0;
 }
 
+/*
+ * With Acceptors > 1, the main loop is acceptor #0 and each of the others
+ * runs a thread with its own SO_REUSEPORT socket per portal. The kernel
+ * spreads new connections over the sockets, and an acceptor hands its
+ * connections to the reactor of the same index, so accept, connection
+ * setup and login scale with the acceptors.
+ */
+typedef struct istgt_acceptor_t {
+  ISTGT_Ptr istgt;
+  int id;
+  pthread_t thread;
+  int nsocks;
+  int* socks;
+  PORTAL_Ptr* portals;
+} ISTGT_ACCEPTOR;
+typedef ISTGT_ACCEPTOR* ISTGT_ACCEPTOR_Ptr;
+
+static ISTGT_ACCEPTOR_Ptr g_acceptors = NULL;
+static int g_nacceptors = 0;
+static istgt_control_pipe_t g_acceptor_pipe = {.fd = {-1, -1}};
+
+static void istgt_acceptor_close(ISTGT_ACCEPTOR_Ptr acceptor) {
+  int i;
+
+  for (i = 0; i < acceptor->nsocks; i++) {
+    close(acceptor->socks[i]);
+  }
+  acceptor->nsocks = 0;
+  xfree(acceptor->socks);
+  xfree(acceptor->portals);
+  acceptor->socks = NULL;
+  acceptor->portals = NULL;
+}
+
+/* a shared listen socket for each portal opened by istgt_open_all_portals() */
+static int istgt_acceptor_open(ISTGT_ACCEPTOR_Ptr acceptor) {
+  ISTGT_Ptr istgt = acceptor->istgt;
+  PORTAL_Ptr pp;
+  int nportals;
+  int port;
+  int sock;
+  int i, j;
+
+  MTX_LOCK(&istgt->mutex);
+  nportals = 0;
+  for (i = 0; i < istgt->nportal_group; i++) {
+    nportals += istgt->portal_group[i].nportals;
+  }
+  acceptor->nsocks = 0;
+  acceptor->socks = xmalloc(sizeof *acceptor->socks * (nportals + 1));
+  acceptor->portals = xmalloc(sizeof *acceptor->portals * (nportals + 1));
+  for (i = 0; i < istgt->nportal_group; i++) {
+    for (j = 0; j < istgt->portal_group[i].nportals; j++) {
+      pp = istgt->portal_group[i].portals[j];
+      if (pp->sock < 0)
+        continue;
+      port = (int) strtol(pp->port, NULL, 0);
+      sock = istgt_listen_shared(pp->host, port);
+      if (sock < 0) {
+        MTX_UNLOCK(&istgt->mutex);
+        ISTGT_ERRLOG("listen error %.64s:%d\n", pp->host, port);
+        istgt_acceptor_close(acceptor);
+        return -1;
+      }
+      acceptor->socks[acceptor->nsocks] = sock;
+      acceptor->portals[acceptor->nsocks] = pp;
+      acceptor->nsocks++;
+    }
+  }
+  MTX_UNLOCK(&istgt->mutex);
+  return 0;
+}
+
+static void* istgt_acceptor_thread(void* arg) {
+  ISTGT_ACCEPTOR_Ptr acceptor = (ISTGT_ACCEPTOR_Ptr) arg;
+  ISTGT_Ptr istgt = acceptor->istgt;
+  struct pollfd* fds;
+  struct sockaddr_storage sa;
+  socklen_t salen;
+  int nfds;
+  int sock;
+  int rc;
+  int i;
+
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "acceptor #%d start\n", acceptor->id);
+  nfds = acceptor->nsocks + 1;
+  fds = xmalloc(sizeof *fds * nfds);
+  memset(fds, 0, sizeof *fds * nfds);
+  for (i = 0; i < acceptor->nsocks; i++) {
+    fds[i].fd = acceptor->socks[i];
+    fds[i].events = POLLIN;
+  }
+  /* never read, becomes readable for all acceptors on exit */
+  fds[acceptor->nsocks].fd = g_acceptor_pipe.fd[0];
+  fds[acceptor->nsocks].events = POLLIN;
+
+  while (1) {
+    rc = poll(fds, nfds, POLLWAIT);
+    if (rc == -1 && errno == EINTR) {
+      continue;
+    }
+    if (rc == -1) {
+      ISTGT_ERRLOG("poll() failed\n");
+      break;
+    }
+    if (fds[acceptor->nsocks].revents != 0) {
+      break;
+    }
+    for (i = 0; i < acceptor->nsocks; i++) {
+      if (!(fds[i].revents & POLLIN))
+        continue;
+      memset(&sa, 0, sizeof(sa));
+      salen = sizeof(sa);
+      ISTGT_TRACELOG(ISTGT_TRACE_NET,
+                     "accept %d (acceptor #%d)\n",
+                     fds[i].fd,
+                     acceptor->id);
+      rc = accept(fds[i].fd, (struct sockaddr*) &sa, &salen);
+      if (rc < 0) {
+        if (errno == ECONNABORTED || errno == ECONNRESET) {
+          continue;
+        }
+        ISTGT_ERRLOG("accept error: %d(errno=%d)\n", rc, errno);
+        continue;
+      }
+      sock = rc;
+      rc = istgt_create_conn(istgt,
+                             acceptor->portals[i],
+                             sock,
+                             (struct sockaddr*) &sa,
+                             salen,
+                             acceptor->id);
+      if (rc < 0) {
+        close(sock);
+        ISTGT_ERRLOG("istgt_create_conn() failed\n");
+        continue;
+      }
+    }
+  }
+  xfree(fds);
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "acceptor #%d end\n", acceptor->id);
+  return NULL;
+}
+
+static void istgt_stop_acceptors(void) {
+  int i;
+
+  if (g_nacceptors == 0 && g_acceptors == NULL)
+    return;
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "istgt_stop_acceptors\n");
+  if (g_acceptor_pipe.fd[1] >= 0) {
+    (void) istgt_control_pipe_write(&g_acceptor_pipe, "E", 1);
+  }
+  for (i = 0; i < g_nacceptors; i++) {
+    pthread_join(g_acceptors[i].thread, NULL);
+    istgt_acceptor_close(&g_acceptors[i]);
+  }
+  g_nacceptors = 0;
+  xfree(g_acceptors);
+  g_acceptors = NULL;
+  istgt_control_pipe_destroy(&g_acceptor_pipe);
+  g_acceptor_pipe = istgt_control_pipe_init();
+}
+
+/* acceptors #1 to #Acceptors-1, the main loop is #0 */
+static int istgt_start_acceptors(ISTGT_Ptr istgt) {
+  ISTGT_ACCEPTOR_Ptr acceptor;
+#ifdef HAVE_PTHREAD_SET_NAME_NP
+  char buf[MAX_TMPBUF];
+#endif
+  int rc;
+  int i;
+
+  if (istgt->Acceptors <= 1)
+    return 0;
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "istgt_start_acceptors\n");
+  rc = istgt_control_pipe_create(&g_acceptor_pipe);
+  if (rc != 0) {
+    ISTGT_ERRLOG("istgt_control_pipe_create() failed\n");
+    return -1;
+  }
+  g_acceptors = xmalloc(sizeof *g_acceptors * (istgt->Acceptors - 1));
+  memset(g_acceptors, 0, sizeof *g_acceptors * (istgt->Acceptors - 1));
+  for (i = 0; i < istgt->Acceptors - 1; i++) {
+    acceptor = &g_acceptors[i];
+    acceptor->istgt = istgt;
+    acceptor->id = i + 1;
+    rc = istgt_acceptor_open(acceptor);
+    if (rc < 0) {
+      goto error_return;
+    }
+    rc = pthread_create(
+        &acceptor->thread, NULL, &istgt_acceptor_thread, (void*) acceptor);
+    if (rc != 0) {
+      ISTGT_ERRLOG("pthread_create() failed\n");
+      istgt_acceptor_close(acceptor);
+      goto error_return;
+    }
+#ifdef HAVE_PTHREAD_SET_NAME_NP
+    snprintf(buf, sizeof buf, "acceptor #%d", acceptor->id);
+    pthread_set_name_np(acceptor->thread, buf);
+#endif
+    g_nacceptors++;
+  }
+  ISTGT_NOTICELOG("accepting on %d sockets per portal\n", istgt->Acceptors);
+  return 0;
+
+error_return:
+  istgt_stop_acceptors();
+  return -1;
+}
+
 static PORTAL* istgt_get_sock_portal(ISTGT_Ptr istgt, int sock) {
   int i, j;
 
@@ -1204,7 +1577,12 @@ static int istgt_acceptor(ISTGT_Ptr istgt) {
 					continue;
 				}
 #endif
-        rc = istgt_create_conn(istgt, pp, sock, (struct sockaddr*) &sa, salen);
+        rc = istgt_create_conn(istgt,
+                               pp,
+                               sock,
+                               (struct sockaddr*) &sa,
+                               salen,
+                               istgt->Acceptors > 1 ? 0 : -1);
         if (rc < 0) {
           close(sock);
           ISTGT_ERRLOG("istgt_create_conn() failed\n");
@@ -1297,10 +1675,9 @@ int istgt_start() {
   ISTGT_NOTICELOG("using generic atomic\n");
 #endif /* USE_ATOMIC */
 
-#ifdef ISTGT_USE_CRC32C_TABLE
-  /* build crc32c table */
-  istgt_init_crc32c_table();
-#endif /* ISTGT_USE_CRC32C_TABLE */
+  /* build crc32c tables, select the implementation for this CPU */
+  istgt_init_crc32c();
+  ISTGT_NOTICELOG("using crc32c %s\n", istgt_crc32c_name());
 
   /* initialize sub modules */
   rc = istgt_init(istgt);
@@ -1340,8 +1717,15 @@ int istgt_start() {
     goto initialize_error;
   }
 
-  /* accept loop */
+  /* accept loops */
+  rc = istgt_start_acceptors(istgt);
+  if (rc < 0) {
+    ISTGT_ERRLOG("istgt_start_acceptors() failed\n");
+    istgt_close_all_portals(istgt);
+    goto initialize_error;
+  }
   rc = istgt_acceptor(istgt);
+  istgt_stop_acceptors();
   if (rc < 0) {
     ISTGT_ERRLOG("istgt_acceptor() failed\n");
     istgt_close_all_portals(istgt);
@@ -44,6 +44,7 @@
 #endif
 #endif /* USE_ATOMIC */
 
+#include "istgt_affinity.h"
 #include "istgt_conf.h"
 #include "istgt_control_pipe.h"
 #include "istgt_log.h"
@@ -75,6 +76,10 @@
 #define MAX_INITIATOR_GROUP 4096
 #define MAX_LOGICAL_UNIT 4096
 #define MAX_R2T 256
+#define MAX_REACTOR_THREADS 64
+#define MAX_DIGEST_THREADS 16
+#define MAX_ACCEPTORS 64
+#define MAX_BUSYPOLL 10000
 
 #define DEFAULT_NODEBASE "iqn.2007-09.jp.ne.peach.istgt"
 #define DEFAULT_PORT 3260
@@ -94,6 +99,15 @@
 #define DEFAULT_TIMEOUT 60
 #define DEFAULT_NOPININTERVAL 20
 #define DEFAULT_MAXR2T 16
+#define DEFAULT_POOLMEMORY 256 /* MB */
+#define DEFAULT_REACTORTHREADS 4
+#define DEFAULT_ACCEPTORS 1
+#define DEFAULT_RUNTOCOMPLETION 0
+#define DEFAULT_REACTORSTATSINTERVAL 0
+#define DEFAULT_BUSYPOLL 0
+#define DEFAULT_INCOMINGCPU 0
+#define DEFAULT_DIGESTTHREADS 0
+#define DEFAULT_DIGESTOFFLOADLENGTH (256 * 1024)
 
 #define ISTGT_PG_TAG_MAX 0x0000ffff
 #define ISTGT_LU_TAG_MAX 0x0000ffff
@@ -216,6 +230,17 @@ typedef struct istgt_t {
   int DataPDUInOrder;
   int DataSequenceInOrder;
   int ErrorRecoveryLevel;
+  int PoolMemory;
+  int ReactorThreads;
+  int ReactorEngine;
+  int Acceptors;
+  int RunToCompletion;
+  int ReactorStatsInterval;
+  int BusyPoll;
+  ISTGT_CPUSET ReactorCPUs;
+  int IncomingCPU;
+  int DigestThreads;
+  int DigestOffloadLength;
 } ISTGT;
 typedef ISTGT* ISTGT_Ptr;
 
@@ -38,7 +38,19 @@
 #define ISTGT_CRC32C_POLYNOMIAL 0x1edc6f41UL
 
 void istgt_init_crc32c_table(void);
+void istgt_init_crc32c(void);
+const char* istgt_crc32c_name(void);
+const char* istgt_crc32c_impl_name(int idx);
+int istgt_select_crc32c(const char* name);
 uint32_t istgt_update_crc32c(const uint8_t* buf, size_t len, uint32_t crc);
+uint32_t istgt_update_crc32c_copy(uint8_t* dst,
+                                  const uint8_t* src,
+                                  size_t len,
+                                  uint32_t crc);
+uint32_t istgt_crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+int istgt_crc32c_start_workers(int nworkers, size_t offload_len);
+void istgt_crc32c_stop_workers(void);
+int istgt_crc32c_offloaded(size_t len);
 uint32_t istgt_fixup_crc32c(size_t total, uint32_t crc);
 uint32_t istgt_crc32c(const uint8_t* buf, size_t len);
 uint32_t istgt_iovec_crc32c(const struct iovec* iovp,
@@ -50,6 +50,7 @@
 #include "istgt_md5.h"
 #include "istgt_misc.h"
 #include "istgt_platform.h"
+#include "istgt_pool.h"
 #include "istgt_proto.h"
 #include "istgt_queue.h"
 #include "istgt_scsi.h"
@@ -91,8 +92,15 @@ static uint16_t g_last_tsih;
 static pthread_mutex_t g_last_tsih_mutex;
 
 static int istgt_add_transfer_task(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd);
+static ISTGT_R2T_TASK_Ptr istgt_get_transfer_task(CONN_Ptr conn,
+                                                  uint32_t task_tag,
+                                                  uint32_t transfer_tag);
 static void istgt_clear_transfer_task(CONN_Ptr conn, uint32_t CmdSN);
 static void istgt_clear_all_transfer_task(CONN_Ptr conn);
+#ifdef ISTGT_USE_REACTOR
+static int istgt_iscsi_transfer_out_next(CONN_Ptr conn,
+                                         ISTGT_R2T_TASK_Ptr r2t_task);
+#endif /* ISTGT_USE_REACTOR */
 static int istgt_iscsi_send_r2t(CONN_Ptr conn,
                                 ISTGT_LU_CMD_Ptr lu_cmd,
                                 int offset,
@@ -146,59 +154,73 @@ istgt_make_digest_word(uint8_t *buf, size_t len, uint32_t crc32c)
 }
 #endif
 
-static int istgt_iscsi_read_pdu(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
-  struct iovec iovec[4]; /* AHS+HD+DATA+DD */
-  uint32_t crc32c;
-  time_t start, now;
-  int nbytes;
-  int total_ahs_len;
-  int data_len;
-  int segment_len;
-  int total;
-  int rc;
-  int i;
+/* final place of Data-Out segment, or NULL if it should be buffered */
+static uint8_t* istgt_iscsi_dataout_place(CONN_Ptr conn,
+                                          ISCSI_PDU_Ptr pdu,
+                                          int data_len) {
+  ISTGT_R2T_TASK_Ptr r2t_task;
+  uint8_t* cp;
+  uint8_t* buf;
+  size_t len;
+  uint32_t task_tag;
+  uint32_t transfer_tag;
+  uint32_t buffer_offset;
 
-  pdu->ahs = NULL;
-  pdu->total_ahs_len = 0;
-  pdu->data = NULL;
-  pdu->data_segment_len = 0;
-  total = 0;
+  cp = (uint8_t*) &pdu->bhs;
+  task_tag = DGET32(&cp[16]);
+  transfer_tag = DGET32(&cp[20]);
+  buffer_offset = DGET32(&cp[40]);
 
-  /* BHS (require for all PDU) */
-  ISTGT_TRACELOG(ISTGT_TRACE_NET, "BHS read %d\n", ISCSI_BHS_LEN);
-  errno = 0;
-  start = time(NULL);
-  rc = recv(conn->sock, (void*) &pdu->bhs, ISCSI_BHS_LEN, MSG_WAITALL);
-  if (rc < 0) {
-    now = time(NULL);
-    if (errno == ECONNRESET) {
-      ISTGT_WARNLOG("Connection reset by peer (%s,time=%d)\n",
-                    conn->initiator_name,
-                    istgt_difftime(now, start));
-      conn->state = CONN_STATE_EXITING;
-    } else if (errno == ETIMEDOUT) {
-      ISTGT_WARNLOG("Operation timed out (%s,time=%d)\n",
-                    conn->initiator_name,
-                    istgt_difftime(now, start));
-      conn->state = CONN_STATE_EXITING;
-    } else {
-      ISTGT_ERRLOG("iscsi_read() failed (errno=%d,%s,time=%d)\n",
-                   errno,
-                   conn->initiator_name,
-                   istgt_difftime(now, start));
+  if (conn->dataout_buf != NULL && task_tag == conn->dataout_task_tag &&
+      transfer_tag == conn->dataout_transfer_tag) {
+    buf = conn->dataout_buf;
+    len = conn->dataout_len;
+  } else {
+    r2t_task = istgt_get_transfer_task(conn, task_tag, transfer_tag);
+    if (r2t_task == NULL || r2t_task->task_tag != task_tag) {
+      return NULL;
     }
-    return -1;
+    buf = r2t_task->iobuf;
+    len = r2t_task->iobufsize;
   }
-  if (rc == 0) {
-    ISTGT_TRACELOG(ISTGT_TRACE_NET, "recv() EOF (%s)\n", conn->initiator_name);
-    conn->state = CONN_STATE_EXITING;
-    return -1;
+  /* padding goes to pdu->pad, not over the following data */
+  if (buffer_offset > len || (size_t) data_len > len - buffer_offset) {
+    return NULL;
   }
-  if (rc != ISCSI_BHS_LEN) {
-    ISTGT_ERRLOG("invalid BHS length (%d,%s)\n", rc, conn->initiator_name);
-    return -1;
+  return buf + buffer_offset;
+}
+
+static void istgt_iscsi_iovec_advance(struct iovec* iovec,
+                                      int iovcnt,
+                                      size_t nbytes) {
+  int i;
+
+  for (i = 0; i < iovcnt && nbytes > 0; i++) {
+    if (iovec[i].iov_len > nbytes) {
+      iovec[i].iov_base = (void*) (((uintptr_t) iovec[i].iov_base) + nbytes);
+      iovec[i].iov_len -= nbytes;
+      break;
+    }
+    nbytes -= iovec[i].iov_len;
+    iovec[i].iov_len = 0;
   }
-  total += ISCSI_BHS_LEN;
+}
+
+/*
+ * The rest of PDU after BHS is received in two steps, AHS+HD first and
+ * DATA+PAD+DD after the header digest has been checked, so a corrupted
+ * header never selects where the data segment is stored.
+ */
+
+/* prepare iovec for AHS+HD, returns their length */
+static int istgt_iscsi_read_pdu_setup(CONN_Ptr conn,
+                                      ISCSI_PDU_Ptr pdu,
+                                      struct iovec* iovec) {
+  int total_ahs_len;
+  int total;
+  int i;
+
+  total = 0;
 
   /* AHS */
   total_ahs_len = DGET8(&pdu->bhs.total_ahs_len);
@@ -222,8 +244,30 @@ static int istgt_iscsi_read_pdu(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
     iovec[1].iov_len = 0;
   }
 
+  for (i = 2; i < 5; i++) {
+    iovec[i].iov_base = NULL;
+    iovec[i].iov_len = 0;
+  }
+  pdu->data = NULL;
+  pdu->data_segment_len = 0;
+  conn->rx_dnext = NULL;
+  return total;
+}
+
+/* prepare iovec for DATA+PAD+DD, returns their length */
+static int istgt_iscsi_read_pdu_setup_data(CONN_Ptr conn,
+                                           ISCSI_PDU_Ptr pdu,
+                                           struct iovec* iovec) {
+  int data_len;
+  int segment_len;
+  int total;
+
+  total = 0;
+
   /* Data Segment */
   data_len = DGET24(&pdu->bhs.data_segment_len[0]);
+  iovec[3].iov_base = pdu->pad;
+  iovec[3].iov_len = 0;
   if (data_len != 0) {
     if (conn->sess == NULL) {
       segment_len = DEFAULT_FIRSTBURSTLENGTH;
@@ -234,66 +278,61 @@ static int istgt_iscsi_read_pdu(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
       ISTGT_ERRLOG("Data(%d) > Segment(%d)\n", data_len, segment_len);
       return -1;
     }
-    if (ISCSI_ALIGN(data_len) <= ISTGT_SHORTDATASIZE) {
-      pdu->data = pdu->shortdata;
+    if (pdu->total_ahs_len == 0 &&
+        BGET8W(&pdu->bhs.opcode, 5, 6) == ISCSI_OP_SCSI_DATAOUT) {
+      /* receive directly into the task buffer */
+      pdu->data = istgt_iscsi_dataout_place(conn, pdu, data_len);
+    }
+    if (pdu->data != NULL) {
+      /* not owned by PDU, only data_len bytes are ours to write */
+      pdu->copy_pdu = 1;
+      iovec[2].iov_len = data_len;
+      iovec[3].iov_len = ISCSI_ALIGN(data_len) - data_len;
     } else {
-      pdu->data = xmalloc(ISCSI_ALIGN(segment_len));
+      if (ISCSI_ALIGN(data_len) <= ISTGT_SHORTDATASIZE) {
+        pdu->data = pdu->shortdata;
+      } else {
+        pdu->data = xmalloc(ISCSI_ALIGN(segment_len));
+      }
+      iovec[2].iov_len = ISCSI_ALIGN(data_len);
     }
     pdu->data_segment_len = data_len;
     total += ISCSI_ALIGN(data_len);
   } else {
     pdu->data = NULL;
     pdu->data_segment_len = 0;
+    iovec[2].iov_len = 0;
   }
   iovec[2].iov_base = pdu->data;
-  iovec[2].iov_len = ISCSI_ALIGN(pdu->data_segment_len);
 
   /* Data Digest */
-  iovec[3].iov_base = pdu->data_digest;
+  iovec[4].iov_base = pdu->data_digest;
   if (conn->data_digest && data_len != 0) {
-    iovec[3].iov_len = ISCSI_DIGEST_LEN;
+    iovec[4].iov_len = ISCSI_DIGEST_LEN;
     total += ISCSI_DIGEST_LEN;
+    if (istgt_crc32c_offloaded(ISCSI_ALIGN(data_len))) {
+      /* split across the digest threads once the segment is complete */
+      conn->rx_dnext = NULL;
+    } else {
+      /* computed on each chunk as it arrives, see istgt_iscsi_rx_digest() */
+      conn->rx_dnext = pdu->data;
+      conn->rx_dcrc = ISTGT_CRC32C_INITIAL;
+    }
   } else {
-    iovec[3].iov_len = 0;
+    iovec[4].iov_len = 0;
+    conn->rx_dnext = NULL;
   }
 
-  /* read all bytes to iovec */
-  nbytes = total - ISCSI_BHS_LEN;
-  ISTGT_TRACELOG(ISTGT_TRACE_NET, "PDU read %d\n", nbytes);
-  errno = 0;
-  start = time(NULL);
-  while (nbytes > 0) {
-    rc = istgt_readv_socket(conn->sock, &iovec[0], 4);
-    if (rc < 0) {
-      now = time(NULL);
-      ISTGT_ERRLOG("readv() failed (%d,errno=%d,%s,time=%d)\n",
-                   rc,
-                   errno,
-                   conn->initiator_name,
-                   istgt_difftime(now, start));
-      return -1;
-    }
-    if (rc == 0) {
-      ISTGT_TRACELOG(
-          ISTGT_TRACE_NET, "readv() EOF (%s)\n", conn->initiator_name);
-      conn->state = CONN_STATE_EXITING;
-      return -1;
-    }
-    nbytes -= rc;
-    if (nbytes == 0)
-      break;
-    /* adjust iovec length */
-    for (i = 0; i < 4; i++) {
-      if (iovec[i].iov_len != 0 && iovec[i].iov_len > (size_t) rc) {
-        iovec[i].iov_base = (void*) (((uintptr_t) iovec[i].iov_base) + rc);
-        iovec[i].iov_len -= rc;
-        break;
-      } else {
-        rc -= iovec[i].iov_len;
-        iovec[i].iov_len = 0;
-      }
-    }
-  }
+  return total;
+}
+
+static int istgt_iscsi_read_pdu_check_header(CONN_Ptr conn,
+                                             ISCSI_PDU_Ptr pdu) {
+  uint32_t crc32c;
+  int total_ahs_len;
+  int rc;
+
+  total_ahs_len = pdu->total_ahs_len;
 
   /* check digest */
   if (conn->header_digest) {
@@ -317,14 +356,297 @@ static int istgt_iscsi_read_pdu(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
       return -1;
     }
   }
+  return 0;
+}
+
+static int istgt_iscsi_read_pdu_check(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
+  uint32_t crc32c;
+  int data_len;
+  int len;
+  int rc;
+
+  data_len = pdu->data_segment_len;
+
+  /* check digest */
   if (conn->data_digest && data_len != 0) {
-    crc32c = istgt_crc32c(pdu->data, ISCSI_ALIGN(data_len));
+    /* placed segment has its padding in pdu->pad */
+    len = pdu->copy_pdu ? data_len : (int) ISCSI_ALIGN(data_len);
+    if (conn->rx_dnext == pdu->data + len) {
+      crc32c = conn->rx_dcrc;
+      crc32c = istgt_update_crc32c(pdu->pad, ISCSI_ALIGN(len) - len, crc32c);
+      crc32c = crc32c ^ ISTGT_CRC32C_XOR;
+    } else {
+      /* the segment with zero padding, then the actual padding */
+      crc32c = istgt_crc32c(pdu->data, len);
+      crc32c ^= istgt_update_crc32c(pdu->pad, ISCSI_ALIGN(len) - len, 0);
+    }
+    conn->rx_dnext = NULL;
     rc = MATCH_DIGEST_WORD(pdu->data_digest, crc32c);
     if (rc == 0) {
       ISTGT_ERRLOG("data digest error (%s)\n", conn->initiator_name);
       return -1;
     }
   }
+  return 0;
+}
+
+#ifdef ISTGT_USE_REACTOR
+static int istgt_iscsi_conn_wait(CONN_Ptr conn, int events);
+#endif /* ISTGT_USE_REACTOR */
+
+/*
+ * A read fills the requested iovec first and rxbuf behind it, so pipelined
+ * small PDUs are parsed out of one read while large data segments still go
+ * straight to their destination. rxbuf keeps bytes of the following PDUs.
+ */
+#define ISTGT_RXBUF_SIZE (64 * 1024)
+
+/*
+ * With DataDigest, rx_dnext is the next byte of the data segment to arrive.
+ * Received data is folded into rx_dcrc right after each read (or while it is
+ * copied from rxbuf), when it is still in cache, instead of a second pass
+ * over the whole segment.
+ */
+static void istgt_iscsi_rx_digest(CONN_Ptr conn,
+                                  const struct iovec* iovec,
+                                  int iovcnt,
+                                  size_t nbytes) {
+  size_t len;
+  int i;
+
+  for (i = 0; i < iovcnt && nbytes > 0; i++) {
+    len = DMIN64(iovec[i].iov_len, nbytes);
+    if (len != 0 && iovec[i].iov_base == conn->rx_dnext) {
+      conn->rx_dcrc = istgt_update_crc32c(conn->rx_dnext, len, conn->rx_dcrc);
+      conn->rx_dnext += len;
+    }
+    nbytes -= len;
+  }
+}
+
+/* like readv(2), return bytes stored to iovec */
+static ssize_t istgt_iscsi_rx_readv(CONN_Ptr conn,
+                                    struct iovec* iovec,
+                                    int iovcnt) {
+  struct iovec vec[6]; /* iovec+rxbuf */
+  ssize_t rc;
+  size_t want;
+  size_t len;
+  int n;
+  int i;
+
+#ifdef ISTGT_USE_REACTOR
+  if (conn->reactor != NULL &&
+      conn->reactor->engine == ISTGT_REACTOR_ENGINE_URING) {
+    /* chunks of the buffer ring serve the same purpose */
+    rc = istgt_reactor_recv(&conn->rev, iovec, iovcnt);
+    if (rc > 0 && conn->rx_dnext != NULL) {
+      istgt_iscsi_rx_digest(conn, iovec, iovcnt, rc);
+    }
+    return rc;
+  }
+#endif /* ISTGT_USE_REACTOR */
+  if (conn->rxhead != conn->rxtail) {
+    rc = 0;
+    for (i = 0; i < iovcnt && conn->rxhead < conn->rxtail; i++) {
+      len = DMIN32(iovec[i].iov_len, conn->rxtail - conn->rxhead);
+      if (len != 0 && iovec[i].iov_base == conn->rx_dnext) {
+        conn->rx_dcrc = istgt_update_crc32c_copy(
+            conn->rx_dnext, conn->rxbuf + conn->rxhead, len, conn->rx_dcrc);
+        conn->rx_dnext += len;
+      } else {
+        memcpy(iovec[i].iov_base, conn->rxbuf + conn->rxhead, len);
+      }
+      conn->rxhead += len;
+      rc += len;
+    }
+    if (conn->rxhead == conn->rxtail) {
+      conn->rxhead = conn->rxtail = 0;
+    }
+    return rc;
+  }
+
+  if (conn->rxbuf == NULL) {
+    conn->rxbuf = xmalloc(ISTGT_RXBUF_SIZE);
+  }
+  n = 0;
+  want = 0;
+  for (i = 0; i < iovcnt && i < 5; i++) {
+    if (iovec[i].iov_len == 0)
+      continue;
+    vec[n++] = iovec[i];
+    want += iovec[i].iov_len;
+  }
+  vec[n].iov_base = conn->rxbuf;
+  vec[n].iov_len = ISTGT_RXBUF_SIZE;
+  n++;
+#ifdef ISTGT_USE_REACTOR
+  if (conn->reactor != NULL) {
+    rc = istgt_reactor_recv(&conn->rev, &vec[0], n);
+  } else
+#endif /* ISTGT_USE_REACTOR */
+    rc = istgt_readv_socket(conn->sock, &vec[0], n);
+  if (rc > 0 && (size_t) rc > want) {
+    conn->rxtail = rc - want;
+    rc = want;
+  }
+  if (rc > 0 && conn->rx_dnext != NULL) {
+    istgt_iscsi_rx_digest(conn, iovec, iovcnt, rc);
+  }
+  return rc;
+}
+
+/* read nbytes to iovec, return bytes read (short on EOF) */
+static int istgt_iscsi_rx_readv_full(CONN_Ptr conn,
+                                     struct iovec* iovec,
+                                     int iovcnt,
+                                     int nbytes) {
+  ssize_t rc;
+  int total;
+
+  total = 0;
+  while (total < nbytes) {
+    rc = istgt_iscsi_rx_readv(conn, iovec, iovcnt);
+    if (rc < 0) {
+      if (errno == EINTR)
+        continue;
+#ifdef ISTGT_USE_REACTOR
+      if (conn->reactor != NULL &&
+          (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        /* non-blocking socket owned by reactor */
+        if (istgt_iscsi_conn_wait(conn, ISTGT_REACTOR_READ) < 0) {
+          return -1;
+        }
+        continue;
+      }
+#endif /* ISTGT_USE_REACTOR */
+      return -1;
+    }
+    if (rc == 0)
+      break;
+    total += rc;
+    istgt_iscsi_iovec_advance(iovec, iovcnt, rc);
+  }
+  return total;
+}
+
+/* read the rest of PDU prepared in iovec */
+static int istgt_iscsi_read_pdu_iovec(CONN_Ptr conn,
+                                      struct iovec* iovec,
+                                      int nbytes) {
+  time_t start, now;
+  int rc;
+
+  if (nbytes == 0) {
+    return 0;
+  }
+  ISTGT_TRACELOG(ISTGT_TRACE_NET, "PDU read %d\n", nbytes);
+  errno = 0;
+  start = time(NULL);
+  rc = istgt_iscsi_rx_readv_full(conn, iovec, 5, nbytes);
+  if (rc > 0 && rc < nbytes) {
+    /* EOF in the middle */
+    rc = 0;
+  }
+  if (rc < 0) {
+    now = time(NULL);
+    ISTGT_ERRLOG("readv() failed (%d,errno=%d,%s,time=%d)\n",
+                 rc,
+                 errno,
+                 conn->initiator_name,
+                 istgt_difftime(now, start));
+    return -1;
+  }
+  if (rc == 0) {
+    ISTGT_TRACELOG(ISTGT_TRACE_NET, "readv() EOF (%s)\n", conn->initiator_name);
+    conn->state = CONN_STATE_EXITING;
+    return -1;
+  }
+  return 0;
+}
+
+static int istgt_iscsi_read_pdu(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
+  struct iovec iovec[5]; /* AHS+HD+DATA+PAD+DD */
+  time_t start, now;
+  int nbytes;
+  int total;
+  int rc;
+
+  pdu->ahs = NULL;
+  pdu->total_ahs_len = 0;
+  pdu->data = NULL;
+  pdu->data_segment_len = 0;
+  pdu->copy_pdu = 0;
+  total = 0;
+
+  /* BHS (require for all PDU) */
+  ISTGT_TRACELOG(ISTGT_TRACE_NET, "BHS read %d\n", ISCSI_BHS_LEN);
+  errno = 0;
+  start = time(NULL);
+  iovec[0].iov_base = (void*) &pdu->bhs;
+  iovec[0].iov_len = ISCSI_BHS_LEN;
+  rc = istgt_iscsi_rx_readv_full(conn, &iovec[0], 1, ISCSI_BHS_LEN);
+  if (rc < 0) {
+    now = time(NULL);
+    if (errno == ECONNRESET) {
+      ISTGT_WARNLOG("Connection reset by peer (%s,time=%d)\n",
+                    conn->initiator_name,
+                    istgt_difftime(now, start));
+      conn->state = CONN_STATE_EXITING;
+    } else if (errno == ETIMEDOUT) {
+      ISTGT_WARNLOG("Operation timed out (%s,time=%d)\n",
+                    conn->initiator_name,
+                    istgt_difftime(now, start));
+      conn->state = CONN_STATE_EXITING;
+    } else {
+      ISTGT_ERRLOG("iscsi_read() failed (errno=%d,%s,time=%d)\n",
+                   errno,
+                   conn->initiator_name,
+                   istgt_difftime(now, start));
+    }
+    return -1;
+  }
+  if (rc == 0) {
+    ISTGT_TRACELOG(ISTGT_TRACE_NET, "recv() EOF (%s)\n", conn->initiator_name);
+    conn->state = CONN_STATE_EXITING;
+    return -1;
+  }
+  if (rc != ISCSI_BHS_LEN) {
+    ISTGT_ERRLOG("invalid BHS length (%d,%s)\n", rc, conn->initiator_name);
+    return -1;
+  }
+  total += ISCSI_BHS_LEN;
+
+  /* AHS+HD */
+  nbytes = istgt_iscsi_read_pdu_setup(conn, pdu, &iovec[0]);
+  if (nbytes < 0) {
+    return -1;
+  }
+  rc = istgt_iscsi_read_pdu_iovec(conn, &iovec[0], nbytes);
+  if (rc < 0) {
+    return -1;
+  }
+  total += nbytes;
+  rc = istgt_iscsi_read_pdu_check_header(conn, pdu);
+  if (rc < 0) {
+    return -1;
+  }
+
+  /* DATA+PAD+DD */
+  nbytes = istgt_iscsi_read_pdu_setup_data(conn, pdu, &iovec[0]);
+  if (nbytes < 0) {
+    return -1;
+  }
+  rc = istgt_iscsi_read_pdu_iovec(conn, &iovec[0], nbytes);
+  if (rc < 0) {
+    return -1;
+  }
+  total += nbytes;
+
+  rc = istgt_iscsi_read_pdu_check(conn, pdu);
+  if (rc < 0) {
+    return -1;
+  }
 
   return total;
 }
@@ -393,6 +715,81 @@ static int istgt_iscsi_write_pdu_upd(CONN_Ptr conn,
   return rc;
 }
 
+/*
+ * R2T and NOP-In go through a control lane which the sender always drains
+ * before the results, so they do not wait behind queued Data-In. Their
+ * StatSN is set when sent (REQUPDPDU). A TMF response stays in the result
+ * queue, it must not pass the responses of the tasks it aborted.
+ */
+static ISTGT_MPSC_QUEUE_Ptr istgt_iscsi_result_lane(CONN_Ptr conn,
+                                                    ISTGT_LU_TASK_Ptr lu_task) {
+  int opcode;
+
+  if (lu_task->type == ISTGT_LU_TASK_REQUPDPDU) {
+    opcode = BGET8W(&lu_task->lu_cmd.pdu->bhs.opcode, 5, 6);
+    if (opcode == ISCSI_OP_R2T || opcode == ISCSI_OP_NOPIN) {
+      return &conn->result_queue_ctl;
+    }
+  }
+  return &conn->result_queue;
+}
+
+/* next result to send, sender only */
+static ISTGT_LU_TASK_Ptr istgt_iscsi_pop_result(CONN_Ptr conn) {
+  ISTGT_LU_TASK_Ptr lu_task;
+
+  lu_task = istgt_mpsc_pop(&conn->result_queue_ctl);
+  if (lu_task == NULL) {
+    lu_task = istgt_mpsc_pop(&conn->result_queue);
+  }
+  return lu_task;
+}
+
+static void istgt_iscsi_set_result_idle(CONN_Ptr conn, int idle) {
+  istgt_mpsc_set_idle(&conn->result_queue_ctl, idle);
+  istgt_mpsc_set_idle(&conn->result_queue, idle);
+}
+
+/* pass lu_task to the thread sending responses of the connection */
+int istgt_iscsi_queue_result(CONN_Ptr conn, ISTGT_LU_TASK_Ptr lu_task) {
+  char tmp[1];
+  int rc;
+
+  tmp[0] = 'Q';
+  if (conn->use_sender == 0) {
+    MTX_LOCK(&conn->task_queue_mutex);
+    rc = istgt_queue_enqueue_node(&conn->task_queue, &lu_task->qnode, lu_task);
+    MTX_UNLOCK(&conn->task_queue_mutex);
+    if (rc < 0) {
+      ISTGT_ERRLOG("queue_enqueue() failed\n");
+      return -1;
+    }
+    rc = istgt_control_pipe_write(&conn->task_pipe, tmp, 1);
+    if (rc < 0 || rc != 1) {
+      ISTGT_ERRLOG("write() failed\n");
+      return -1;
+    }
+  } else {
+    /* lock-free, the sender is woken up only if idle */
+    if (istgt_mpsc_push(
+            istgt_iscsi_result_lane(conn, lu_task), &lu_task->qnode, lu_task)) {
+#ifdef ISTGT_USE_REACTOR
+      if (conn->reactor != NULL) {
+        return istgt_reactor_post(&conn->rev);
+      }
+#endif /* ISTGT_USE_REACTOR */
+      MTX_LOCK(&conn->result_queue_mutex);
+      rc = pthread_cond_broadcast(&conn->result_queue_cond);
+      MTX_UNLOCK(&conn->result_queue_mutex);
+      if (rc != 0) {
+        ISTGT_ERRLOG("cond_broadcast() failed\n");
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
 static int istgt_iscsi_write_pdu_queue(CONN_Ptr conn,
                                        ISCSI_PDU_Ptr pdu,
                                        int req_type,
@@ -424,7 +821,7 @@ static int istgt_iscsi_write_pdu_queue(CONN_Ptr conn,
     alloc_len += ISCSI_ALIGN(sizeof *lu_task->lu_cmd.pdu);
     alloc_len += ISCSI_ALIGN(4 * total_ahs_len);
     alloc_len += ISCSI_ALIGN(data_len);
-    lu_task = xmalloc(alloc_len);
+    lu_task = istgt_pool_alloc(alloc_len);
     memset(lu_task, 0, alloc_len);
     lu_task->lu_cmd.pdu =
         (ISCSI_PDU_Ptr)((uintptr_t) lu_task + ISCSI_ALIGN(sizeof *lu_task));
@@ -469,27 +866,327 @@ static int istgt_iscsi_write_pdu_queue(CONN_Ptr conn,
       total += ISCSI_DIGEST_LEN;
     }
 
-    /* insert to queue */
-    MTX_LOCK(&conn->result_queue_mutex);
-    rc = istgt_queue_enqueue(&conn->result_queue, lu_task);
-    if (rc != 0) {
-      MTX_UNLOCK(&conn->result_queue_mutex);
-      ISTGT_ERRLOG("queue_enqueue() failed\n");
+    /* insert to queue, notify to thread only if sleeping */
+    rc = istgt_iscsi_queue_result(conn, lu_task);
+    if (rc < 0) {
+      return -1;
+    }
+
+    /* total bytes should be sent in queue */
+    rc = total;
+  }
+  return rc;
+}
+
+/*
+ * The socket of a reactor connection is non-blocking. Bytes which cannot be
+ * written immediately are copied to txbuf and flushed on the next writable
+ * event, so the reactor thread never waits for a slow initiator.
+ * With the io_uring engine all PDUs are copied to txbuf, which is handed to
+ * the reactor as one send while the next PDUs fill the other buffer.
+ *
+ * While a batch of results is sent (tx_batch), PDUs up to
+ * ISTGT_TXBUF_COALESCE bytes are also collected in txbuf. A larger PDU is
+ * written with them in front of it by one writev, and the end of the batch
+ * writes the rest, so a burst of responses fills whole TCP segments.
+ */
+#define ISTGT_TXBUF_MIN (64 * 1024)
+#define ISTGT_TXBUF_KEEP (256 * 1024)
+#define ISTGT_TXBUF_COALESCE (16 * 1024)
+
+#ifdef ISTGT_USE_REACTOR
+#define ISTGT_CONN_URING(conn) \
+  ((conn)->reactor != NULL &&  \
+   (conn)->reactor->engine == ISTGT_REACTOR_ENGINE_URING)
+
+static int istgt_iscsi_conn_flush(CONN_Ptr conn);
+#else
+#define ISTGT_CONN_URING(conn) 0
+#endif /* ISTGT_USE_REACTOR */
+
+static uint8_t* istgt_iscsi_tx_reserve(CONN_Ptr conn, size_t len) {
+  size_t used;
+  size_t newsize;
+
+  used = conn->txtail - conn->txhead;
+  if (conn->txbufsize - conn->txtail >= len) {
+    return conn->txbuf + conn->txtail;
+  }
+  if (conn->txhead != 0) {
+    memmove(conn->txbuf, conn->txbuf + conn->txhead, used);
+    conn->txhead = 0;
+    conn->txtail = used;
+    if (conn->txbufsize - conn->txtail >= len) {
+      return conn->txbuf + conn->txtail;
+    }
+  }
+  newsize = DMAX64(conn->txbufsize, ISTGT_TXBUF_MIN);
+  while (newsize - used < len) {
+    newsize *= 2;
+  }
+  conn->txbuf = xrealloc(conn->txbuf, newsize);
+  conn->txbufsize = newsize;
+  return conn->txbuf + conn->txtail;
+}
+
+static void istgt_iscsi_tx_append(CONN_Ptr conn,
+                                  const struct iovec* iovec,
+                                  int iovcnt) {
+  uint8_t* cp;
+  size_t len;
+  int i;
+
+  len = 0;
+  for (i = 0; i < iovcnt; i++) {
+    len += iovec[i].iov_len;
+  }
+  if (len == 0)
+    return;
+  cp = istgt_iscsi_tx_reserve(conn, len);
+  for (i = 0; i < iovcnt; i++) {
+    if (iovec[i].iov_len == 0)
+      continue;
+    memcpy(cp, iovec[i].iov_base, iovec[i].iov_len);
+    cp += iovec[i].iov_len;
+  }
+  conn->txtail += len;
+}
+
+/* 1 if a PDU of nbytes is copied to txbuf instead of written now */
+static int istgt_iscsi_tx_copied(CONN_Ptr conn, size_t nbytes) {
+  if (conn->tx_blocked || ISTGT_CONN_URING(conn))
+    return 1;
+  /* in a batch, goes out with the next PDU or at the end of the batch */
+  return conn->tx_batch && nbytes <= ISTGT_TXBUF_COALESCE &&
+         conn->txtail - conn->txhead + nbytes <= ISTGT_TXBUF_MIN;
+}
+
+/* append BHS+AHS+HD+DATA+DD, the DataDigest is made while copying DATA */
+static void istgt_iscsi_tx_append_digest(CONN_Ptr conn,
+                                         const struct iovec* iovec,
+                                         size_t total) {
+  uint8_t* cp;
+  uint32_t crc32c;
+  int i;
+
+  cp = istgt_iscsi_tx_reserve(conn, total);
+  for (i = 0; i < 3; i++) {
+    if (iovec[i].iov_len == 0)
+      continue;
+    memcpy(cp, iovec[i].iov_base, iovec[i].iov_len);
+    cp += iovec[i].iov_len;
+  }
+  crc32c = istgt_update_crc32c_copy(
+      cp, iovec[3].iov_base, iovec[3].iov_len, ISTGT_CRC32C_INITIAL);
+  cp += iovec[3].iov_len;
+  MAKE_DIGEST_WORD(cp, crc32c ^ ISTGT_CRC32C_XOR);
+  conn->txtail += total;
+}
+
+/* write txbuf and iovec by one call, return bytes taken from iovec */
+static ssize_t istgt_iscsi_tx_sendv(CONN_Ptr conn,
+                                    struct iovec* iovec,
+                                    int iovcnt,
+                                    int flags) {
+  struct iovec vec[6]; /* txbuf+BHS+AHS+HD+DATA+DD */
+  size_t used;
+  ssize_t rc;
+  int n;
+  int i;
+
+  n = 0;
+  used = conn->txtail - conn->txhead;
+  if (used != 0) {
+    vec[n].iov_base = conn->txbuf + conn->txhead;
+    vec[n].iov_len = used;
+    n++;
+  }
+  for (i = 0; i < iovcnt && n < 6; i++) {
+    if (iovec[i].iov_len == 0)
+      continue;
+    vec[n++] = iovec[i];
+  }
+#ifdef MSG_MORE
+  if (flags != 0) {
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &vec[0];
+    msg.msg_iovlen = n;
+    rc = sendmsg(conn->sock, &msg, flags);
+  } else
+#endif /* MSG_MORE */
+    rc = istgt_writev_socket(conn->sock, &vec[0], n);
+  if (rc <= 0) {
+    return rc;
+  }
+  if ((size_t) rc < used) {
+    conn->txhead += rc;
+    return 0;
+  }
+  conn->txhead = conn->txtail = 0;
+  rc -= used;
+  istgt_iscsi_iovec_advance(iovec, iovcnt, rc);
+  return rc;
+}
+
+#ifdef ISTGT_USE_REACTOR
+/* io_uring engine, return 1 if txbuf is full while sending */
+static int istgt_iscsi_tx_submit(CONN_Ptr conn) {
+  ISTGT_REACTOR_EVENT_Ptr ev = &conn->rev;
+  uint8_t* buf;
+  size_t size;
+  ssize_t rc;
+
+  if (ev->state == ISTGT_REACTOR_EVENT_REMOVED) {
+    /* closing, the rest of a cancelled send goes first */
+    while (ev->send_off < ev->send_len) {
+      rc = send(conn->sock,
+                ev->send_buf + ev->send_off,
+                ev->send_len - ev->send_off,
+                0);
+      if (rc < 0) {
+        if (errno == EINTR)
+          continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+          return 1;
+        ISTGT_ERRLOG("send() failed (errno=%d,%s)\n",
+                     errno,
+                     conn->initiator_name);
+        return -1;
+      }
+      ev->send_off += rc;
+    }
+    ev->send_len = 0;
+    return 0;
+  }
+  if (ev->send_error != 0) {
+    ISTGT_ERRLOG("send() failed (errno=%d,%s)\n",
+                 ev->send_error,
+                 conn->initiator_name);
+    return -1;
+  }
+  if (ev->send_len != 0) {
+    return conn->txtail - conn->txhead >= ISTGT_TXBUF_KEEP ? 1 : 0;
+  }
+  if (conn->txhead == conn->txtail) {
+    return 0;
+  }
+
+  /* swap the buffers, a burst buffer is not kept for filling */
+  buf = conn->txsbuf;
+  size = conn->txsbufsize;
+  if (size > ISTGT_TXBUF_KEEP) {
+    xfree(buf);
+    buf = NULL;
+    size = 0;
+  }
+  conn->txsbuf = conn->txbuf;
+  conn->txsbufsize = conn->txbufsize;
+  conn->txbuf = buf;
+  conn->txbufsize = size;
+  rc = istgt_reactor_send(
+      ev, conn->txsbuf + conn->txhead, conn->txtail - conn->txhead);
+  conn->txhead = conn->txtail = 0;
+  if (rc < 0) {
+    ISTGT_ERRLOG("reactor_send() failed (errno=%d,%s)\n",
+                 errno,
+                 conn->initiator_name);
+    return -1;
+  }
+  return 0;
+}
+
+#endif /* ISTGT_USE_REACTOR */
+
+/* return 0 if all sent, 1 if the socket is full */
+static int istgt_iscsi_tx_flush(CONN_Ptr conn) {
+  ssize_t rc;
+
+#ifdef ISTGT_USE_REACTOR
+  if (ISTGT_CONN_URING(conn)) {
+    rc = istgt_iscsi_tx_submit(conn);
+    if (rc != 0 || conn->rev.state != ISTGT_REACTOR_EVENT_REMOVED) {
+      return (int) rc;
+    }
+    /* closing, write txbuf directly */
+  }
+#endif /* ISTGT_USE_REACTOR */
+  while (conn->txhead < conn->txtail) {
+    rc = istgt_iscsi_tx_sendv(conn, NULL, 0, 0);
+    if (rc < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        conn->tx_blocked = 1;
+        return 1;
+      }
+      ISTGT_ERRLOG("writev() failed (errno=%d,%s)\n",
+                   errno,
+                   conn->initiator_name);
       return -1;
     }
-    /* notify to thread */
-    rc = pthread_cond_broadcast(&conn->result_queue_cond);
-    MTX_UNLOCK(&conn->result_queue_mutex);
-    if (rc != 0) {
-      ISTGT_ERRLOG("cond_broadcast() failed\n");
+  }
+  conn->txhead = conn->txtail = 0;
+  conn->tx_blocked = 0;
+  if (conn->txbufsize > ISTGT_TXBUF_KEEP) {
+    /* drop the buffer grown by a burst */
+    xfree(conn->txbuf);
+    conn->txbuf = NULL;
+    conn->txbufsize = 0;
+  }
+  return 0;
+}
+
+/* write what the socket accepts now, keep the rest in txbuf */
+static int istgt_iscsi_tx_writev(CONN_Ptr conn,
+                                 struct iovec* iovec,
+                                 int iovcnt,
+                                 int nbytes) {
+  ssize_t rc;
+
+  if (istgt_iscsi_tx_copied(conn, nbytes)) {
+    istgt_iscsi_tx_append(conn, iovec, iovcnt);
+    return 0;
+  }
+  while (nbytes > 0) {
+    rc = istgt_iscsi_tx_sendv(conn, iovec, iovcnt, 0);
+    if (rc < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        conn->tx_blocked = 1;
+        break;
+      }
+      ISTGT_ERRLOG("writev() failed (errno=%d,%s)\n",
+                   errno,
+                   conn->initiator_name);
       return -1;
     }
+    nbytes -= rc;
+  }
+  if (nbytes > 0) {
+    istgt_iscsi_tx_append(conn, iovec, iovcnt);
+  }
+  return 0;
+}
 
-    /* total bytes should be sent in queue */
-    rc = total;
+#ifdef ISTGT_USE_REACTOR
+
+/* wait for the socket in the blocking paths (LU without queue) */
+static int istgt_iscsi_conn_wait(CONN_Ptr conn, int events) {
+  int rc;
+
+  rc = istgt_iscsi_conn_flush(conn);
+  if (rc < 0) {
+    return -1;
   }
-  return rc;
+  if (conn->txhead != conn->txtail || conn->rev.send_len != 0) {
+    events |= ISTGT_REACTOR_WRITE;
+  }
+  return istgt_reactor_wait(&conn->rev, events, conn->timeout * 1000);
 }
+#endif /* ISTGT_USE_REACTOR */
 
 static int istgt_iscsi_write_pdu_internal(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
   struct iovec iovec[5]; /* BHS+AHS+HD+DATA+DD */
@@ -522,8 +1219,8 @@ static int istgt_iscsi_write_pdu_internal(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
   iovec[0].iov_len = ISCSI_BHS_LEN;
   total += ISCSI_BHS_LEN;
 
-  /* AHS */
-  iovec[1].iov_base = pdu->ahs;
+  /* AHS (pointer is not set by responses without AHS) */
+  iovec[1].iov_base = total_ahs_len != 0 ? pdu->ahs : NULL;
   iovec[1].iov_len = 4 * total_ahs_len;
   total += (4 * total_ahs_len);
 
@@ -553,18 +1250,24 @@ static int istgt_iscsi_write_pdu_internal(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
   }
 
   /* Data Segment */
-  iovec[3].iov_base = pdu->data;
+  iovec[3].iov_base = data_len != 0 ? pdu->data : NULL;
   iovec[3].iov_len = ISCSI_ALIGN(data_len);
   total += ISCSI_ALIGN(data_len);
 
   /* Data Digest */
   iovec[4].iov_base = pdu->data_digest;
   if (enable_digest && conn->data_digest && data_len != 0) {
-    crc32c = istgt_crc32c(pdu->data, ISCSI_ALIGN(data_len));
-    MAKE_DIGEST_WORD(pdu->data_digest, crc32c);
-
     iovec[4].iov_len = ISCSI_DIGEST_LEN;
     total += ISCSI_DIGEST_LEN;
+    if ((conn->reactor != NULL || conn->tx_batch) &&
+        istgt_iscsi_tx_copied(conn, total)) {
+      /* digest while the data is copied, not in a pass of its own */
+      ISTGT_TRACELOG(ISTGT_TRACE_NET, "PDU write %d\n", total);
+      istgt_iscsi_tx_append_digest(conn, &iovec[0], total);
+      return total;
+    }
+    crc32c = istgt_crc32c(pdu->data, ISCSI_ALIGN(data_len));
+    MAKE_DIGEST_WORD(pdu->data_digest, crc32c);
   } else {
     iovec[4].iov_len = 0;
   }
@@ -572,6 +1275,13 @@ static int istgt_iscsi_write_pdu_internal(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
   /* write all bytes from iovec */
   nbytes = total;
   ISTGT_TRACELOG(ISTGT_TRACE_NET, "PDU write %d\n", nbytes);
+  if (conn->reactor != NULL || conn->tx_batch) {
+    rc = istgt_iscsi_tx_writev(conn, &iovec[0], 5, nbytes);
+    if (rc < 0) {
+      return -1;
+    }
+    return total;
+  }
   errno = 0;
   start = time(NULL);
   while (nbytes > 0) {
@@ -603,6 +1313,212 @@ static int istgt_iscsi_write_pdu_internal(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
   return total;
 }
 
+#ifdef ISTGT_USE_SENDFILE
+/* sendfile() while the socket accepts, the rest is read into txbuf */
+static int istgt_iscsi_tx_file(CONN_Ptr conn,
+                               struct iovec* iovec,
+                               int hlen,
+                               int fd,
+                               uint64_t offset,
+                               int data_len) {
+  static uint8_t zero[4096];
+  struct iovec zvec[1];
+  uint8_t* cp;
+  size_t nbytes;
+  size_t pad;
+  ssize_t rc;
+
+  nbytes = data_len;
+  pad = ISCSI_ALIGN(data_len) - data_len;
+  /* a small segment costs one pread instead of sendmsg and sendfile */
+  if (!istgt_iscsi_tx_copied(conn, hlen + ISCSI_ALIGN(data_len))) {
+    while (hlen > 0) {
+      /* collected PDUs and header go out with the data */
+      rc = istgt_iscsi_tx_sendv(
+          conn, &iovec[0], 2, data_len != 0 ? MSG_MORE : 0);
+      if (rc < 0) {
+        if (errno == EINTR)
+          continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          conn->tx_blocked = 1;
+          break;
+        }
+        ISTGT_ERRLOG("sendmsg() failed (errno=%d,%s)\n",
+                     errno,
+                     conn->initiator_name);
+        return -1;
+      }
+      hlen -= rc;
+    }
+    while (hlen == 0 && nbytes > 0) {
+      rc = istgt_sendfile_socket(conn->sock, fd, offset, nbytes);
+      if (rc < 0) {
+        if (errno == EINTR)
+          continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          conn->tx_blocked = 1;
+          break;
+        }
+        ISTGT_ERRLOG("sendfile() failed (errno=%d,%s)\n",
+                     errno,
+                     conn->initiator_name);
+        return -1;
+      }
+      if (rc == 0) {
+        /* beyond EOF of sparse file, reads as zero */
+        pad += nbytes;
+        nbytes = 0;
+        break;
+      }
+      nbytes -= rc;
+      offset += rc;
+    }
+  }
+  if (hlen > 0) {
+    istgt_iscsi_tx_append(conn, &iovec[0], 2);
+  }
+  if (nbytes > 0) {
+    cp = istgt_iscsi_tx_reserve(conn, nbytes);
+    while (nbytes > 0) {
+      rc = pread(fd, cp, nbytes, offset);
+      if (rc < 0) {
+        if (errno == EINTR)
+          continue;
+        ISTGT_ERRLOG("pread() failed (errno=%d,%s)\n",
+                     errno,
+                     conn->initiator_name);
+        return -1;
+      }
+      if (rc == 0) {
+        memset(cp, 0, nbytes);
+        rc = nbytes;
+      }
+      cp += rc;
+      conn->txtail += rc;
+      nbytes -= rc;
+      offset += rc;
+    }
+  }
+  while (pad > 0) {
+    zvec[0].iov_base = zero;
+    zvec[0].iov_len = DMIN32(pad, sizeof zero);
+    pad -= zvec[0].iov_len;
+    rc = istgt_iscsi_tx_writev(conn, &zvec[0], 1, zvec[0].iov_len);
+    if (rc < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* write Data-In PDU without AHS/DataDigest, data segment is read from fd */
+static int istgt_iscsi_write_pdu_file(CONN_Ptr conn,
+                                      ISCSI_PDU_Ptr pdu,
+                                      int fd,
+                                      uint64_t offset) {
+  static uint8_t zero[4096];
+  struct iovec iovec[2]; /* BHS+HD */
+  struct msghdr msg;
+  uint8_t* cp;
+  uint32_t crc32c;
+  size_t nbytes;
+  size_t pad;
+  int data_len;
+  int total;
+  int rc;
+
+  cp = (uint8_t*) &pdu->bhs;
+  data_len = DGET24(&cp[5]);
+  total = 0;
+
+  iovec[0].iov_base = &pdu->bhs;
+  iovec[0].iov_len = ISCSI_BHS_LEN;
+  total += ISCSI_BHS_LEN;
+  iovec[1].iov_base = pdu->header_digest;
+  if (conn->header_digest) {
+    crc32c = istgt_crc32c((uint8_t*) &pdu->bhs, ISCSI_BHS_LEN);
+    MAKE_DIGEST_WORD(pdu->header_digest, crc32c);
+    iovec[1].iov_len = ISCSI_DIGEST_LEN;
+    total += ISCSI_DIGEST_LEN;
+  } else {
+    iovec[1].iov_len = 0;
+  }
+
+  ISTGT_TRACELOG(
+      ISTGT_TRACE_NET, "PDU write %d+%d(file)\n", total, ISCSI_ALIGN(data_len));
+  if (conn->reactor != NULL || conn->tx_batch) {
+    rc = istgt_iscsi_tx_file(conn, &iovec[0], total, fd, offset, data_len);
+    if (rc < 0) {
+      return -1;
+    }
+    return total + ISCSI_ALIGN(data_len);
+  }
+  memset(&msg, 0, sizeof msg);
+  msg.msg_iov = &iovec[0];
+  msg.msg_iovlen = 2;
+  nbytes = total;
+  while (nbytes > 0) {
+    /* header goes out with the first data segment */
+    rc = sendmsg(conn->sock, &msg, data_len != 0 ? MSG_MORE : 0);
+    if (rc < 0) {
+      if (errno == EINTR)
+        continue;
+      ISTGT_ERRLOG("sendmsg() failed (errno=%d,%s)\n",
+                   errno,
+                   conn->initiator_name);
+      return -1;
+    }
+    nbytes -= rc;
+    while (rc > 0 && msg.msg_iovlen > 0) {
+      if (msg.msg_iov->iov_len > (size_t) rc) {
+        msg.msg_iov->iov_base = (uint8_t*) msg.msg_iov->iov_base + rc;
+        msg.msg_iov->iov_len -= rc;
+        rc = 0;
+      } else {
+        rc -= msg.msg_iov->iov_len;
+        msg.msg_iov++;
+        msg.msg_iovlen--;
+      }
+    }
+  }
+
+  nbytes = data_len;
+  pad = ISCSI_ALIGN(data_len) - data_len;
+  while (nbytes > 0) {
+    rc = istgt_sendfile_socket(conn->sock, fd, offset, nbytes);
+    if (rc < 0) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      ISTGT_ERRLOG("sendfile() failed (errno=%d,%s)\n",
+                   errno,
+                   conn->initiator_name);
+      return -1;
+    }
+    if (rc == 0) {
+      /* beyond EOF of sparse file, reads as zero */
+      pad += nbytes;
+      break;
+    }
+    nbytes -= rc;
+    offset += rc;
+  }
+  while (pad > 0) {
+    rc = send(conn->sock, zero, DMIN32(pad, sizeof zero), 0);
+    if (rc < 0) {
+      if (errno == EINTR)
+        continue;
+      ISTGT_ERRLOG("send() failed (errno=%d,%s)\n",
+                   errno,
+                   conn->initiator_name);
+      return -1;
+    }
+    pad -= rc;
+  }
+
+  return total + ISCSI_ALIGN(data_len);
+}
+#endif /* ISTGT_USE_SENDFILE */
+
 int istgt_iscsi_copy_pdu(ISCSI_PDU_Ptr dst_pdu, ISCSI_PDU_Ptr src_pdu) {
   memcpy(&dst_pdu->bhs, &src_pdu->bhs, ISCSI_BHS_LEN);
   dst_pdu->ahs = src_pdu->ahs;
@@ -2662,6 +3578,21 @@ static int istgt_iscsi_op_logout(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
 
 static int istgt_iscsi_transfer_in_internal(CONN_Ptr conn,
                                             ISTGT_LU_CMD_Ptr lu_cmd);
+static int istgt_iscsi_send_result(CONN_Ptr conn, ISTGT_LU_TASK_Ptr lu_task);
+
+/* send the control lane between Data-In PDUs of a long read, sender only */
+static int istgt_iscsi_send_ctl_results(CONN_Ptr conn) {
+  ISTGT_LU_TASK_Ptr lu_task;
+  int rc;
+
+  while ((lu_task = istgt_mpsc_pop(&conn->result_queue_ctl)) != NULL) {
+    rc = istgt_iscsi_send_result(conn, lu_task);
+    if (rc < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
 
 static int istgt_iscsi_transfer_in(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
   int rc;
@@ -2805,11 +3736,24 @@ static int istgt_iscsi_transfer_in_internal(CONN_Ptr conn,
       DSET32(&rsp[44], 0);
     }
 
-    rc = istgt_iscsi_write_pdu_internal(conn, &rsp_pdu);
+#ifdef ISTGT_USE_SENDFILE
+    if (lu_cmd->data_file) {
+      rc = istgt_iscsi_write_pdu_file(
+          conn, &rsp_pdu, lu_cmd->data_fd, lu_cmd->data_offset + offset);
+    } else
+#endif
+      rc = istgt_iscsi_write_pdu_internal(conn, &rsp_pdu);
     if (rc < 0) {
       ISTGT_ERRLOG("iscsi_write_pdu() failed\n");
       return -1;
     }
+    if (conn->tx_batch && F_bit == 0) {
+      /* R2T and NOP-In queued meanwhile do not wait for the whole read */
+      rc = istgt_iscsi_send_ctl_results(conn);
+      if (rc < 0) {
+        return -1;
+      }
+    }
   }
 
   if (sent_status) {
@@ -2842,6 +3786,9 @@ static int istgt_iscsi_op_scsi(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
     ISTGT_ERRLOG("before Full Feature\n");
     return -1;
   }
+  if (conn->reactor != NULL) {
+    conn->reactor->ncommands++;
+  }
 
   data_len = 0;
   alloc_len = conn->sendbufsize;
@@ -3018,8 +3965,8 @@ static int istgt_iscsi_op_scsi(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
   lu_cmd.sense_data_len = 0;
   lu_cmd.sense_alloc_len = conn->snsbufsize;
 
-  /* need R2T? */
-  if ((W_bit && F_bit) && (conn->max_r2t > 0)) {
+  /* need R2T? (reactor sends it when the task is queued) */
+  if ((W_bit && F_bit) && (conn->max_r2t > 0) && conn->reactor == NULL) {
     if (lu_cmd.pdu->data_segment_len < transfer_len) {
       rc = istgt_add_transfer_task(conn, &lu_cmd);
       if (rc < 0) {
@@ -3129,20 +4076,6 @@ static int istgt_iscsi_op_scsi(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
   return 0;
 }
 
-static int istgt_iscsi_task_transfer_out(CONN_Ptr conn,
-                                         ISTGT_LU_TASK_Ptr lu_task) {
-  ISTGT_LU_CMD_Ptr lu_cmd;
-  uint32_t transfer_len;
-  int rc;
-
-  lu_cmd = &lu_task->lu_cmd;
-  transfer_len = lu_cmd->transfer_len;
-
-  rc = istgt_iscsi_transfer_out(
-      conn, lu_cmd, lu_cmd->iobuf, lu_cmd->iobufsize, transfer_len);
-  return rc;
-}
-
 static int istgt_iscsi_task_response(CONN_Ptr conn,
                                      ISTGT_LU_TASK_Ptr lu_task) {
   ISTGT_LU_CMD_Ptr lu_cmd;
@@ -3589,11 +4522,18 @@ static ISTGT_R2T_TASK_Ptr istgt_allocate_transfer_task(void) {
 static void istgt_free_transfer_task(ISTGT_R2T_TASK_Ptr r2t_task) {
   if (r2t_task == NULL)
     return;
-  xfree(r2t_task->iobuf);
+  if (r2t_task->lu_task != NULL) {
+    /* iobuf belongs to the task */
+    (void) istgt_lu_destroy_task(r2t_task->lu_task);
+  } else {
+    istgt_pool_free(r2t_task->iobuf);
+  }
   xfree(r2t_task);
 }
 
+/* unsolicited Data-Out (transfer_tag 0xffffffff) is matched by task_tag */
 static ISTGT_R2T_TASK_Ptr istgt_get_transfer_task(CONN_Ptr conn,
+                                                  uint32_t task_tag,
                                                   uint32_t transfer_tag) {
   ISTGT_R2T_TASK_Ptr r2t_task;
   int i;
@@ -3610,7 +4550,8 @@ static ISTGT_R2T_TASK_Ptr istgt_get_transfer_task(CONN_Ptr conn,
 		    "CmdSN=%d, TransferTag=%x/%x\n",
 		    r2t_task->CmdSN, r2t_task->transfer_tag, transfer_tag);
 #endif
-    if (r2t_task->transfer_tag == transfer_tag) {
+    if (r2t_task->transfer_tag == transfer_tag &&
+        (transfer_tag != 0xffffffffU || r2t_task->task_tag == task_tag)) {
       ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
                      "Match index=%d, CmdSN=%d, TransferTag=%x\n",
                      i,
@@ -3664,8 +4605,8 @@ static int istgt_add_transfer_task(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
     r2t_task->transfer_len = transfer_len;
     r2t_task->transfer_tag = transfer_tag;
 
-    r2t_task->iobufsize = lu_cmd->transfer_len + 65536;
-    r2t_task->iobuf = xmalloc(r2t_task->iobufsize);
+    r2t_task->iobufsize = lu_cmd->transfer_len;
+    r2t_task->iobuf = istgt_pool_alloc(r2t_task->iobufsize);
     memcpy(r2t_task->iobuf, lu_cmd->pdu->data, data_len);
     r2t_task->offset = offset;
     r2t_task->R2TSN = 0;
@@ -3822,7 +4763,7 @@ static int istgt_iscsi_op_data(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
 
   ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "pending R2T = %d\n", conn->pending_r2t);
 
-  r2t_task = istgt_get_transfer_task(conn, transfer_tag);
+  r2t_task = istgt_get_transfer_task(conn, task_tag, transfer_tag);
   if (r2t_task == NULL) {
     ISTGT_ERRLOG("Not found R2T task for transfer_tag=%x\n", transfer_tag);
     goto reject_return;
@@ -3865,13 +4806,20 @@ static int istgt_iscsi_op_data(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
     return -1;
   }
 
-  memcpy(data + buffer_offset, pdu->data, data_len);
+  if (pdu->data != data + buffer_offset) {
+    memcpy(data + buffer_offset, pdu->data, data_len);
+  }
   offset += data_len;
   ExpDataSN++;
 
   r2t_task->offset = offset;
   r2t_task->DataSN = ExpDataSN;
   r2t_task->F_bit = F_bit;
+#ifdef ISTGT_USE_REACTOR
+  if (r2t_task->lu_task != NULL) {
+    return istgt_iscsi_transfer_out_next(conn, r2t_task);
+  }
+#endif /* ISTGT_USE_REACTOR */
   return 0;
 }
 
@@ -3982,7 +4930,8 @@ int istgt_iscsi_transfer_out(CONN_Ptr conn,
                  max_burst_len,
                  segment_len);
 
-  r2t_task = istgt_get_transfer_task(conn, current_transfer_tag);
+  r2t_task =
+      istgt_get_transfer_task(conn, current_task_tag, current_transfer_tag);
   if (r2t_task != NULL) {
     current_lun = r2t_task->lun;
     current_task_tag = r2t_task->task_tag;
@@ -3994,7 +4943,18 @@ int istgt_iscsi_transfer_out(CONN_Ptr conn,
     r2t_flag = 1;
     data_len = 0;
 
-    memcpy(data, r2t_task->iobuf, offset);
+    if (lu_cmd->lu_task != NULL && data == lu_cmd->iobuf &&
+        lu_cmd->lu_task->r2t_iobuf == NULL) {
+      /* take over the buffer received by R2T task */
+      lu_cmd->lu_task->r2t_iobuf = r2t_task->iobuf;
+      lu_cmd->iobuf = r2t_task->iobuf;
+      lu_cmd->iobufsize = r2t_task->iobufsize;
+      data = lu_cmd->iobuf;
+      alloc_len = lu_cmd->iobufsize;
+      r2t_task->iobuf = NULL;
+    } else {
+      memcpy(data, r2t_task->iobuf, offset);
+    }
     istgt_del_transfer_task(conn, r2t_task);
     istgt_free_transfer_task(r2t_task);
 
@@ -4089,7 +5049,12 @@ int istgt_iscsi_transfer_out(CONN_Ptr conn,
       }
 
       /* transfer by segment_len */
+      conn->dataout_task_tag = current_task_tag;
+      conn->dataout_transfer_tag = current_transfer_tag;
+      conn->dataout_buf = data;
+      conn->dataout_len = alloc_len;
       rc = istgt_iscsi_read_pdu(conn, &data_pdu);
+      conn->dataout_buf = NULL;
       if (rc < 0) {
         // ISTGT_ERRLOG("iscsi_read_pdu() failed\n");
         ISTGT_ERRLOG("iscsi_read_pdu() failed, r2t_sent=%d\n", r2t_sent);
@@ -4120,7 +5085,7 @@ int istgt_iscsi_transfer_out(CONN_Ptr conn,
             ISTGT_ERRLOG("iscsi_op_data() failed\n");
             goto error_return;
           }
-          if (data_pdu.data != data_pdu.shortdata) {
+          if (data_pdu.copy_pdu == 0 && data_pdu.data != data_pdu.shortdata) {
             xfree(data_pdu.data);
           }
           data_pdu.ahs = NULL;
@@ -4227,7 +5192,9 @@ int istgt_iscsi_transfer_out(CONN_Ptr conn,
         goto error_return;
       }
 
-      memcpy(data + buffer_offset, data_pdu.data, data_len);
+      if (data_pdu.data != data + buffer_offset) {
+        memcpy(data + buffer_offset, data_pdu.data, data_len);
+      }
       offset += data_len;
       len -= data_len;
       ExpDataSN++;
@@ -4264,27 +5231,179 @@ int istgt_iscsi_transfer_out(CONN_Ptr conn,
       }
     } while (offset < transfer_len);
 
-    cp = (uint8_t*) &data_pdu.bhs;
-    F_bit = BGET8(&cp[1], 7);
-    if (F_bit == 0) {
-      ISTGT_ERRLOG("F_bit not set on the last PDU\n");
-      return -1;
-    }
-  } else {
-    cp = (uint8_t*) &lu_cmd->pdu->bhs;
-    F_bit = BGET8(&cp[1], 7);
-    if (F_bit == 0) {
-      ISTGT_ERRLOG("F_bit not set on the last PDU\n");
-      return -1;
-    }
+    cp = (uint8_t*) &data_pdu.bhs;
+    F_bit = BGET8(&cp[1], 7);
+    if (F_bit == 0) {
+      ISTGT_ERRLOG("F_bit not set on the last PDU\n");
+      return -1;
+    }
+  } else {
+    cp = (uint8_t*) &lu_cmd->pdu->bhs;
+    F_bit = BGET8(&cp[1], 7);
+    if (F_bit == 0) {
+      ISTGT_ERRLOG("F_bit not set on the last PDU\n");
+      return -1;
+    }
+  }
+
+r2t_return:
+  ISTGT_TRACELOG(
+      ISTGT_TRACE_DEBUG, "Transfered=%zd, Offset=%zd\n", transfer_len, offset);
+
+  return 0;
+}
+
+#ifdef ISTGT_USE_REACTOR
+/* R2T for the next burst of the queued task */
+static int istgt_iscsi_transfer_out_r2t(CONN_Ptr conn,
+                                        ISTGT_R2T_TASK_Ptr r2t_task) {
+  int len;
+  int rc;
+
+  len = DMIN32(conn->MaxBurstLength,
+               (r2t_task->transfer_len - r2t_task->offset));
+  r2t_task->transfer_tag = r2t_task->task_tag;
+  r2t_task->DataSN = 0;
+  r2t_task->burst_end = r2t_task->offset + len;
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
+                 "R2T, Transfer=%u, Offset=%d, Len=%d\n",
+                 r2t_task->transfer_len,
+                 r2t_task->offset,
+                 len);
+  rc = istgt_iscsi_send_r2t(conn,
+                            &r2t_task->lu_task->lu_cmd,
+                            r2t_task->offset,
+                            len,
+                            r2t_task->transfer_tag,
+                            &r2t_task->R2TSN);
+  if (rc < 0) {
+    ISTGT_ERRLOG("iscsi_send_r2t() failed\n");
+    return -1;
+  }
+  return 0;
+}
+
+/* called after each Data-Out of the queued task */
+static int istgt_iscsi_transfer_out_next(CONN_Ptr conn,
+                                         ISTGT_R2T_TASK_Ptr r2t_task) {
+  ISTGT_LU_TASK_Ptr lu_task;
+
+  if (r2t_task->offset > r2t_task->burst_end) {
+    ISTGT_ERRLOG("offset(%d) beyond burst(%d)\n",
+                 r2t_task->offset,
+                 r2t_task->burst_end);
+    return -1;
+  }
+  if (r2t_task->F_bit == 0) {
+    if (r2t_task->offset == r2t_task->burst_end) {
+      ISTGT_ERRLOG("F_bit not set on the last PDU\n");
+      return -1;
+    }
+    return 0;
+  }
+  if (r2t_task->offset < r2t_task->transfer_len) {
+    return istgt_iscsi_transfer_out_r2t(conn, r2t_task);
+  }
+
+  /* all data received, pass the task to LU threads */
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
+                 "Transfered=%u, CmdSN=%u\n",
+                 r2t_task->transfer_len,
+                 r2t_task->CmdSN);
+  lu_task = r2t_task->lu_task;
+  istgt_del_transfer_task(conn, r2t_task);
+  r2t_task->lu_task = NULL;
+  r2t_task->iobuf = NULL;
+  istgt_free_transfer_task(r2t_task);
+  return istgt_lu_queue_ready(lu_task);
+}
+
+/*
+ * Receive Data-Out of a queued write on the reactor without waiting.
+ * Returns 1 if istgt_lu_queue_ready() will be called with lu_task, 0 if
+ * the caller should use istgt_iscsi_transfer_out(). lu_task already
+ * holds its place in the task set.
+ */
+int istgt_iscsi_transfer_out_async(CONN_Ptr conn, ISTGT_LU_TASK_Ptr lu_task) {
+  ISTGT_LU_CMD_Ptr lu_cmd;
+  ISTGT_R2T_TASK_Ptr r2t_task;
+  ISTGT_R2T_TASK_Ptr* r2t_tasks;
+  size_t data_len;
+  int slots;
+  int rc;
+  int i;
+
+  lu_cmd = &lu_task->lu_cmd;
+  if (conn->reactor == NULL || conn->sess == NULL) {
+    return 0;
+  }
+  data_len = lu_cmd->pdu->data_segment_len;
+  if (lu_cmd->transfer_len > lu_cmd->iobufsize) {
+    ISTGT_ERRLOG("transfer_len > alloc_len\n");
+    return -1;
+  }
+  if (data_len > (size_t) conn->FirstBurstLength) {
+    ISTGT_ERRLOG("data_len > first_burst_len\n");
+    return -1;
   }
 
-r2t_return:
-  ISTGT_TRACELOG(
-      ISTGT_TRACE_DEBUG, "Transfered=%zd, Offset=%zd\n", transfer_len, offset);
+  r2t_task = istgt_allocate_transfer_task();
+  r2t_task->conn = conn;
+  r2t_task->lu = lu_cmd->lu;
+  r2t_task->lun = lu_cmd->lun;
+  r2t_task->CmdSN = lu_cmd->CmdSN;
+  r2t_task->task_tag = lu_cmd->task_tag;
+  r2t_task->transfer_len = lu_cmd->transfer_len;
+  r2t_task->iobuf = lu_task->iobuf;
+  r2t_task->iobufsize = lu_cmd->iobufsize;
+  r2t_task->lu_task = lu_task;
+  if (data_len != 0) {
+    memcpy(r2t_task->iobuf, lu_cmd->pdu->data, data_len);
+  }
+  r2t_task->offset = data_len;
+  r2t_task->R2TSN = 0;
+  r2t_task->DataSN = 0;
+  lu_cmd->lu_task = lu_task;
+  lu_cmd->iobuf = lu_task->iobuf;
+
+  MTX_LOCK(&conn->r2t_mutex);
+  if (conn->pending_r2t >= conn->r2t_slots) {
+    /* one entry per queued write, not limited by MaxOutstandingR2T */
+    slots = conn->r2t_slots * 2;
+    r2t_tasks = xrealloc(conn->r2t_tasks, sizeof *r2t_tasks * (slots + 1));
+    for (i = conn->r2t_slots + 1; i < slots + 1; i++) {
+      r2t_tasks[i] = NULL;
+    }
+    conn->r2t_tasks = r2t_tasks;
+    conn->r2t_slots = slots;
+  }
+  conn->r2t_tasks[conn->pending_r2t++] = r2t_task;
+  MTX_UNLOCK(&conn->r2t_mutex);
 
+  if (lu_cmd->F_bit == 0) {
+    /* unsolicited Data-Out follows */
+    r2t_task->transfer_tag = 0xffffffffU;
+    r2t_task->F_bit = 0;
+    r2t_task->burst_end =
+        DMIN32(conn->FirstBurstLength, r2t_task->transfer_len);
+    return 1;
+  }
+  r2t_task->F_bit = 1;
+  rc = istgt_iscsi_transfer_out_r2t(conn, r2t_task);
+  if (rc < 0) {
+    istgt_del_transfer_task(conn, r2t_task);
+    r2t_task->lu_task = NULL;
+    r2t_task->iobuf = NULL;
+    istgt_free_transfer_task(r2t_task);
+    return -1;
+  }
+  return 1;
+}
+#else
+int istgt_iscsi_transfer_out_async(CONN_Ptr conn, ISTGT_LU_TASK_Ptr lu_task) {
   return 0;
 }
+#endif /* ISTGT_USE_REACTOR */
 
 static int istgt_iscsi_send_nopin(CONN_Ptr conn) {
   ISCSI_PDU rsp_pdu;
@@ -4437,155 +5556,49 @@ static int istgt_iscsi_execute(CONN_Ptr conn, ISCSI_PDU_Ptr pdu) {
   return 0;
 }
 
+/* wait for the tasks taken by LU threads or the backend, in every mode */
 static void wait_all_task(CONN_Ptr conn) {
   ISTGT_LU_TASK_Ptr lu_task;
-#ifdef ISTGT_USE_KQUEUE
-  int kq;
-  struct kevent kev;
-  struct timespec kev_timeout;
-#else
-  struct pollfd fds[1];
-#endif /* ISTGT_USE_KQUEUE */
-  int msec = 30 * 1000;
+  int msec = 0;
   int rc;
 
-  if (conn->running_tasks == 0)
-    return;
-
-#ifdef ISTGT_USE_KQUEUE
-  kq = kqueue();
-  if (kq == -1) {
-    ISTGT_ERRLOG("kqueue() failed\n");
-    return;
-  }
-  ISTGT_EV_SET(&kev, conn->task_pipe.fd[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
-  rc = kevent(kq, &kev, 1, NULL, 0, NULL);
-  if (rc == -1) {
-    ISTGT_ERRLOG("kevent() failed\n");
-    close(kq);
-    return;
-  }
-#else
-  fds[0].fd = conn->task_pipe.fd[0];
-  fds[0].events = POLLIN;
-#endif /* ISTGT_USE_KQUEUE */
-
-  /* wait all running tasks */
   ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
                  "waiting task start (%d) (left %d tasks)\n",
                  conn->id,
-                 conn->running_tasks);
-  while (1) {
-#ifdef ISTGT_USE_KQUEUE
-    kev_timeout.tv_sec = msec / 1000;
-    kev_timeout.tv_nsec = (msec % 1000) * 1000000;
-    rc = kevent(kq, NULL, 0, &kev, 1, &kev_timeout);
-    if (rc == -1 && errno == EINTR) {
-      continue;
-    }
-    if (rc == -1) {
-      ISTGT_ERRLOG("kevent() failed\n");
-      break;
-    }
-    if (rc == 0) {
-      ISTGT_ERRLOG("waiting task timeout (left %d tasks)\n",
-                   conn->running_tasks);
-      break;
-    }
-#else
-    rc = poll(fds, 1, msec);
-    if (rc == -1 && errno == EINTR) {
-      continue;
-    }
-    if (rc == -1) {
-      ISTGT_ERRLOG("poll() failed\n");
-      break;
-    }
-    if (rc == 0) {
-      ISTGT_ERRLOG("waiting task timeout (left %d tasks)\n",
-                   conn->running_tasks);
-      break;
-    }
-#endif /* ISTGT_USE_KQUEUE */
-
-#ifdef ISTGT_USE_KQUEUE
-    if (kev.ident == (uintptr_t) conn->task_pipe.fd[0]) {
-      if (kev.flags & (EV_EOF | EV_ERROR)) {
-        break;
-      }
-#else
-    if (fds[0].revents & POLLHUP) {
-      break;
+                 __atomic_load_n(&conn->lu_tasks, __ATOMIC_SEQ_CST));
+  /* queued tasks are cleared, running ones still queue their results */
+  while (__atomic_load_n(&conn->lu_tasks, __ATOMIC_SEQ_CST) != 0) {
+    if (msec == 30 * 1000) {
+      ISTGT_WARNLOG("waiting task (left %d tasks)\n",
+                    __atomic_load_n(&conn->lu_tasks, __ATOMIC_SEQ_CST));
+      msec = 0;
     }
-    if (fds[0].revents & POLLIN) {
-#endif /* ISTGT_USE_KQUEUE */
-      char tmp[1];
-
-      rc = istgt_control_pipe_read(&conn->task_pipe, tmp, 1);
-      printf("task %d %d\n", rc, (int) tmp[0]);
-
-      if (rc < 0 || rc == 0 || rc != 1) {
-        ISTGT_ERRLOG("read() failed\n");
-        break;
-      }
+    usleep(1000);
+    msec++;
+  }
 
+  if (conn->use_sender == 0) {
+    /* results passed through the task pipe, ignore response */
+    while (1) {
       MTX_LOCK(&conn->task_queue_mutex);
       lu_task = istgt_queue_dequeue(&conn->task_queue);
       MTX_UNLOCK(&conn->task_queue_mutex);
-      if (lu_task != NULL) {
-        if (lu_task->lu_cmd.W_bit) {
-          /* write */
-          if (lu_task->req_transfer_out != 0) {
-            /* error transfer */
-            lu_task->error = 1;
-            lu_task->abort = 1;
-            rc = pthread_cond_broadcast(&lu_task->trans_cond);
-            if (rc != 0) {
-              ISTGT_ERRLOG("cond_broadcast() failed\n");
-              /* ignore error */
-            }
-          } else {
-            if (lu_task->req_execute) {
-              conn->running_tasks--;
-              if (conn->running_tasks == 0) {
-                ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "task cleanup finished\n");
-                break;
-              }
-            }
-            /* ignore response */
-            rc = istgt_lu_destroy_task(lu_task);
-            if (rc < 0) {
-              ISTGT_ERRLOG("lu_destroy_task() failed\n");
-              /* ignore error */
-            }
-          }
-        } else {
-          /* read or no data */
-          /* ignore response */
-          rc = istgt_lu_destroy_task(lu_task);
-          if (rc < 0) {
-            ISTGT_ERRLOG("lu_destroy_task() failed\n");
-            /* ignore error */
-          }
-        }
-      } else {
-        ISTGT_ERRLOG("lu_task is NULL\n");
+      if (lu_task == NULL)
         break;
+      rc = istgt_lu_destroy_task(lu_task);
+      if (rc < 0) {
+        ISTGT_ERRLOG("lu_destroy_task() failed\n");
+        /* ignore error */
       }
     }
   }
 
   istgt_clear_all_transfer_task(conn);
-#ifdef ISTGT_USE_KQUEUE
-  close(kq);
-#endif /* ISTGT_USE_KQUEUE */
-  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
-                 "waiting task end (%d) (left %d tasks)\n",
-                 conn->id,
-                 conn->running_tasks);
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "waiting task end (%d)\n", conn->id);
 }
 
 static void worker_cleanup(CONN_Ptr conn) {
+  ISTGT_LU_TASK_Ptr lu_task;
   ISTGT_LU_Ptr lu;
   int rc;
 
@@ -4593,24 +5606,27 @@ static void worker_cleanup(CONN_Ptr conn) {
   ISTGT_WARNLOG("force cleanup execute\n");
 
   /* cleanup */
-  pthread_mutex_unlock(&conn->task_queue_mutex);
-  pthread_mutex_unlock(&conn->result_queue_mutex);
-  if (conn->sess != NULL) {
-    if (conn->sess->lu != NULL) {
-      pthread_mutex_unlock(&conn->sess->lu->mutex);
+  if (conn->reactor == NULL) {
+    /* worker may have left locks (reactor runs this on a new thread) */
+    pthread_mutex_unlock(&conn->task_queue_mutex);
+    pthread_mutex_unlock(&conn->result_queue_mutex);
+    if (conn->sess != NULL) {
+      if (conn->sess->lu != NULL) {
+        pthread_mutex_unlock(&conn->sess->lu->mutex);
+      }
+      pthread_mutex_unlock(&conn->sess->mutex);
     }
-    pthread_mutex_unlock(&conn->sess->mutex);
   }
   if (conn->exec_lu_task != NULL) {
     conn->exec_lu_task->error = 1;
-    pthread_cond_broadcast(&conn->exec_lu_task->trans_cond);
-    pthread_mutex_unlock(&conn->exec_lu_task->trans_mutex);
   }
-  pthread_mutex_unlock(&conn->wpdu_mutex);
-  pthread_mutex_unlock(&conn->r2t_mutex);
-  pthread_mutex_unlock(&conn->istgt->mutex);
-  pthread_mutex_unlock(&g_conns_mutex);
-  pthread_mutex_unlock(&g_last_tsih_mutex);
+  if (conn->reactor == NULL) {
+    pthread_mutex_unlock(&conn->wpdu_mutex);
+    pthread_mutex_unlock(&conn->r2t_mutex);
+    pthread_mutex_unlock(&conn->istgt->mutex);
+    pthread_mutex_unlock(&g_conns_mutex);
+    pthread_mutex_unlock(&g_last_tsih_mutex);
+  }
 
   conn->state = CONN_STATE_EXITING;
   if (conn->sess != NULL) {
@@ -4634,10 +5650,20 @@ static void worker_cleanup(CONN_Ptr conn) {
     conn->pdu.data = NULL;
   }
   wait_all_task(conn);
-  if (conn->use_sender) {
+  if (conn->use_sender && conn->reactor == NULL) {
+    MTX_LOCK(&conn->result_queue_mutex);
     pthread_cond_broadcast(&conn->result_queue_cond);
+    MTX_UNLOCK(&conn->result_queue_mutex);
     pthread_join(conn->sender_thread, NULL);
   }
+  /* results nobody will send */
+  while ((lu_task = istgt_iscsi_pop_result(conn)) != NULL) {
+    if (lu_task->type == ISTGT_LU_TASK_RESPONSE) {
+      (void) istgt_lu_destroy_task(lu_task);
+    } else {
+      istgt_pool_free(lu_task);
+    }
+  }
   istgt_close_socket(conn->sock);
 #ifdef ISTGT_USE_KQUEUE
   close(conn->kq);
@@ -4656,9 +5682,71 @@ static void worker_cleanup(CONN_Ptr conn) {
   return;
 }
 
+/* send DATA-IN/SCSI status or a queued PDU, -1 if the connection failed */
+static int istgt_iscsi_send_result(CONN_Ptr conn, ISTGT_LU_TASK_Ptr lu_task) {
+  int rc;
+
+  ISTGT_TRACELOG(
+      ISTGT_TRACE_DEBUG, "task response CmdSN=%u\n", lu_task->lu_cmd.CmdSN);
+  lu_task->lock = 1;
+  if (lu_task->type == ISTGT_LU_TASK_RESPONSE) {
+    /* send DATA-IN, SCSI status */
+    rc = istgt_iscsi_task_response(conn, lu_task);
+    if (rc < 0) {
+      lu_task->error = 1;
+      ISTGT_ERRLOG(
+          "iscsi_task_response() CmdSN=%u failed"
+          " on %s(%s)\n",
+          lu_task->lu_cmd.CmdSN,
+          conn->target_port,
+          conn->initiator_port);
+      return -1;
+    }
+    rc = istgt_lu_destroy_task(lu_task);
+    if (rc < 0) {
+      ISTGT_ERRLOG("lu_destroy_task() failed\n");
+    }
+  } else if (lu_task->type == ISTGT_LU_TASK_REQPDU ||
+             lu_task->type == ISTGT_LU_TASK_REQUPDPDU) {
+    if (lu_task->type == ISTGT_LU_TASK_REQUPDPDU) {
+      rc = istgt_update_pdu(lu_task->conn, &lu_task->lu_cmd);
+      if (rc < 0) {
+        lu_task->error = 1;
+        ISTGT_ERRLOG("update_pdu() failed on %s(%s)\n",
+                     lu_task->conn->target_port,
+                     lu_task->conn->initiator_port);
+        return -1;
+      }
+    }
+    /* send PDU */
+    rc = istgt_iscsi_write_pdu_internal(lu_task->conn, lu_task->lu_cmd.pdu);
+    if (rc < 0) {
+      lu_task->error = 1;
+      ISTGT_ERRLOG("iscsi_write_pdu() failed on %s(%s)\n",
+                   lu_task->conn->target_port,
+                   lu_task->conn->initiator_port);
+      return -1;
+    }
+    /* free allocated memory by caller */
+    istgt_pool_free(lu_task);
+  } else {
+    ISTGT_ERRLOG("Unknown task type %x\n", lu_task->type);
+  }
+  return 0;
+}
+
+static int istgt_iscsi_result_ready(void* arg) {
+  CONN_Ptr conn = (CONN_Ptr) arg;
+
+  /* sender only, the consumer of both queues */
+  return !istgt_mpsc_empty(&conn->result_queue_ctl) ||
+         !istgt_mpsc_empty(&conn->result_queue);
+}
+
 static void* sender(void* arg) {
   CONN_Ptr conn = (CONN_Ptr) arg;
   ISTGT_LU_TASK_Ptr lu_task;
+  ISTGT_SPIN spin;
   struct timespec abstime;
   time_t now;
   int rc;
@@ -4671,6 +5759,7 @@ static void* sender(void* arg) {
   }
 #endif
   memset(&abstime, 0, sizeof abstime);
+  istgt_spin_init(&spin, 0);
   /* handle DATA-IN/SCSI status */
   ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "sender loop start (%d)\n", conn->id);
   // MTX_LOCK(&conn->sender_mutex);
@@ -4678,98 +5767,65 @@ static void* sender(void* arg) {
     if (conn->state != CONN_STATE_RUNNING) {
       break;
     }
-    MTX_LOCK(&conn->result_queue_mutex);
-    lu_task = istgt_queue_dequeue(&conn->result_queue);
+    lu_task = istgt_iscsi_pop_result(conn);
     if (lu_task == NULL) {
-      now = time(NULL);
-      abstime.tv_sec = now + conn->timeout;
-      abstime.tv_nsec = 0;
-      rc = pthread_cond_timedwait(
-          &conn->result_queue_cond, &conn->result_queue_mutex, &abstime);
-      if (rc == ETIMEDOUT) {
-        /* nothing */
-      }
-      lu_task = istgt_queue_dequeue(&conn->result_queue);
+      if (spin.usec != conn->busy_poll) {
+        istgt_spin_init(&spin, conn->busy_poll);
+      }
+      if (istgt_spin_wait(&spin, istgt_iscsi_result_ready, conn)) {
+        continue;
+      }
+      /* producers wake up only an idle sender */
+      MTX_LOCK(&conn->result_queue_mutex);
+      istgt_iscsi_set_result_idle(conn, 1);
+      lu_task = istgt_iscsi_pop_result(conn);
+      if (lu_task == NULL && conn->state == CONN_STATE_RUNNING) {
+        now = time(NULL);
+        abstime.tv_sec = now + conn->timeout;
+        abstime.tv_nsec = 0;
+        rc = pthread_cond_timedwait(
+            &conn->result_queue_cond, &conn->result_queue_mutex, &abstime);
+        if (rc == ETIMEDOUT) {
+          /* nothing */
+        }
+        lu_task = istgt_iscsi_pop_result(conn);
+      }
+      istgt_iscsi_set_result_idle(conn, 0);
+      MTX_UNLOCK(&conn->result_queue_mutex);
       if (lu_task == NULL) {
-        MTX_UNLOCK(&conn->result_queue_mutex);
         continue;
       }
     }
-    MTX_UNLOCK(&conn->result_queue_mutex);
-    /* send all responses */
+    /* send all responses, collected and written by the batch */
     //		MTX_LOCK(&conn->wpdu_mutex);
+    conn->tx_batch = 1;
     do {
-      ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
-                     "task response CmdSN=%u\n",
-                     lu_task->lu_cmd.CmdSN);
-      lu_task->lock = 1;
-      if (lu_task->type == ISTGT_LU_TASK_RESPONSE) {
-        /* send DATA-IN, SCSI status */
-        rc = istgt_iscsi_task_response(conn, lu_task);
-        if (rc < 0) {
-          lu_task->error = 1;
-          ISTGT_ERRLOG(
-              "iscsi_task_response() CmdSN=%u failed"
-              " on %s(%s)\n",
-              lu_task->lu_cmd.CmdSN,
-              conn->target_port,
-              conn->initiator_port);
-          rc = istgt_control_pipe_write(&conn->task_pipe, "E", 1);
-          if (rc < 0 || rc != 1) {
-            ISTGT_ERRLOG("write() failed\n");
-          }
-          break;
-        }
-        rc = istgt_lu_destroy_task(lu_task);
-        if (rc < 0) {
-          ISTGT_ERRLOG("lu_destroy_task() failed\n");
-          break;
-        }
-      } else if (lu_task->type == ISTGT_LU_TASK_REQPDU) {
-      reqpdu:
-        /* send PDU */
-        rc =
-            istgt_iscsi_write_pdu_internal(lu_task->conn, lu_task->lu_cmd.pdu);
-        if (rc < 0) {
-          lu_task->error = 1;
-          ISTGT_ERRLOG("iscsi_write_pdu() failed on %s(%s)\n",
-                       lu_task->conn->target_port,
-                       lu_task->conn->initiator_port);
-          rc = istgt_control_pipe_write(&conn->task_pipe, "E", 1);
-          if (rc < 0 || rc != 1) {
-            ISTGT_ERRLOG("write() failed\n");
-          }
-          break;
-        }
-        /* free allocated memory by caller */
-        xfree(lu_task);
-      } else if (lu_task->type == ISTGT_LU_TASK_REQUPDPDU) {
-        rc = istgt_update_pdu(lu_task->conn, &lu_task->lu_cmd);
-        if (rc < 0) {
-          lu_task->error = 1;
-          ISTGT_ERRLOG("update_pdu() failed on %s(%s)\n",
-                       lu_task->conn->target_port,
-                       lu_task->conn->initiator_port);
-          rc = istgt_control_pipe_write(&conn->task_pipe, "E", 1);
-          if (rc < 0 || rc != 1) {
-            ISTGT_ERRLOG("write() failed\n");
-          }
-          break;
-        }
-        goto reqpdu;
-      } else {
-        ISTGT_ERRLOG("Unknown task type %x\n", lu_task->type);
-        rc = -1;
+      rc = istgt_iscsi_send_result(conn, lu_task);
+      if (rc < 0) {
+        break;
       }
       // conn is running?
       if (conn->state != CONN_STATE_RUNNING) {
         // ISTGT_WARNLOG("exit thread\n");
         break;
       }
-      MTX_LOCK(&conn->result_queue_mutex);
-      lu_task = istgt_queue_dequeue(&conn->result_queue);
-      MTX_UNLOCK(&conn->result_queue_mutex);
+      lu_task = istgt_iscsi_pop_result(conn);
     } while (lu_task != NULL);
+    conn->tx_batch = 0;
+    if (rc >= 0) {
+      rc = istgt_iscsi_tx_flush(conn);
+      if (rc > 0) {
+        /* blocking socket, the send timeout expired */
+        ISTGT_ERRLOG("writev() timed out (%s)\n", conn->initiator_name);
+        rc = -1;
+      }
+    }
+    if (rc < 0) {
+      rc = istgt_control_pipe_write(&conn->task_pipe, "E", 1);
+      if (rc < 0 || rc != 1) {
+        ISTGT_ERRLOG("write() failed\n");
+      }
+    }
     //		MTX_UNLOCK(&conn->wpdu_mutex);
   }
   // MTX_UNLOCK(&conn->sender_mutex);
@@ -4777,20 +5833,112 @@ static void* sender(void* arg) {
   return NULL;
 }
 
+/* execute conn->pdu and pending PDUs, 1 on logout, -1 on failure */
+static int istgt_iscsi_execute_pdus(CONN_Ptr conn) {
+  ISCSI_PDU_Ptr pdu;
+  int opcode;
+  int rc;
+
+  while (1) {
+    opcode = BGET8W(&conn->pdu.bhs.opcode, 5, 6);
+
+    if (conn->state != CONN_STATE_RUNNING) {
+      return -1;
+    }
+
+    if (g_trace_flag) {
+      if (conn->sess != NULL) {
+        SESS_MTX_LOCK(conn);
+        ISTGT_TRACELOG(ISTGT_TRACE_ISCSI,
+                       "isid=%" PRIx64 ", tsih=%u, cid=%u, op=%x\n",
+                       conn->sess->isid,
+                       conn->sess->tsih,
+                       conn->cid,
+                       opcode);
+        SESS_MTX_UNLOCK(conn);
+      } else {
+        ISTGT_TRACELOG(ISTGT_TRACE_ISCSI,
+                       "isid=xxx, tsih=xxx, cid=%u, op=%x\n",
+                       conn->cid,
+                       opcode);
+      }
+    }
+    rc = istgt_iscsi_execute(conn, &conn->pdu);
+    if (rc < 0) {
+      ISTGT_ERRLOG("iscsi_execute() failed on %s(%s)\n",
+                   conn->target_port,
+                   conn->initiator_port);
+      return -1;
+    }
+    if (g_trace_flag) {
+      if (conn->sess != NULL) {
+        SESS_MTX_LOCK(conn);
+        ISTGT_TRACELOG(ISTGT_TRACE_ISCSI,
+                       "isid=%" PRIx64 ", tsih=%u, cid=%u, op=%x complete\n",
+                       conn->sess->isid,
+                       conn->sess->tsih,
+                       conn->cid,
+                       opcode);
+        SESS_MTX_UNLOCK(conn);
+      } else {
+        ISTGT_TRACELOG(ISTGT_TRACE_ISCSI,
+                       "isid=xxx, tsih=xxx, cid=%u, op=%x complete\n",
+                       conn->cid,
+                       opcode);
+      }
+    }
+
+    if (opcode == ISCSI_OP_LOGOUT) {
+      ISTGT_TRACELOG(ISTGT_TRACE_ISCSI, "logout received\n");
+      return 1;
+    }
+
+    if (conn->pdu.copy_pdu == 0) {
+      xfree(conn->pdu.ahs);
+      conn->pdu.ahs = NULL;
+      if (conn->pdu.data != conn->pdu.shortdata) {
+        xfree(conn->pdu.data);
+      }
+      conn->pdu.data = NULL;
+    }
+
+    /* execute pending PDUs */
+    pdu = istgt_queue_dequeue(&conn->pending_pdus);
+    if (pdu == NULL) {
+      return 0;
+    }
+    ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "execute pending PDU\n");
+    istgt_iscsi_copy_pdu(&conn->pdu, pdu);
+    conn->pdu.copy_pdu = 0;
+    xfree(pdu);
+  }
+}
+
+#ifndef ISTGT_USE_KQUEUE
+static int istgt_iscsi_poll_ready(void* arg) {
+  struct pollfd* fds = (struct pollfd*) arg;
+
+  /* errors are left to the blocking poll() */
+  return poll(fds, 2, 0) != 0;
+}
+#endif /* !ISTGT_USE_KQUEUE */
+
 static void* worker(void* arg) {
   CONN_Ptr conn = (CONN_Ptr) arg;
   ISTGT_LU_TASK_Ptr lu_task;
   ISTGT_LU_Ptr lu;
   ISCSI_PDU_Ptr pdu;
+  ISTGT_CPUSET cpus;
 #ifdef ISTGT_USE_KQUEUE
   int kq;
   struct kevent kev;
   struct timespec kev_timeout;
 #else
   struct pollfd fds[2];
+  ISTGT_SPIN spin;
   int nopin_timer;
+  int wait;
 #endif /* ISTGT_USE_KQUEUE */
-  int opcode;
   int rc;
 
   ISTGT_TRACELOG(ISTGT_TRACE_NET,
@@ -4803,6 +5951,15 @@ static void* worker(void* arg) {
 	    conn->portal.host, conn->portal.port, conn->portal.tag);
 #endif
 
+  /* near the NIC queue, before the buffers are first touched and the
+   * sender thread inherits the placement */
+  if (conn->cpu >= 0 &&
+      istgt_cpuset_node(&cpus, istgt_cpu_node(conn->cpu)) == 0) {
+    if (istgt_set_affinity(&cpus) < 0) {
+      ISTGT_WARNLOG("CPUs of CPU %d not set (errno=%d)\n", conn->cpu, errno);
+    }
+  }
+
 #ifdef ISTGT_USE_KQUEUE
   kq = kqueue();
   if (kq == -1) {
@@ -4874,6 +6031,7 @@ static void* worker(void* arg) {
   ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "loop start (%d)\n", conn->id);
 #ifndef ISTGT_USE_KQUEUE
   nopin_timer = conn->nopininterval;
+  istgt_spin_init(&spin, 0);
 #endif /* !ISTGT_USE_KQUEUE */
   while (1) {
     /* check exit request */
@@ -4905,7 +6063,11 @@ static void* worker(void* arg) {
                    "kevent sock %d (timeout %dms)\n",
                    conn->sock,
                    conn->nopininterval);
-    if (conn->nopininterval != 0) {
+    if (conn->rxhead != conn->rxtail) {
+      /* PDUs left in the receive buffer */
+      kev_timeout.tv_sec = 0;
+      kev_timeout.tv_nsec = 0;
+    } else if (conn->nopininterval != 0) {
       kev_timeout.tv_sec = conn->nopininterval / 1000;
       kev_timeout.tv_nsec = (conn->nopininterval % 1000) * 1000000;
     } else {
@@ -4921,6 +6083,10 @@ static void* worker(void* arg) {
       ISTGT_ERRLOG("kevent() failed\n");
       break;
     }
+    if (rc == 0 && conn->rxhead != conn->rxtail) {
+      ISTGT_EV_SET(&kev, conn->sock, EVFILT_READ, 0, 0, 0, NULL);
+      rc = 1;
+    }
     if (rc == 0) {
       /* idle timeout, send diagnosis packet */
       if (conn->nopininterval != 0) {
@@ -4942,7 +6108,17 @@ static void* worker(void* arg) {
     }
 #else
     // ISTGT_TRACELOG(ISTGT_TRACE_NET, "poll sock %d\n", conn->sock);
-    rc = poll(fds, 2, POLLWAIT);
+    /* do not sleep on PDUs left in the receive buffer */
+    wait = conn->rxhead != conn->rxtail ? 0 : POLLWAIT;
+    if (wait != 0) {
+      if (spin.usec != conn->busy_poll) {
+        istgt_spin_init(&spin, conn->busy_poll);
+      }
+      if (istgt_spin_wait(&spin, istgt_iscsi_poll_ready, fds)) {
+        wait = 0;
+      }
+    }
+    rc = poll(fds, 2, wait);
     if (rc == -1 && errno == EINTR) {
       // ISTGT_ERRLOG("EINTR poll\n");
       continue;
@@ -4951,7 +6127,9 @@ static void* worker(void* arg) {
       ISTGT_ERRLOG("poll() failed\n");
       break;
     }
-    if (rc == 0) {
+    if (conn->rxhead != conn->rxtail) {
+      fds[0].revents |= POLLIN;
+    } else if (rc == 0) {
       /* no fds */
       // ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "poll TIMEOUT\n");
       if (nopin_timer > 0) {
@@ -5005,88 +6183,10 @@ static void* worker(void* arg) {
         ISTGT_ERRLOG("iscsi_read_pdu() failed\n");
         break;
       }
-    execute_pdu:
-      opcode = BGET8W(&conn->pdu.bhs.opcode, 5, 6);
-
-      if (conn->state != CONN_STATE_RUNNING) {
-        break;
-      }
-
-      if (g_trace_flag) {
-        if (conn->sess != NULL) {
-          SESS_MTX_LOCK(conn);
-          ISTGT_TRACELOG(ISTGT_TRACE_ISCSI,
-                         "isid=%" PRIx64 ", tsih=%u, cid=%u, op=%x\n",
-                         conn->sess->isid,
-                         conn->sess->tsih,
-                         conn->cid,
-                         opcode);
-          SESS_MTX_UNLOCK(conn);
-        } else {
-          ISTGT_TRACELOG(ISTGT_TRACE_ISCSI,
-                         "isid=xxx, tsih=xxx, cid=%u, op=%x\n",
-                         conn->cid,
-                         opcode);
-        }
-      }
-      rc = istgt_iscsi_execute(conn, &conn->pdu);
-      if (rc < 0) {
-        ISTGT_ERRLOG("iscsi_execute() failed on %s(%s)\n",
-                     conn->target_port,
-                     conn->initiator_port);
-        break;
-      }
-      if (g_trace_flag) {
-        if (conn->sess != NULL) {
-          SESS_MTX_LOCK(conn);
-          ISTGT_TRACELOG(ISTGT_TRACE_ISCSI,
-                         "isid=%" PRIx64 ", tsih=%u, cid=%u, op=%x complete\n",
-                         conn->sess->isid,
-                         conn->sess->tsih,
-                         conn->cid,
-                         opcode);
-          SESS_MTX_UNLOCK(conn);
-        } else {
-          ISTGT_TRACELOG(ISTGT_TRACE_ISCSI,
-                         "isid=xxx, tsih=xxx, cid=%u, op=%x complete\n",
-                         conn->cid,
-                         opcode);
-        }
-      }
-
-#if 0
-			if (opcode == ISCSI_OP_LOGIN) {
-				//ISTGT_NOTICELOG("OP LOGIN: %s\n", conn->initiator_port);
-				istgt_yield();
-				if (conn->full_feature) {
-					//ISTGT_NOTICELOG("full_feature %s\n", conn->initiator_port);
-				}
-			}
-#endif
-      if (opcode == ISCSI_OP_LOGOUT) {
-        ISTGT_TRACELOG(ISTGT_TRACE_ISCSI, "logout received\n");
+      rc = istgt_iscsi_execute_pdus(conn);
+      if (rc != 0) {
         break;
       }
-
-      if (conn->pdu.copy_pdu == 0) {
-        xfree(conn->pdu.ahs);
-        conn->pdu.ahs = NULL;
-        if (conn->pdu.data != conn->pdu.shortdata) {
-          xfree(conn->pdu.data);
-        }
-        conn->pdu.data = NULL;
-      }
-
-      /* execute pending PDUs */
-      pdu = istgt_queue_dequeue(&conn->pending_pdus);
-      if (pdu != NULL) {
-        ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "execute pending PDU\n");
-        rc = istgt_iscsi_copy_pdu(&conn->pdu, pdu);
-        conn->pdu.copy_pdu = 0;
-        xfree(pdu);
-        goto execute_pdu;
-      }
-
 #if 0
 			/* retry read/PDUs */
 			continue;
@@ -5134,62 +6234,22 @@ static void* worker(void* arg) {
         }
         conn->exec_lu_task = lu_task;
         if (lu_task->lu_cmd.W_bit) {
-          /* write */
-          if (lu_task->req_transfer_out == 0) {
-            if (lu_task->req_execute) {
-              if (conn->running_tasks > 0) {
-                conn->running_tasks--;
-              } else {
-                ISTGT_ERRLOG("running no task\n");
-              }
-            }
-            rc = istgt_iscsi_task_response(conn, lu_task);
-            if (rc < 0) {
-              lu_task->error = 1;
-              ISTGT_ERRLOG("iscsi_task_response() failed on %s(%s)\n",
-                           conn->target_port,
-                           conn->initiator_port);
-              break;
-            }
-            rc = istgt_lu_destroy_task(lu_task);
-            if (rc < 0) {
-              ISTGT_ERRLOG("lu_destroy_task() failed\n");
-              break;
-            }
-            lu_task = NULL;
-            conn->exec_lu_task = NULL;
-          } else {
-            // ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
-            //    "Task Write Trans START\n");
-            rc = istgt_iscsi_task_transfer_out(conn, lu_task);
-            if (rc < 0) {
-              lu_task->error = 1;
-              ISTGT_ERRLOG("iscsi_task_transfer_out() failed on %s(%s)\n",
-                           conn->target_port,
-                           conn->initiator_port);
-              break;
-            }
-            // ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
-            //    "Task Write Trans END\n");
-
-            MTX_LOCK(&lu_task->trans_mutex);
-            lu_task->req_transfer_out = 0;
-
-            /* need response after execution */
-            lu_task->req_execute = 1;
-            if (conn->use_sender == 0) {
-              conn->running_tasks++;
-            }
-
-            rc = pthread_cond_broadcast(&lu_task->trans_cond);
-            MTX_UNLOCK(&lu_task->trans_mutex);
-            if (rc != 0) {
-              ISTGT_ERRLOG("cond_broadcast() failed\n");
-              break;
-            }
-            lu_task = NULL;
-            conn->exec_lu_task = NULL;
+          /* write, Data-Out was received before queueing */
+          rc = istgt_iscsi_task_response(conn, lu_task);
+          if (rc < 0) {
+            lu_task->error = 1;
+            ISTGT_ERRLOG("iscsi_task_response() failed on %s(%s)\n",
+                         conn->target_port,
+                         conn->initiator_port);
+            break;
+          }
+          rc = istgt_lu_destroy_task(lu_task);
+          if (rc < 0) {
+            ISTGT_ERRLOG("lu_destroy_task() failed\n");
+            break;
           }
+          lu_task = NULL;
+          conn->exec_lu_task = NULL;
         } else {
           /* read or no data */
           rc = istgt_iscsi_task_response(conn, lu_task);
@@ -5216,12 +6276,10 @@ static void* worker(void* arg) {
         rc = istgt_iscsi_copy_pdu(&conn->pdu, pdu);
         conn->pdu.copy_pdu = 0;
         xfree(pdu);
-#ifdef ISTGT_USE_KQUEUE
-        kev.ident = -1;
-#else
-        fds[1].revents &= ~POLLIN;
-#endif /* ISTGT_USE_KQUEUE */
-        goto execute_pdu;
+        rc = istgt_iscsi_execute_pdus(conn);
+        if (rc != 0) {
+          break;
+        }
       }
     }
   }
@@ -5233,11 +6291,288 @@ cleanup_exit:;
   return NULL;
 }
 
+#ifdef ISTGT_USE_REACTOR
+#define ISTGT_REACTOR_MAX_PDUS 16
+
+/* send queued results while the socket accepts, reactor thread only */
+static int istgt_iscsi_conn_flush(CONN_Ptr conn) {
+  ISTGT_LU_TASK_Ptr lu_task;
+  int rc;
+
+  istgt_iscsi_set_result_idle(conn, 0);
+  conn->tx_batch = 1;
+  while (1) {
+    if (conn->tx_blocked || ISTGT_CONN_URING(conn)) {
+      rc = istgt_iscsi_tx_flush(conn);
+      if (rc != 0) {
+        /* wait for writable, results stay in the queue */
+        break;
+      }
+    }
+    lu_task = istgt_iscsi_pop_result(conn);
+    if (lu_task == NULL) {
+      /* producers post the event only if idle */
+      istgt_iscsi_set_result_idle(conn, 1);
+      lu_task = istgt_iscsi_pop_result(conn);
+      if (lu_task == NULL) {
+        /* end of the batch */
+        rc = istgt_iscsi_tx_flush(conn);
+        break;
+      }
+      istgt_iscsi_set_result_idle(conn, 0);
+    }
+    rc = istgt_iscsi_send_result(conn, lu_task);
+    if (rc < 0) {
+      break;
+    }
+  }
+  conn->tx_batch = 0;
+  return rc < 0 ? -1 : 0;
+}
+
+/* receive and execute PDUs until the socket is drained */
+static int istgt_iscsi_conn_recv(CONN_Ptr conn) {
+  ISCSI_PDU_Ptr pdu = &conn->pdu;
+  struct iovec iovec[1];
+  ssize_t rc;
+  int npdus;
+
+  npdus = 0;
+  while (1) {
+    if (conn->rx_stage == 0) {
+      /* BHS */
+      if (conn->rx_len == 0) {
+        pdu->ahs = NULL;
+        pdu->total_ahs_len = 0;
+        pdu->data = NULL;
+        pdu->data_segment_len = 0;
+        pdu->copy_pdu = 0;
+      }
+      iovec[0].iov_base = (uint8_t*) &pdu->bhs + conn->rx_len;
+      iovec[0].iov_len = ISCSI_BHS_LEN - conn->rx_len;
+      rc = istgt_iscsi_rx_readv(conn, &iovec[0], 1);
+    } else {
+      /* AHS+HD or DATA+PAD+DD */
+      rc = istgt_iscsi_rx_readv(conn, &conn->rx_iovec[0], 5);
+    }
+    if (rc < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return 0;
+      if (errno == ECONNRESET) {
+        ISTGT_WARNLOG("Connection reset by peer (%s)\n",
+                      conn->initiator_name);
+      } else {
+        ISTGT_ERRLOG("recv() failed (errno=%d,%s)\n",
+                     errno,
+                     conn->initiator_name);
+      }
+      conn->state = CONN_STATE_EXITING;
+      return -1;
+    }
+    if (rc == 0) {
+      ISTGT_TRACELOG(
+          ISTGT_TRACE_NET, "recv() EOF (%s)\n", conn->initiator_name);
+      conn->state = CONN_STATE_EXITING;
+      return -1;
+    }
+    if (conn->rx_stage == 0) {
+      conn->rx_len += rc;
+      if (conn->rx_len < ISCSI_BHS_LEN)
+        continue;
+      ISTGT_TRACELOG(ISTGT_TRACE_NET, "BHS read %d\n", ISCSI_BHS_LEN);
+      rc = istgt_iscsi_read_pdu_setup(conn, pdu, &conn->rx_iovec[0]);
+      if (rc < 0) {
+        return -1;
+      }
+      conn->rx_stage = 1;
+      conn->rx_len = rc;
+    } else {
+      conn->rx_len -= rc;
+      istgt_iscsi_iovec_advance(&conn->rx_iovec[0], 5, rc);
+    }
+    if (conn->rx_len != 0)
+      continue;
+    if (conn->rx_stage == 1) {
+      /* header checked before the data segment is given a place */
+      rc = istgt_iscsi_read_pdu_check_header(conn, pdu);
+      if (rc < 0) {
+        return -1;
+      }
+      rc = istgt_iscsi_read_pdu_setup_data(conn, pdu, &conn->rx_iovec[0]);
+      if (rc < 0) {
+        return -1;
+      }
+      ISTGT_TRACELOG(ISTGT_TRACE_NET, "PDU read %d\n", (int) rc);
+      conn->rx_stage = 2;
+      conn->rx_len = rc;
+      if (conn->rx_len != 0)
+        continue;
+    }
+
+    /* whole PDU received */
+    conn->rx_stage = 0;
+    rc = istgt_iscsi_read_pdu_check(conn, pdu);
+    if (rc < 0) {
+      return -1;
+    }
+    rc = istgt_iscsi_execute_pdus(conn);
+    if (rc != 0) {
+      return rc;
+    }
+    if (++npdus >= ISTGT_REACTOR_MAX_PDUS) {
+      /* give other connections a turn, continue on post */
+      conn->rx_more = 1;
+      return istgt_reactor_post(&conn->rev);
+    }
+  }
+}
+
+/* once per second on the reactor thread */
+static int istgt_iscsi_conn_timer(CONN_Ptr conn) {
+  ISTGT_LU_Ptr lu;
+  time_t now;
+  int rc;
+
+  if (conn->sess != NULL) {
+    SESS_MTX_LOCK(conn);
+    lu = conn->sess->lu;
+    SESS_MTX_UNLOCK(conn);
+  } else {
+    lu = NULL;
+  }
+  if (lu != NULL) {
+    if (istgt_lu_get_state(lu) != ISTGT_STATE_RUNNING) {
+      conn->state = CONN_STATE_EXITING;
+    }
+  } else {
+    if (istgt_get_state(conn->istgt) != ISTGT_STATE_RUNNING) {
+      conn->state = CONN_STATE_EXITING;
+    }
+  }
+  if (conn->state != CONN_STATE_RUNNING) {
+    return 1;
+  }
+
+  now = time(NULL);
+  if (conn->nopininterval != 0 && now >= conn->nopin_time) {
+    /* idle timeout, send diagnosis packet */
+    conn->nopin_time = now + conn->nopininterval / 1000;
+    rc = istgt_iscsi_send_nopin(conn);
+    if (rc < 0) {
+      ISTGT_ERRLOG("iscsi_send_nopin() failed\n");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void* istgt_iscsi_conn_cleanup(void* arg) {
+  CONN_Ptr conn = (CONN_Ptr) arg;
+
+  if (conn->exec_logout) {
+    /* Logout Response may be left in the queue */
+    if (istgt_set_nonblock(conn->sock, 0) == 0) {
+      (void) istgt_iscsi_conn_flush(conn);
+    }
+  }
+  worker_cleanup(conn);
+  return NULL;
+}
+
+static void istgt_iscsi_conn_close(CONN_Ptr conn) {
+  pthread_t thread;
+  int rc;
+
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "loop ended (%d)\n", conn->id);
+  istgt_reactor_del(&conn->rev);
+  conn->state = CONN_STATE_EXITING;
+
+  /* cleanup waits for running tasks, do not block the reactor */
+  rc = pthread_create(&thread, NULL, &istgt_iscsi_conn_cleanup, (void*) conn);
+  if (rc != 0) {
+    ISTGT_ERRLOG("pthread_create() failed\n");
+    istgt_iscsi_conn_cleanup(conn);
+    return;
+  }
+  rc = pthread_detach(thread);
+  if (rc != 0) {
+    ISTGT_ERRLOG("pthread_detach() failed\n");
+  }
+}
+
+static void istgt_iscsi_conn_event(ISTGT_REACTOR_EVENT_Ptr ev, int events) {
+  CONN_Ptr conn = (CONN_Ptr) ev->arg;
+  int rc;
+
+  rc = 0;
+  if (ev->state == ISTGT_REACTOR_EVENT_REMOVED) {
+    /* registration failed */
+    rc = -1;
+  } else if (conn->exit_request) {
+    ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "exit request (%d)\n", conn->id);
+    rc = 1;
+  }
+  if (rc == 0 && (events & ISTGT_REACTOR_TIMER)) {
+    rc = istgt_iscsi_conn_timer(conn);
+  }
+  if (rc == 0 && ((events & (ISTGT_REACTOR_READ | ISTGT_REACTOR_ERROR)) ||
+                  ((events & ISTGT_REACTOR_POST) && conn->rx_more))) {
+    conn->rx_more = 0;
+    if (conn->nopininterval != 0) {
+      conn->nopin_time = time(NULL) + conn->nopininterval / 1000;
+    }
+    rc = istgt_iscsi_conn_recv(conn);
+  }
+  if (rc == 0) {
+    /* results of LU threads, and writable socket */
+    rc = istgt_iscsi_conn_flush(conn);
+    if (rc < 0) {
+      conn->state = CONN_STATE_EXITING;
+    }
+  }
+  if (rc != 0) {
+    istgt_iscsi_conn_close(conn);
+  }
+}
+#endif /* ISTGT_USE_REACTOR */
+
+/* ask the thread serving conn to close it */
+static int istgt_iscsi_conn_request_exit(CONN_Ptr conn) {
+  int rc;
+
+#ifdef ISTGT_USE_REACTOR
+  if (conn->reactor != NULL) {
+    conn->exit_request = 1;
+    return istgt_reactor_post(&conn->rev);
+  }
+#endif /* ISTGT_USE_REACTOR */
+  rc = istgt_control_pipe_write(&conn->task_pipe, "E", 1);
+  if (rc < 0 || rc != 1) {
+    return -1;
+  }
+  return 0;
+}
+
+/* spin budget of the connection threads, and of the socket if supported */
+static void istgt_iscsi_set_busy_poll(CONN_Ptr conn, int usec) {
+  if (usec == conn->busy_poll)
+    return;
+  conn->busy_poll = usec;
+  if (istgt_set_busy_poll(conn->sock, usec) < 0) {
+    ISTGT_TRACELOG(ISTGT_TRACE_NET,
+                   "SO_BUSY_POLL not set (errno=%d)\n",
+                   errno);
+  }
+}
+
 int istgt_create_conn(ISTGT_Ptr istgt,
                       PORTAL_Ptr portal,
                       int sock,
                       struct sockaddr* sa,
-                      socklen_t salen) {
+                      socklen_t salen,
+                      int acceptor) {
   char buf[MAX_TMPBUF];
   CONN_Ptr conn;
   int rc;
@@ -5294,6 +6629,7 @@ int istgt_create_conn(ISTGT_Ptr istgt,
   conn->req_auth = 0;
   conn->req_mutual = 0;
   istgt_queue_init(&conn->pending_pdus);
+  conn->r2t_slots = conn->max_r2t;
   conn->r2t_tasks = xmalloc(sizeof *conn->r2t_tasks * (conn->max_r2t + 1));
   for (i = 0; i < (conn->max_r2t + 1); i++) {
     conn->r2t_tasks[i] = NULL;
@@ -5301,9 +6637,10 @@ int istgt_create_conn(ISTGT_Ptr istgt,
   conn->task_pipe = istgt_control_pipe_init();
   conn->max_task_queue = MAX_LU_QUEUE_DEPTH;
   istgt_queue_init(&conn->task_queue);
-  istgt_queue_init(&conn->result_queue);
+  istgt_mpsc_init(&conn->result_queue);
+  istgt_mpsc_init(&conn->result_queue_ctl);
   conn->exec_lu_task = NULL;
-  conn->running_tasks = 0;
+  conn->lu_tasks = 0;
 
   memset(conn->initiator_addr, 0, sizeof conn->initiator_addr);
   memset(conn->target_addr, 0, sizeof conn->target_addr);
@@ -5381,11 +6718,14 @@ int istgt_create_conn(ISTGT_Ptr istgt,
     ISTGT_ERRLOG("istgt_set_sendtimeo() failed\n");
     goto error_return;
   }
-  /* set low water mark */
-  rc = istgt_set_recvlowat(conn->sock, ISCSI_BHS_LEN);
-  if (rc != 0) {
-    ISTGT_WARNLOG("istgt_set_recvlowat() failed\n");
+  istgt_iscsi_set_busy_poll(conn, istgt->BusyPoll);
+  conn->cpu = istgt->IncomingCPU ? istgt_get_incoming_cpu(sock) : -1;
+  /* NULL if connections have own threads */
+  conn->reactor = istgt_reactor_get_cpu(conn->cpu);
+  if (conn->reactor == NULL) {
+    conn->reactor = istgt_reactor_get(acceptor);
   }
+  /* no low water mark, a short read only fills part of rxbuf */
 
   rc = istgt_control_pipe_create(&conn->task_pipe);
   if (rc != 0) {
@@ -5491,7 +6831,6 @@ int istgt_create_conn(ISTGT_Ptr istgt,
     istgt_iscsi_param_free(conn->params);
     istgt_queue_destroy(&conn->pending_pdus);
     istgt_queue_destroy(&conn->task_queue);
-    istgt_queue_destroy(&conn->result_queue);
     xfree(conn->portal.label);
     xfree(conn->portal.host);
     xfree(conn->portal.port);
@@ -5503,6 +6842,44 @@ int istgt_create_conn(ISTGT_Ptr istgt,
     return -1;
   }
 
+#ifdef ISTGT_USE_REACTOR
+  if (conn->reactor != NULL) {
+    ISTGT_TRACELOG(ISTGT_TRACE_NET,
+                   "connect to %s:%s,%d (reactor #%d)\n",
+                   conn->portal.host,
+                   conn->portal.port,
+                   conn->portal.tag,
+                   conn->reactor->id);
+    conn->pdu.ahs = NULL;
+    conn->pdu.data = NULL;
+    conn->pdu.copy_pdu = 0;
+    conn->state = CONN_STATE_RUNNING;
+    conn->exec_lu_task = NULL;
+    conn->use_sender = ISTGT_USE_SENDER_THREAD;
+    conn->wsock = conn->sock;
+    conn->nopin_time = time(NULL) + conn->nopininterval / 1000;
+    rc = istgt_set_nonblock(conn->sock, 1);
+    if (rc != 0) {
+      ISTGT_ERRLOG("istgt_set_nonblock() failed\n");
+      goto unregister_return;
+    }
+    /* served by the reactor from now on */
+    conn->rev.fd = conn->sock;
+    conn->rev.cb = istgt_iscsi_conn_event;
+    conn->rev.arg = conn;
+    rc = istgt_reactor_add(conn->reactor, &conn->rev);
+    if (rc < 0) {
+      ISTGT_ERRLOG("reactor_add() failed\n");
+    unregister_return:
+      MTX_LOCK(&g_conns_mutex);
+      g_conns[conn->id] = NULL;
+      MTX_UNLOCK(&g_conns_mutex);
+      goto error_return;
+    }
+    return 0;
+  }
+#endif /* ISTGT_USE_REACTOR */
+
   /* create new thread */
   rc = pthread_create(&conn->thread, NULL, &worker, (void*) conn);
   if (rc != 0) {
@@ -5594,6 +6971,15 @@ int istgt_create_sess(ISTGT_Ptr istgt, CONN_Ptr conn, ISTGT_LU_Ptr lu) {
   }
   MTX_UNLOCK(&istgt->mutex);
 
+  if (lu != NULL) {
+    rc = istgt_lu_bind_reactor(lu, conn->reactor);
+    if (rc < 0) {
+      xfree(sess);
+      return -1;
+    }
+    istgt_iscsi_set_busy_poll(conn, lu->busy_poll);
+  }
+
   sess->initiator_port = xstrdup(conn->initiator_port);
   sess->target_name = xstrdup(conn->target_name);
   sess->tag = conn->portal.tag;
@@ -5795,6 +7181,9 @@ static int istgt_append_sess(CONN_Ptr conn,
   sess->connections++;
   MTX_UNLOCK(&sess->mutex);
   MTX_UNLOCK(&g_conns_mutex);
+  if (sess->lu != NULL) {
+    istgt_iscsi_set_busy_poll(conn, sess->lu->busy_poll);
+  }
 
   return 0;
 }
@@ -5826,8 +7215,10 @@ static void istgt_free_conn(CONN_Ptr conn) {
   istgt_iscsi_param_free(conn->params);
   istgt_queue_destroy(&conn->pending_pdus);
   istgt_queue_destroy(&conn->task_queue);
-  istgt_queue_destroy(&conn->result_queue);
   xfree(conn->r2t_tasks);
+  xfree(conn->txbuf);
+  xfree(conn->txsbuf);
+  xfree(conn->rxbuf);
   xfree(conn->portal.label);
   xfree(conn->portal.host);
   xfree(conn->portal.port);
@@ -5965,11 +7356,15 @@ static int istgt_iscsi_drop_all_conns(CONN_Ptr conn) {
                  xconn->initiator_addr,
                  xconn->cid);
         }
-        rc = istgt_control_pipe_write(&conn->task_pipe, "E", 1);
-        if (rc < 0 || rc != 1) {
+        rc = istgt_iscsi_conn_request_exit(conn);
+        if (rc < 0) {
           ISTGT_ERRLOG("write() failed\n");
           continue;
         }
+        if (xconn->reactor != NULL) {
+          /* closed by its reactor thread */
+          continue;
+        }
         rc = pthread_join(xconn->thread, NULL);
         if (rc != 0) {
           ISTGT_ERRLOG("pthread_join() failed rc=%d\n", rc);
@@ -6054,11 +7449,15 @@ static int istgt_iscsi_drop_old_conns(CONN_Ptr conn) {
                  xconn->initiator_addr,
                  xconn->cid);
         }
-        rc = istgt_control_pipe_write(&xconn->task_pipe, "E", 1);
-        if (rc < 0 || rc != 1) {
+        rc = istgt_iscsi_conn_request_exit(xconn);
+        if (rc < 0) {
           ISTGT_ERRLOG("write() failed\n");
           continue;
         }
+        if (xconn->reactor != NULL) {
+          /* closed by its reactor thread */
+          continue;
+        }
         rc = pthread_join(xconn->thread, NULL);
         if (rc != 0) {
           ISTGT_ERRLOG("pthread_join() failed rc=%d\n", rc);
@@ -6110,19 +7509,17 @@ int istgt_get_active_conns(void) {
 
 int istgt_stop_conns(void) {
   CONN_Ptr conn;
-  char tmp[1];
   int rc;
   int i;
 
   ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "istgt_stop_conns\n");
-  tmp[0] = 'E';
   MTX_LOCK(&g_conns_mutex);
   for (i = 0; i < g_nconns; i++) {
     conn = g_conns[i];
     if (conn == NULL)
       continue;
-    rc = istgt_control_pipe_write(&conn->task_pipe, tmp, 1);
-    if (rc < 0 || rc != 1) {
+    rc = istgt_iscsi_conn_request_exit(conn);
+    if (rc < 0) {
       ISTGT_ERRLOG("write() failed\n");
       /* ignore error */
     }
@@ -6203,6 +7600,34 @@ int istgt_iscsi_init(ISTGT_Ptr istgt) {
   }
   g_last_tsih = 0;
 
+  if (istgt->ReactorThreads > 0 && !istgt_lu_all_queued(istgt)) {
+    /* such LU receives Data-Out and executes on the connection's thread */
+    ISTGT_WARNLOG("LU with QueueDepth 0, connections use own threads\n");
+    istgt->ReactorThreads = 0;
+  }
+  rc = istgt_reactor_init(istgt->ReactorThreads,
+                          istgt->ReactorEngine,
+                          istgt->ReactorStatsInterval,
+                          istgt->BusyPoll,
+                          &istgt->ReactorCPUs);
+  if (rc < 0) {
+    ISTGT_ERRLOG("reactor_init() failed\n");
+    return -1;
+  }
+
+  if (istgt->DigestThreads > 0) {
+    rc = istgt_crc32c_start_workers(istgt->DigestThreads,
+                                    istgt->DigestOffloadLength);
+    if (rc < 0) {
+      ISTGT_ERRLOG("crc32c_start_workers() failed\n");
+      istgt_reactor_shutdown();
+      return -1;
+    }
+    ISTGT_NOTICELOG("digests of %d bytes or more split across %d threads\n",
+                    istgt->DigestOffloadLength,
+                    istgt->DigestThreads);
+  }
+
   return 0;
 }
 
@@ -6247,6 +7672,9 @@ int istgt_iscsi_shutdown(ISTGT_Ptr istgt) {
       retry--;
     }
   }
+  /* connections on reactors closed themselves by the timer */
+  istgt_reactor_shutdown();
+  istgt_crc32c_stop_workers();
 
   rc = pthread_mutex_destroy(&g_last_tsih_mutex);
   if (rc != 0) {
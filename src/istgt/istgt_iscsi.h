@@ -36,6 +36,7 @@
 #include "istgt_misc.h"
 #include "istgt_platform.h"
 #include "istgt_queue.h"
+#include "istgt_reactor.h"
 
 #define ISCSI_BHS_LEN 48
 #define ISCSI_DIGEST_LEN 4
@@ -144,6 +145,7 @@ typedef struct iscsi_pdu_t {
   uint8_t header_digest[ISCSI_DIGEST_LEN];
   uint8_t shortdata[ISTGT_SHORTDATASIZE];
   uint8_t* data;
+  uint8_t pad[ISCSI_ALIGNMENT]; /* padding of a data segment placed in task */
   uint8_t data_digest[ISCSI_DIGEST_LEN];
   size_t total_ahs_len;
   size_t data_segment_len;
@@ -206,6 +208,10 @@ typedef struct istgt_r2t_task_t {
   uint32_t DataSN;
   int F_bit;
   int offset;
+
+  /* queued task receiving Data-Out on the reactor, owns iobuf */
+  struct istgt_lu_task_t* lu_task;
+  int burst_end;
 } ISTGT_R2T_TASK;
 typedef ISTGT_R2T_TASK* ISTGT_R2T_TASK_Ptr;
 
@@ -238,18 +244,56 @@ typedef struct istgt_conn_t {
 
   int max_r2t;
   int pending_r2t;
+  int r2t_slots;
   pthread_mutex_t r2t_mutex;
   ISTGT_R2T_TASK_Ptr* r2t_tasks;
 
+  /* Data-Out destination of running transfer_out */
+  uint32_t dataout_task_tag;
+  uint32_t dataout_transfer_tag;
+  uint8_t* dataout_buf;
+  size_t dataout_len;
+
   istgt_control_pipe_t task_pipe;
   int max_task_queue;
   pthread_mutex_t task_queue_mutex;
   ISTGT_QUEUE task_queue;
   pthread_mutex_t result_queue_mutex;
   pthread_cond_t result_queue_cond;
-  ISTGT_QUEUE result_queue;
+  ISTGT_MPSC_QUEUE result_queue;
+  /* R2T and NOP-In, sent before the queued results */
+  ISTGT_MPSC_QUEUE result_queue_ctl;
   ISTGT_LU_TASK_Ptr exec_lu_task;
-  int running_tasks;
+  /* tasks taken by LU threads or the backend, they respond to conn */
+  int lu_tasks;
+
+  /* connection served by a reactor thread instead of worker/sender */
+  ISTGT_REACTOR_Ptr reactor;
+  ISTGT_REACTOR_EVENT rev;
+  int exit_request;
+  int rx_more;
+  time_t nopin_time;
+  /* received bytes of the following PDUs */
+  uint8_t* rxbuf;
+  int rxhead;
+  int rxtail;
+  /* running DataDigest of the data segment being received */
+  uint8_t* rx_dnext;
+  uint32_t rx_dcrc;
+  /* partially received PDU */
+  int rx_stage;
+  int rx_len;
+  struct iovec rx_iovec[5];
+  /* unsent bytes, written when the socket becomes writable or by the batch */
+  uint8_t* txbuf;
+  size_t txbufsize;
+  size_t txhead;
+  size_t txtail;
+  int tx_blocked; /* socket is full, PDUs are appended to txbuf */
+  int tx_batch;   /* sending queued results, small PDUs are collected */
+  /* buffer being sent by the io_uring engine */
+  uint8_t* txsbuf;
+  size_t txsbufsize;
 
   uint16_t cid;
 
@@ -278,6 +322,8 @@ typedef struct istgt_conn_t {
 
   int timeout;
   int nopininterval;
+  int busy_poll; /* usec, BusyPoll of the LU once logged in */
+  int cpu;       /* SO_INCOMING_CPU at accept with IncomingCPU, else -1 */
 
   int TargetMaxRecvDataSegmentLength;
   int MaxRecvDataSegmentLength;
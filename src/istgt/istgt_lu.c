@@ -53,6 +53,7 @@
 #include "istgt_md5.h"
 #include "istgt_misc.h"
 #include "istgt_platform.h"
+#include "istgt_pool.h"
 #include "istgt_proto.h"
 #include "istgt_scsi.h"
 #include "istgt_sock.h"
@@ -1520,11 +1521,68 @@ static int istgt_lu_add_unit(ISTGT_Ptr istgt, CF_SECTION* sp) {
   }
   ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "QueueDepth %d\n", lu->queue_depth);
 
+  val = istgt_get_val(sp, "LUWorkers");
+  if (val == NULL) {
+    lu->luworkers = DEFAULT_LU_WORKERS;
+  } else {
+    lu->luworkers = (int) strtol(val, NULL, 10);
+  }
+  if (lu->luworkers < 1 || lu->luworkers > MAX_LU_WORKERS) {
+    ISTGT_ERRLOG("LU%d: LUWorkers range error\n", lu->num);
+    goto error_return;
+  }
+  /* no more executors than queued commands */
+  if (lu->queue_depth != 0 && lu->luworkers > lu->queue_depth) {
+    lu->luworkers = lu->queue_depth;
+  }
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "LUWorkers %d\n", lu->luworkers);
+
+  val = istgt_get_val(sp, "InlineDepth");
+  if (val == NULL) {
+    lu->inline_depth = DEFAULT_LU_INLINE_DEPTH;
+  } else {
+    lu->inline_depth = (int) strtol(val, NULL, 10);
+  }
+  if (lu->inline_depth < 0 || lu->inline_depth > MAX_LU_QUEUE_DEPTH) {
+    ISTGT_ERRLOG("LU%d: InlineDepth range error\n", lu->num);
+    goto error_return;
+  }
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "InlineDepth %d\n", lu->inline_depth);
+
+  val = istgt_get_val(sp, "BusyPoll");
+  if (val == NULL) {
+    lu->busy_poll = istgt->BusyPoll;
+  } else {
+    lu->busy_poll = (int) strtol(val, NULL, 10);
+  }
+  if (lu->busy_poll < 0 || lu->busy_poll > MAX_BUSYPOLL) {
+    ISTGT_ERRLOG("LU%d: BusyPoll range error\n", lu->num);
+    goto error_return;
+  }
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "BusyPoll %dus\n", lu->busy_poll);
+
+  istgt_cpuset_zero(&lu->cpus);
+  lu->cpus_auto = 0;
+  val = istgt_get_val(sp, "CPUs");
+  if (val == NULL || strcasecmp(val, "None") == 0) {
+    /* not pinned */
+  } else if (strcasecmp(val, "Auto") == 0) {
+    /* resolved with the LUNs in istgt_lu_create_thread() */
+    lu->cpus_auto = 1;
+  } else if (istgt_cpuset_parse(&lu->cpus, val) < 0) {
+    ISTGT_ERRLOG("LU%d: invalid CPUs(%s)\n", lu->num, val);
+    goto error_return;
+  }
+  ISTGT_TRACELOG(
+      ISTGT_TRACE_DEBUG, "CPUs %s\n", val != NULL ? val : "None");
+
   lu->maxlun = 0;
   for (i = 0; i < MAX_LU_LUN; i++) {
     lu->lun[i].type = ISTGT_LU_LUN_TYPE_NONE;
     lu->lun[i].rotationrate = DEFAULT_LU_ROTATIONRATE;
     lu->lun[i].formfactor = DEFAULT_LU_FORMFACTOR;
+    lu->lun[i].ioengine = ISTGT_LU_IOENGINE_SYNC;
+    lu->lun[i].write_cache = DEFAULT_LU_WRITE_CACHE;
     lu->lun[i].serial = NULL;
     lu->lun[i].spec = NULL;
     snprintf(buf, sizeof buf, "LUN%d", i);
@@ -1704,6 +1762,28 @@ static int istgt_lu_add_unit(ISTGT_Ptr istgt, CF_SECTION* sp) {
             formfactor = 0xf;
           }
           lu->lun[i].formfactor = formfactor;
+        } else if (strcasecmp(key, "IOEngine") == 0) {
+          if (strcasecmp(val, "Sync") == 0) {
+            lu->lun[i].ioengine = ISTGT_LU_IOENGINE_SYNC;
+          } else if (strcasecmp(val, "Uring") == 0) {
+            lu->lun[i].ioengine = ISTGT_LU_IOENGINE_URING;
+          } else {
+            ISTGT_ERRLOG("LU%d: LUN%d: unknown IOEngine(%s)\n", lu->num, i, val);
+            goto error_return;
+          }
+        } else if (strcasecmp(key, "WriteCache") == 0) {
+          if (strcasecmp(val, "None") == 0) {
+            lu->lun[i].write_cache = 0;
+          } else {
+            lu->lun[i].write_cache = istgt_lu_parse_size(val);
+          }
+          if (lu->lun[i].write_cache > MAX_LU_WRITE_CACHE) {
+            ISTGT_ERRLOG("LU%d: LUN%d: WriteCache(%s) too large\n",
+                         lu->num,
+                         i,
+                         val);
+            goto error_return;
+          }
         } else {
           ISTGT_WARNLOG("LU%d: LUN%d: unknown key(%s)\n", lu->num, i, key);
           continue;
@@ -1892,6 +1972,14 @@ static int istgt_lu_init_unit(ISTGT_Ptr istgt, ISTGT_LU_Ptr lu) {
     ISTGT_ERRLOG("LU%d: cond_init() failed\n", lu->num);
     return -1;
   }
+  rc = pthread_cond_init(&lu->exec_cond, NULL);
+  if (rc != 0) {
+    ISTGT_ERRLOG("LU%d: cond_init() failed\n", lu->num);
+    return -1;
+  }
+  lu->exec_shared = 0;
+  lu->exec_shared_waiting = 0;
+  lu->exec_excl_waiting = 0;
 
   switch (lu->type) {
     case ISTGT_LU_TYPE_DISK:
@@ -1979,31 +2067,60 @@ int istgt_lu_set_all_state(ISTGT_Ptr istgt, ISTGT_STATE state) {
   return 0;
 }
 
+/* CPUs of the NUMA node of the device backing LUN0 */
+static void istgt_lu_resolve_cpus(ISTGT_LU_Ptr lu) {
+  int node;
+
+  node = -1;
+  if (lu->lun[0].type == ISTGT_LU_LUN_TYPE_STORAGE) {
+    node = istgt_file_node(lu->lun[0].u.storage.file);
+  }
+  if (istgt_cpuset_node(&lu->cpus, node) < 0) {
+    ISTGT_TRACELOG(
+        ISTGT_TRACE_DEBUG, "LU%d: NUMA node unknown, not pinned\n", lu->num);
+    istgt_cpuset_zero(&lu->cpus);
+    return;
+  }
+  ISTGT_NOTICELOG("LU%d: threads on NUMA node %d (%d CPUs)\n",
+                  lu->num,
+                  node,
+                  lu->cpus.ncpus);
+}
+
 static int istgt_lu_create_thread(ISTGT_LU_Ptr lu) {
 #ifdef HAVE_PTHREAD_SET_NAME_NP
   char buf[MAX_TMPBUF];
 #endif
   int rc;
+  int i;
 
+  if (lu->cpus_auto) {
+    istgt_lu_resolve_cpus(lu);
+  }
   if (lu->queue_depth != 0) {
-    ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "thread for LU%d\n", lu->num);
-    /* create LU thread */
-    rc = pthread_create(&lu->thread, NULL, &luworker, (void*) lu);
-    if (rc != 0) {
-      ISTGT_ERRLOG("pthread_create() failed\n");
-      return -1;
-    }
+    ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
+                   "%d threads for LU%d\n",
+                   lu->luworkers,
+                   lu->num);
+    for (i = 0; i < lu->luworkers; i++) {
+      /* create LU thread */
+      rc = pthread_create(&lu->thread[i], NULL, &luworker, (void*) lu);
+      if (rc != 0) {
+        ISTGT_ERRLOG("pthread_create() failed\n");
+        return -1;
+      }
 #if 0
-		rc = pthread_detach(lu->thread);
-		if (rc != 0) {
-			ISTGT_ERRLOG("pthread_detach() failed\n");
-			return -1;
-		}
+			rc = pthread_detach(lu->thread[i]);
+			if (rc != 0) {
+				ISTGT_ERRLOG("pthread_detach() failed\n");
+				return -1;
+			}
 #endif
 #ifdef HAVE_PTHREAD_SET_NAME_NP
-    snprintf(buf, sizeof buf, "luthread #%d", lu->num);
-    pthread_set_name_np(lu->thread, buf);
+      snprintf(buf, sizeof buf, "luthread #%d.%d", lu->num, i);
+      pthread_set_name_np(lu->thread[i], buf);
 #endif
+    }
   }
 
   return 0;
@@ -2032,6 +2149,10 @@ int istgt_lu_create_threads(ISTGT_Ptr istgt) {
 
 static int istgt_lu_shutdown_unit(ISTGT_Ptr istgt, ISTGT_LU_Ptr lu) {
   int rc;
+  int i;
+
+  /* the reactors are gone, wake up LU threads from now on */
+  lu->home = NULL;
 
   switch (lu->type) {
     case ISTGT_LU_TYPE_DISK:
@@ -2061,11 +2182,18 @@ static int istgt_lu_shutdown_unit(ISTGT_Ptr istgt, ISTGT_LU_Ptr lu) {
     if (rc != 0) {
       ISTGT_ERRLOG("LU%d: cond_broadcast() failed\n", lu->num);
     }
-    rc = pthread_join(lu->thread, NULL);
-    if (rc != 0) {
-      ISTGT_ERRLOG("LU%d: pthread_join() failed\n", lu->num);
+    for (i = 0; i < lu->luworkers; i++) {
+      rc = pthread_join(lu->thread[i], NULL);
+      if (rc != 0) {
+        ISTGT_ERRLOG("LU%d: pthread_join() failed\n", lu->num);
+      }
     }
   }
+  rc = pthread_cond_destroy(&lu->exec_cond);
+  if (rc != 0) {
+    ISTGT_ERRLOG("LU%d: cond_destroy() failed\n", lu->num);
+    /* ignore error */
+  }
   rc = pthread_cond_destroy(&lu->queue_cond);
   if (rc != 0) {
     ISTGT_ERRLOG("LU%d: cond_destroy() failed\n", lu->num);
@@ -2170,9 +2298,9 @@ int istgt_lu_reset(ISTGT_LU_Ptr lu, uint64_t lun) {
 
   switch (lu->type) {
     case ISTGT_LU_TYPE_DISK:
-      MTX_LOCK(&lu->mutex);
+      istgt_lu_exec_lock(lu, 0);
       rc = istgt_lu_disk_reset(lu, lun_i);
-      MTX_UNLOCK(&lu->mutex);
+      istgt_lu_exec_unlock(lu, 0);
       if (rc < 0) {
         ISTGT_ERRLOG("LU%d: lu_disk_reset() failed\n", lu->num);
         return -1;
@@ -2190,6 +2318,78 @@ int istgt_lu_reset(ISTGT_LU_Ptr lu, uint64_t lun) {
   return 0;
 }
 
+void istgt_lu_exec_lock(ISTGT_LU_Ptr lu, int shared) {
+  MTX_LOCK(&lu->mutex);
+  if (shared) {
+    /* don't starve waiting exclusive commands */
+    while (lu->exec_excl_waiting != 0) {
+      lu->exec_shared_waiting++;
+      pthread_cond_wait(&lu->exec_cond, &lu->mutex);
+      lu->exec_shared_waiting--;
+    }
+    lu->exec_shared++;
+    MTX_UNLOCK(&lu->mutex);
+    return;
+  }
+  /* exclusive, hold lu->mutex until unlock */
+  lu->exec_excl_waiting++;
+  while (lu->exec_shared != 0) {
+    pthread_cond_wait(&lu->exec_cond, &lu->mutex);
+  }
+  lu->exec_excl_waiting--;
+}
+
+/* 1 if every LU has a task queue, so no command waits on a reactor */
+int istgt_lu_all_queued(ISTGT_Ptr istgt) {
+  ISTGT_LU_Ptr lu;
+  int i;
+
+  for (i = 0; i < MAX_LOGICAL_UNIT; i++) {
+    lu = istgt->logical_unit[i];
+    if (lu == NULL)
+      continue;
+    if (lu->queue_depth == 0)
+      return 0;
+  }
+  return 1;
+}
+
+/* exec lock without waiting, 0 if taken */
+int istgt_lu_exec_trylock(ISTGT_LU_Ptr lu, int shared) {
+  if (pthread_mutex_trylock(&lu->mutex) != 0)
+    return -1;
+  if (shared) {
+    if (lu->exec_excl_waiting != 0) {
+      MTX_UNLOCK(&lu->mutex);
+      return -1;
+    }
+    lu->exec_shared++;
+    MTX_UNLOCK(&lu->mutex);
+    return 0;
+  }
+  if (lu->exec_shared != 0) {
+    MTX_UNLOCK(&lu->mutex);
+    return -1;
+  }
+  return 0;
+}
+
+void istgt_lu_exec_unlock(ISTGT_LU_Ptr lu, int shared) {
+  if (shared) {
+    MTX_LOCK(&lu->mutex);
+    lu->exec_shared--;
+    if (lu->exec_shared == 0 && lu->exec_excl_waiting != 0) {
+      pthread_cond_broadcast(&lu->exec_cond);
+    }
+    MTX_UNLOCK(&lu->mutex);
+    return;
+  }
+  if (lu->exec_shared_waiting != 0) {
+    pthread_cond_broadcast(&lu->exec_cond);
+  }
+  MTX_UNLOCK(&lu->mutex);
+}
+
 int istgt_lu_execute(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
   ISTGT_LU_Ptr lu;
   int rc;
@@ -2226,9 +2426,9 @@ int istgt_lu_execute(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
           return -1;
         }
       } else {
-        MTX_LOCK(&lu->mutex);
+        istgt_lu_exec_lock(lu, 0);
         rc = istgt_lu_disk_execute(conn, lu_cmd);
-        MTX_UNLOCK(&lu->mutex);
+        istgt_lu_exec_unlock(lu, 0);
         if (rc < 0) {
           ISTGT_ERRLOG("LU%d: lu_disk_execute() failed\n", lu->num);
           return -1;
@@ -2254,9 +2454,6 @@ int istgt_lu_create_task(CONN_Ptr conn,
   ISCSI_PDU_Ptr dst_pdu, src_pdu;
   uint8_t* cdb;
   int alloc_len;
-#if 0
-	int rc;
-#endif
 
   if (lu_task == NULL)
     return -1;
@@ -2271,7 +2468,6 @@ int istgt_lu_create_task(CONN_Ptr conn,
           sizeof lu_task->initiator_port);
 
   lu_task->lun = (int) lun;
-  lu_task->use_cond = 0;
   lu_task->dup_iobuf = 0;
   lu_task->iobuf = NULL;
   lu_task->data = NULL;
@@ -2281,32 +2477,13 @@ int istgt_lu_create_task(CONN_Ptr conn,
   lu_task->condwait = 0;
   lu_task->offset = 0;
   lu_task->req_execute = 0;
-  lu_task->req_transfer_out = 0;
   lu_task->error = 0;
   lu_task->abort = 0;
   lu_task->execute = 0;
   lu_task->complete = 0;
   lu_task->lock = 0;
 
-#if 0
-	rc = pthread_mutex_init(&lu_task->trans_mutex, NULL);
-	if (rc != 0) {
-		ISTGT_ERRLOG("mutex_init() failed\n");
-		return -1;
-	}
-	rc = pthread_cond_init(&lu_task->trans_cond, NULL);
-	if (rc != 0) {
-		ISTGT_ERRLOG("cond_init() failed\n");
-		return -1;
-	}
-	rc = pthread_cond_init(&lu_task->exec_cond, NULL);
-	if (rc != 0) {
-		ISTGT_ERRLOG("cond_init() failed\n");
-		return -1;
-	}
-#endif
-
-  lu_task->lu_cmd.pdu = xmalloc(sizeof *lu_task->lu_cmd.pdu);
+  lu_task->lu_cmd.pdu = istgt_pool_alloc(sizeof *lu_task->lu_cmd.pdu);
   memset(lu_task->lu_cmd.pdu, 0, sizeof *lu_task->lu_cmd.pdu);
 
   /* copy PDU */
@@ -2355,7 +2532,6 @@ int istgt_lu_create_task(CONN_Ptr conn,
   lu_task->lu_cmd.sense_alloc_len = lu_cmd->sense_alloc_len;
 
   /* pre allocate buffer */
-  lu_task->lu_cmd.iobufsize = lu_cmd->transfer_len + 65536;
 #if 0
 	lu_task->data = xmalloc(lu_cmd->alloc_len);
 	lu_task->sense_data = xmalloc(lu_cmd->sense_alloc_len);
@@ -2363,12 +2539,24 @@ int istgt_lu_create_task(CONN_Ptr conn,
 #else
   alloc_len = ISCSI_ALIGN(lu_cmd->alloc_len);
   alloc_len += ISCSI_ALIGN(lu_cmd->sense_alloc_len);
-  alloc_len += ISCSI_ALIGN(lu_task->lu_cmd.iobufsize);
-  lu_task->data = xmalloc(alloc_len);
+  lu_task->data = istgt_pool_alloc(alloc_len);
   lu_task->sense_data = lu_task->data + ISCSI_ALIGN(lu_cmd->alloc_len);
-  lu_task->iobuf = lu_task->sense_data + ISCSI_ALIGN(lu_cmd->sense_alloc_len);
   lu_task->alloc_len = alloc_len;
 #endif
+  /* exactly the expected data, a write in immediate data uses the PDU */
+  if (lu_cmd->W_bit &&
+      lu_cmd->pdu->data_segment_len >= lu_cmd->transfer_len) {
+    lu_task->lu_cmd.iobufsize = lu_cmd->pdu->data_segment_len;
+  } else {
+    lu_task->lu_cmd.iobufsize = lu_cmd->transfer_len;
+    if (lu_cmd->transfer_len != 0) {
+      lu_task->iobuf = istgt_pool_try_alloc(lu_cmd->transfer_len);
+      if (lu_task->iobuf == NULL) {
+        /* over PoolMemory, caller destroys the task */
+        return ISTGT_LU_TASK_RESULT_QUEUE_FULL;
+      }
+    }
+  }
 
   /* creation time */
   lu_task->create_time = time(NULL);
@@ -2382,28 +2570,19 @@ int istgt_lu_create_task(CONN_Ptr conn,
 }
 
 int istgt_lu_destroy_task(ISTGT_LU_TASK_Ptr lu_task) {
-  int rc;
-
   if (lu_task == NULL)
     return -1;
 
-  if (lu_task->use_cond != 0) {
-    rc = pthread_mutex_destroy(&lu_task->trans_mutex);
-    if (rc != 0) {
-      ISTGT_ERRLOG("mutex_destroy() failed\n");
-      return -1;
-    }
-    rc = pthread_cond_destroy(&lu_task->trans_cond);
-    if (rc != 0) {
-      ISTGT_ERRLOG("cond_destroy() failed\n");
-      return -1;
-    }
-    rc = pthread_cond_destroy(&lu_task->exec_cond);
-    if (rc != 0) {
-      ISTGT_ERRLOG("cond_destroy() failed\n");
-      return -1;
-    }
+  if (lu_task->data_wait) {
+    /* Data-Out was not completed */
+    istgt_lu_disk_queue_unlink(lu_task);
+  }
+  if (lu_task->file_held) {
+    /* Data-In from file was sent */
+    istgt_lu_disk_release_task_file(lu_task);
   }
+  istgt_pool_free(lu_task->r2t_iobuf);
+  lu_task->r2t_iobuf = NULL;
   if (lu_task->lu_cmd.pdu != NULL) {
     if (lu_task->lu_cmd.pdu->copy_pdu == 0) {
       xfree(lu_task->lu_cmd.pdu->ahs);
@@ -2411,7 +2590,7 @@ int istgt_lu_destroy_task(ISTGT_LU_TASK_Ptr lu_task) {
         xfree(lu_task->lu_cmd.pdu->data);
       }
     }
-    xfree(lu_task->lu_cmd.pdu);
+    istgt_pool_free(lu_task->lu_cmd.pdu);
   }
 #if 0
 	if (lu_task->dup_iobuf == 0) {
@@ -2420,9 +2599,33 @@ int istgt_lu_destroy_task(ISTGT_LU_TASK_Ptr lu_task) {
 	xfree(lu_task->data);
 	xfree(lu_task->sense_data);
 #else
-  xfree(lu_task->data);
+  istgt_pool_free(lu_task->iobuf);
+  istgt_pool_free(lu_task->data);
 #endif
-  xfree(lu_task);
+  istgt_pool_free(lu_task);
+  return 0;
+}
+
+/* queue lu_task whose Data-Out was received asynchronously */
+int istgt_lu_queue_ready(ISTGT_LU_TASK_Ptr lu_task) {
+  ISTGT_LU_Ptr lu;
+  int rc;
+
+  lu = lu_task->lu_cmd.lu;
+  switch (lu->type) {
+    case ISTGT_LU_TYPE_DISK:
+      rc = istgt_lu_disk_queue_ready(lu_task);
+      if (rc < 0) {
+        ISTGT_ERRLOG("LU%d: lu_disk_queue_ready() failed\n", lu->num);
+        return -1;
+      }
+      break;
+
+    default:
+      ISTGT_ERRLOG("LU%d: unsupported type\n", lu->num);
+      (void) istgt_lu_destroy_task(lu_task);
+      return -1;
+  }
   return 0;
 }
 
@@ -2553,8 +2756,115 @@ int istgt_lu_clear_all_task(ISTGT_LU_Ptr lu, uint64_t lun) {
   return 0;
 }
 
+static void istgt_lu_queue_signal(ISTGT_LU_Ptr lu, int all) {
+  MTX_LOCK(&lu->queue_mutex);
+  lu->queue_check = 1;
+  if (all) {
+    pthread_cond_broadcast(&lu->queue_cond);
+  } else {
+    pthread_cond_signal(&lu->queue_cond);
+  }
+  MTX_UNLOCK(&lu->queue_mutex);
+}
+
+/* wake up a LU thread (all if all), or post to the home reactor */
+void istgt_lu_queue_wakeup(ISTGT_LU_Ptr lu, int all) {
+  if (lu->home != NULL) {
+    (void) istgt_reactor_post(&lu->rev);
+    return;
+  }
+  istgt_lu_queue_signal(lu, all);
+}
+
+/* tasks started by one post, the rest after the connections had a turn */
+#define ISTGT_LU_REACTOR_BUDGET 32
+/* tasks a LU thread starts before the backend requests are flushed */
+#define ISTGT_LU_THREAD_BATCH 16
+
+/* the luworker loop run to completion on the home reactor, never blocking */
+static void istgt_lu_reactor_event(ISTGT_REACTOR_EVENT_Ptr ev, int events) {
+  ISTGT_LU_Ptr lu = (ISTGT_LU_Ptr) ev->arg;
+  int budget;
+  int qcnt;
+  int rc;
+
+  if (!(events & ISTGT_REACTOR_POST))
+    return;
+  for (budget = ISTGT_LU_REACTOR_BUDGET; budget > 0; budget--) {
+    if (istgt_lu_get_state(lu) != ISTGT_STATE_RUNNING)
+      break;
+    qcnt = istgt_lu_disk_queue_count(lu, &lu->home_lun);
+    if (qcnt <= 0) {
+      if (qcnt < 0) {
+        ISTGT_ERRLOG("LU%d: lu_disk_queue_count() failed\n", lu->num);
+      }
+      break;
+    }
+    rc = istgt_lu_disk_queue_start(lu, lu->home_lun, 1);
+    lu->home_lun++;
+    if (rc < 0) {
+      ISTGT_ERRLOG("LU%d: lu_disk_queue_start() failed\n", lu->num);
+      break;
+    }
+    if (rc == 1) {
+      /* the task may block, a LU thread drains the queue from here */
+      istgt_lu_queue_signal(lu, 0);
+      break;
+    }
+    ev->reactor->ntasks++;
+  }
+  /* backend requests of the tasks above go in one submission */
+  istgt_lu_disk_queue_flush(lu);
+  if (budget == 0) {
+    (void) istgt_reactor_post(ev);
+  }
+}
+
+/*
+ * RunToCompletion: the reactor of the first session to lu becomes its home
+ * and runs its queued tasks, so a connection on the same reactor executes
+ * and answers a command without a thread switch. Sessions on other
+ * reactors hand their tasks over by a lock-free post.
+ */
+int istgt_lu_bind_reactor(ISTGT_LU_Ptr lu, ISTGT_REACTOR_Ptr reactor) {
+  int rc;
+
+  if (reactor == NULL || !lu->istgt->RunToCompletion)
+    return 0;
+  if (lu->type != ISTGT_LU_TYPE_DISK || lu->queue_depth == 0)
+    return 0;
+  MTX_LOCK(&lu->mutex);
+  if (lu->home != NULL) {
+    MTX_UNLOCK(&lu->mutex);
+    return 0;
+  }
+  lu->rev.fd = -1;
+  lu->rev.cb = istgt_lu_reactor_event;
+  lu->rev.arg = lu;
+  rc = istgt_reactor_add(reactor, &lu->rev);
+  if (rc < 0) {
+    MTX_UNLOCK(&lu->mutex);
+    ISTGT_ERRLOG("LU%d: reactor_add() failed\n", lu->num);
+    return -1;
+  }
+  lu->home_lun = 0;
+  lu->home = reactor;
+  MTX_UNLOCK(&lu->mutex);
+  ISTGT_TRACELOG(
+      ISTGT_TRACE_DEBUG, "LU%d: home reactor #%d\n", lu->num, reactor->id);
+  return 0;
+}
+
+static int istgt_lu_queue_checked(void* arg) {
+  ISTGT_LU_Ptr lu = (ISTGT_LU_Ptr) arg;
+
+  /* a hint only, checked again under queue_mutex */
+  return *(volatile int*) &lu->queue_check != 0;
+}
+
 static void* luworker(void* arg) {
   ISTGT_LU_Ptr lu = (ISTGT_LU_Ptr) arg;
+  ISTGT_SPIN spin;
 #if 0
 	struct timespec abstime;
 	time_t now;
@@ -2563,6 +2873,7 @@ static void* luworker(void* arg) {
   int qcnt;
   int lun;
   int rc;
+  int n;
 
   while (istgt_get_state(lu->istgt) != ISTGT_STATE_RUNNING) {
     if (istgt_get_state(lu->istgt) == ISTGT_STATE_EXITING ||
@@ -2576,6 +2887,10 @@ static void* luworker(void* arg) {
   }
 
   ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "LU%d loop start\n", lu->num);
+  if (lu->cpus.ncpus > 0 && istgt_set_affinity(&lu->cpus) < 0) {
+    ISTGT_WARNLOG("LU%d: CPUs not set (errno=%d)\n", lu->num, errno);
+  }
+  istgt_spin_init(&spin, lu->busy_poll);
   lun = 0;
   qcnt = 0;
 #if 0
@@ -2590,6 +2905,8 @@ static void* luworker(void* arg) {
           }
           qcnt = istgt_lu_disk_queue_count(lu, &lun);
           if (qcnt == 0) {
+            /* a wakeup within the budget is seen as queue_check below */
+            (void) istgt_spin_wait(&spin, istgt_lu_queue_checked, lu);
             MTX_LOCK(&lu->queue_mutex);
             if (lu->queue_check != 0) {
               lu->queue_check = 0;
@@ -2621,11 +2938,20 @@ static void* luworker(void* arg) {
           ISTGT_ERRLOG("LU%d: lu_disk_queue_count() failed\n", lu->num);
           break;
         }
-        rc = istgt_lu_disk_queue_start(lu, lun);
-        if (rc == 0 && qcnt >= 2) {
+        rc = istgt_lu_disk_queue_start(lu, lun, 0);
+        /*
+         * only tasks that cannot block join the batch, a blocking one
+         * could wait for a range whose request is not flushed yet
+         */
+        for (n = 1; rc == 0 && qcnt >= 2 && n < ISTGT_LU_THREAD_BATCH; n++) {
           qcnt--;
-          rc = istgt_lu_disk_queue_start(lu, lun);
+          rc = istgt_lu_disk_queue_start(lu, lun, 1);
+        }
+        if (rc == 1) {
+          /* left for the next round */
+          rc = 0;
         }
+        istgt_lu_disk_queue_flush(lu);
         lun++;
         if (rc == -2) {
           ISTGT_WARNLOG("LU%d: lu_disk_queue_start() aborted\n", lu->num);
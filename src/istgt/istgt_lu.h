@@ -33,6 +33,7 @@
 #include "istgt_core.h"
 #include "istgt_platform.h"
 #include "istgt_queue.h"
+#include "istgt_reactor.h"
 
 #define MAX_LU_LUN 64
 #define MAX_LU_LUN_SLOT 8
@@ -42,14 +43,19 @@
 #define MAX_LU_RESERVE 256
 #define MAX_LU_RESERVE_IPT 256
 #define MAX_LU_QUEUE_DEPTH 256
+#define MAX_LU_WORKERS 64
 
 #define USE_LU_TAPE_DLT8000
 
 #define DEFAULT_LU_BLOCKLEN 512
 #define DEFAULT_LU_BLOCKLEN_DISK DEFAULT_LU_BLOCKLEN
 #define DEFAULT_LU_QUEUE_DEPTH 32
+#define DEFAULT_LU_WORKERS 4
+#define DEFAULT_LU_INLINE_DEPTH 1
 #define DEFAULT_LU_ROTATIONRATE 7200 /* 7200 rpm */
 #define DEFAULT_LU_FORMFACTOR 0x02   /* 3.5 inch */
+#define DEFAULT_LU_WRITE_CACHE 0     /* no write-back cache */
+#define MAX_LU_WRITE_CACHE (1024ULL * 1024 * 1024)
 
 #if defined(__FreeBSD__)
 #define DEFAULT_LU_VENDOR "FreeBSD"
@@ -112,6 +118,11 @@ typedef enum {
   ISTGT_LU_LUN_TYPE_SLOT = 4,
 } ISTGT_LU_LUN_TYPE;
 
+typedef enum {
+  ISTGT_LU_IOENGINE_SYNC = 0,
+  ISTGT_LU_IOENGINE_URING = 1,
+} ISTGT_LU_IOENGINE;
+
 typedef struct istgt_lu_device_t { char* file; } ISTGT_LU_DEVICE;
 
 typedef struct istgt_lu_storage_t {
@@ -147,6 +158,8 @@ typedef struct istgt_lu_lun_t {
   } u;
   int rotationrate;
   int formfactor;
+  int ioengine;
+  uint64_t write_cache;
   char* serial;
   void* spec;
 } ISTGT_LU_LUN;
@@ -192,7 +205,12 @@ typedef struct istgt_lu_t {
   pthread_mutex_t state_mutex;
   pthread_mutex_t queue_mutex;
   pthread_cond_t queue_cond;
-  pthread_t thread;
+  pthread_cond_t exec_cond;
+  int exec_shared;
+  int exec_shared_waiting;
+  int exec_excl_waiting;
+  int luworkers;
+  pthread_t thread[MAX_LU_WORKERS];
 
   uint16_t last_tsih;
 
@@ -221,6 +239,15 @@ typedef struct istgt_lu_t {
   int blocklen;
   int queue_depth;
   int queue_check;
+  int inline_depth;
+  int busy_poll;
+  ISTGT_CPUSET cpus; /* of the LU threads, empty if not pinned */
+  int cpus_auto;     /* cpus from the NUMA node of LUN0 */
+
+  /* RunToCompletion: queued tasks run on this reactor instead of luworker */
+  ISTGT_REACTOR_Ptr home;
+  ISTGT_REACTOR_EVENT rev;
+  int home_lun;
 
   int maxlun;
   ISTGT_LU_LUN lun[MAX_LU_LUN];
@@ -256,6 +283,16 @@ typedef struct istgt_lu_cmd_t {
   uint8_t* sense_data;
   size_t sense_data_len;
   size_t sense_alloc_len;
+
+  /* owner task if queued */
+  struct istgt_lu_task_t* lu_task;
+  /* LBA range (lu_task->range if queued) and shared exec lock taken */
+  int range_held;
+
+  /* Data-In is sent from file instead of data */
+  int data_file;
+  int data_fd;
+  uint64_t data_offset;
 } ISTGT_LU_CMD;
 typedef ISTGT_LU_CMD* ISTGT_LU_CMD_Ptr;
 
@@ -271,7 +308,52 @@ enum {
   ISTGT_LU_TASK_REQUPDPDU = 2,
 } ISTGT_LU_TASK_TYPE;
 
+/* LBA range lock, linked in arrival order */
+typedef struct istgt_lu_range_t {
+  uint64_t lba;
+  uint64_t len;
+  int write;
+  struct istgt_lu_range_t* prev;
+  struct istgt_lu_range_t* next;
+} ISTGT_LU_RANGE;
+
+typedef enum {
+  ISTGT_LU_DISK_IO_READ = 0,
+  ISTGT_LU_DISK_IO_WRITE = 1,
+  ISTGT_LU_DISK_IO_SYNC = 2,
+} ISTGT_LU_DISK_IO_TYPE;
+
+/* backend request, done() is called once with result set */
+typedef struct istgt_lu_disk_io_t {
+  int type;
+  void* buf;
+  uint64_t nbytes;
+  uint64_t offset;
+  int64_t result;
+  void (*done)(struct istgt_lu_disk_io_t* io);
+  void* arg;
+} ISTGT_LU_DISK_IO;
+
+/* dirty data of the write-back cache */
+typedef struct istgt_lu_wext_t {
+  uint64_t offset;
+  uint64_t nbytes;
+  uint64_t bufsize;
+  uint8_t* buf;
+  int failed; /* write-back failed, kept until written */
+} ISTGT_LU_WEXT;
+
+/* extents sorted by offset, not overlapping each other */
+typedef struct istgt_lu_wmap_t {
+  ISTGT_LU_WEXT** ext;
+  int n;
+  int max;
+} ISTGT_LU_WMAP;
+
 typedef struct istgt_lu_task_t {
+  /* link of cmd/task/result queue, in one queue at a time */
+  ISTGT_QUEUE qnode;
+
   int type;
 
   struct istgt_conn_t* conn;
@@ -280,10 +362,6 @@ typedef struct istgt_lu_task_t {
   ISTGT_LU_CMD lu_cmd;
   int lun;
   pthread_t thread;
-  int use_cond;
-  pthread_mutex_t trans_mutex;
-  pthread_cond_t trans_cond;
-  pthread_cond_t exec_cond;
 
   time_t create_time;
   int condwait;
@@ -296,12 +374,24 @@ typedef struct istgt_lu_task_t {
 
   int offset;
   int req_execute;
-  int req_transfer_out;
   int error;
   int abort;
   int execute;
   int complete;
   int lock;
+
+  /* media access completed by backend */
+  int io_pending;
+  ISTGT_LU_DISK_IO io;
+  ISTGT_LU_RANGE range;
+  /* Data-In sent from the file, counted in inflight_file */
+  int file_held;
+
+  /* in the task set, not ready before the Data-Out is received */
+  int data_wait;
+
+  /* Data-Out buffer taken over from R2T task */
+  uint8_t* r2t_iobuf;
 } ISTGT_LU_TASK;
 typedef ISTGT_LU_TASK* ISTGT_LU_TASK_Ptr;
 
@@ -339,16 +429,32 @@ typedef struct istgt_lu_disk_t {
   int read_cache;
   int write_cache;
   /* parts for cache */
-  int wbufsize;
-  uint8_t* wbuf;
-  uint64_t woffset;
-  uint64_t wnbytes;
+  int wbufsize;     /* limit of dirty data, 0=no write-back cache */
+  uint8_t* wbuf;    /* gathers adjacent extents for write-back */
+  uint64_t woffset; /* failed write-back, reported as deferred error */
+  uint64_t wnbytes; /* memory held by dirty data */
   int req_write_cache;
   int err_write_cache;
+  pthread_mutex_t wcache_mutex;
+  pthread_cond_t wcache_cond;      /* wakes the flusher */
+  pthread_cond_t wcache_done_cond; /* write-back batch finished */
+  pthread_t wcache_thread;
+  int wcache_stop;
+  int wcache_sync;  /* waiters for clean ranges */
+  int wcache_error; /* count of failed write-backs */
+  uint64_t wcache_cursor;
+  ISTGT_LU_WMAP wdirty;
+  ISTGT_LU_WMAP wflush;   /* being written back */
+  ISTGT_LU_WMAP wfail;    /* failed write-back, older than wflush */
+  uint64_t wcache_rounds; /* finished write-back batches */
+  int wcache_retry;       /* a waiter needs the failed data written */
 
   /* thin provisioning */
   int thin_provisioning;
 
+  /* fd is a plain file, Data-In can be sent from it */
+  int zcopy;
+
   /* for ats */
   pthread_mutex_t ats_mutex;
   int watssize;
@@ -357,8 +463,15 @@ typedef struct istgt_lu_disk_t {
   int queue_depth;
   pthread_mutex_t cmd_queue_mutex;
   ISTGT_QUEUE cmd_queue;
-  pthread_mutex_t wait_lu_task_mutex;
-  ISTGT_LU_TASK_Ptr wait_lu_task;
+  int inflight;
+  int inflight_ordered;
+  int inflight_file;
+
+  /* LBA range lock */
+  pthread_mutex_t range_mutex;
+  pthread_cond_t range_cond;
+  ISTGT_LU_RANGE* range_head;
+  ISTGT_LU_RANGE* range_tail;
 
   /* PERSISTENT RESERVE */
   int npr_keys;
@@ -388,6 +501,9 @@ typedef struct istgt_lu_disk_t {
                   uint64_t nbytes,
                   uint64_t offset);
   int (*allocate)(struct istgt_lu_disk_t* spec);
+  int (*submit)(struct istgt_lu_disk_t* spec, ISTGT_LU_DISK_IO* io);
+  /* start requests left by submit(), NULL if submit() starts them */
+  int (*flush)(struct istgt_lu_disk_t* spec);
 } ISTGT_LU_DISK;
 
 #endif /* ISTGT_LU_H */
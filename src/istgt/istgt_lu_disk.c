@@ -48,6 +48,7 @@
 #include "istgt_md5.h"
 #include "istgt_misc.h"
 #include "istgt_platform.h"
+#include "istgt_pool.h"
 #include "istgt_proto.h"
 #include "istgt_queue.h"
 #include "istgt_scsi.h"
@@ -93,6 +94,7 @@ static int istgt_lu_disk_build_sense_data(
     ISTGT_LU_DISK* spec, uint8_t* data, int sk, int asc, int ascq);
 static int istgt_lu_disk_queue_abort_ITL(ISTGT_LU_DISK* spec,
                                          const char* initiator_port);
+static int istgt_lu_disk_submit_sync(ISTGT_LU_DISK* spec, ISTGT_LU_DISK_IO* io);
 
 
 static const char* istgt_get_disktype_by_ext(const char* file) {
@@ -169,20 +171,29 @@ int istgt_lu_disk_init(ISTGT_Ptr istgt, ISTGT_LU_Ptr lu) {
       ISTGT_ERRLOG("LU%d: mutex_init() failed\n", lu->num);
       return -1;
     }
-
-    spec->queue_depth = lu->queue_depth;
-    rc = pthread_mutex_init(&spec->cmd_queue_mutex, NULL);
+    rc = pthread_mutex_init(&spec->range_mutex, NULL);
     if (rc != 0) {
       ISTGT_ERRLOG("LU%d: mutex_init() failed\n", lu->num);
       return -1;
     }
-    istgt_queue_init(&spec->cmd_queue);
-    rc = pthread_mutex_init(&spec->wait_lu_task_mutex, NULL);
+    rc = pthread_cond_init(&spec->range_cond, NULL);
+    if (rc != 0) {
+      ISTGT_ERRLOG("LU%d: cond_init() failed\n", lu->num);
+      return -1;
+    }
+    spec->range_head = NULL;
+    spec->range_tail = NULL;
+
+    spec->queue_depth = lu->queue_depth;
+    rc = pthread_mutex_init(&spec->cmd_queue_mutex, NULL);
     if (rc != 0) {
       ISTGT_ERRLOG("LU%d: mutex_init() failed\n", lu->num);
       return -1;
     }
-    spec->wait_lu_task = NULL;
+    istgt_queue_init(&spec->cmd_queue);
+    spec->inflight = 0;
+    spec->inflight_ordered = 0;
+    spec->inflight_file = 0;
 
     spec->npr_keys = 0;
     /* spec is cleared, only pointer is handled */
@@ -211,6 +222,10 @@ int istgt_lu_disk_init(ISTGT_Ptr istgt, ISTGT_LU_Ptr lu) {
     spec->file = lu->lun[i].u.storage.file;
     spec->size = lu->lun[i].u.storage.size;
     spec->disktype = istgt_get_disktype_by_ext(spec->file);
+    if (strcasecmp(spec->disktype, "RAW") == 0 &&
+        lu->lun[i].ioengine == ISTGT_LU_IOENGINE_URING) {
+      spec->disktype = "URING";
+    }
 
     if (strcasecmp(spec->disktype, "VDI") == 0 ||
         strcasecmp(spec->disktype, "VHD") == 0 ||
@@ -224,6 +239,13 @@ int istgt_lu_disk_init(ISTGT_Ptr istgt, ISTGT_LU_Ptr lu) {
             "LU%d: LUN%d: lu_disk_vbox_lun_init() failed\n", lu->num, i);
         goto error_return;
       }
+    } else if (strcasecmp(spec->disktype, "URING") == 0) {
+      rc = istgt_lu_disk_uring_lun_init(spec, istgt, lu);
+      if (rc < 0) {
+        ISTGT_ERRLOG(
+            "LU%d: LUN%d: lu_disk_uring_lun_init() failed\n", lu->num, i);
+        goto error_return;
+      }
     } else if (strcasecmp(spec->disktype, "RAW") == 0) {
       rc = istgt_lu_disk_raw_lun_init(spec, istgt, lu);
       if (rc < 0) {
@@ -236,6 +258,11 @@ int istgt_lu_disk_init(ISTGT_Ptr istgt, ISTGT_LU_Ptr lu) {
       goto error_return;
     }
 
+    if (spec->submit == NULL) {
+      /* blocking backend, complete on the calling thread */
+      spec->submit = istgt_lu_disk_submit_sync;
+    }
+
     spec->blockcnt = spec->size / spec->blocklen;
     if (spec->blockcnt == 0)
       ISTGT_WARNLOG("LU%d: LUN%d: size zero\n", lu->num, i);
@@ -278,7 +305,14 @@ int istgt_lu_disk_init(ISTGT_Ptr istgt, ISTGT_LU_Ptr lu) {
         ISTGT_ERRLOG("LU%d: LUN%d: allocate error\n", lu->num, i);
         goto error_return;
       }
+      rc = istgt_lu_disk_wcache_init(spec, lu->lun[i].write_cache);
+      if (rc < 0) {
+        ISTGT_ERRLOG("LU%d: LUN%d: write cache error\n", lu->num, i);
+        goto error_return;
+      }
     }
+    /* opened without O_FSYNC, same as MODE SENSE reports */
+    spec->write_cache = 1;
 
     gb_size = spec->size / ISTGT_LU_1GB;
     mb_size = (spec->size % ISTGT_LU_1GB) / ISTGT_LU_1MB;
@@ -337,13 +371,13 @@ int istgt_lu_disk_init(ISTGT_Ptr istgt, ISTGT_LU_Ptr lu) {
     } else {
       printf("LU%d: LUN%d command queuing disabled\n", lu->num, i);
     }
-#if 0
-		if (spec->write_cache && spec->wbufsize) {
-			mb_size = (spec->wbufsize / ISTGT_LU_1MB);
-			printf("LU%d: LUN%d write buffer %"PRIu64"MB\n",
-			    lu->num, i, mb_size);
-		}
-#endif
+    if (spec->wbufsize) {
+      mb_size = (spec->wbufsize / ISTGT_LU_1MB);
+      printf("LU%d: LUN%d write-back buffer %" PRIu64 "MB\n",
+             lu->num,
+             i,
+             mb_size);
+    }
 
     lu->lun[i].spec = spec;
   }
@@ -351,9 +385,10 @@ int istgt_lu_disk_init(ISTGT_Ptr istgt, ISTGT_LU_Ptr lu) {
   return 0;
 
 error_return:
-  (void) pthread_mutex_destroy(&spec->wait_lu_task_mutex);
   (void) pthread_mutex_destroy(&spec->cmd_queue_mutex);
   (void) pthread_mutex_destroy(&spec->ats_mutex);
+  (void) pthread_cond_destroy(&spec->range_cond);
+  (void) pthread_mutex_destroy(&spec->range_mutex);
   istgt_queue_destroy(&spec->cmd_queue);
   xfree(spec);
   return -1;
@@ -379,6 +414,12 @@ int istgt_lu_disk_shutdown(ISTGT_Ptr istgt, ISTGT_LU_Ptr lu) {
     }
     spec = (ISTGT_LU_DISK*) lu->lun[i].spec;
 
+    rc = istgt_lu_disk_wcache_shutdown(spec);
+    if (rc < 0) {
+      ISTGT_ERRLOG("LU%d: LUN%d: write-back failed, data lost\n", lu->num, i);
+      /* ignore error */
+    }
+
     if (strcasecmp(spec->disktype, "VDI") == 0 ||
         strcasecmp(spec->disktype, "VHD") == 0 ||
         strcasecmp(spec->disktype, "VMDK") == 0 ||
@@ -390,6 +431,12 @@ int istgt_lu_disk_shutdown(ISTGT_Ptr istgt, ISTGT_LU_Ptr lu) {
         ISTGT_ERRLOG("LU%d: lu_disk_vbox_lun_shutdown() failed\n", lu->num);
         /* ignore error */
       }
+    } else if (strcasecmp(spec->disktype, "URING") == 0) {
+      rc = istgt_lu_disk_uring_lun_shutdown(spec, istgt, lu);
+      if (rc < 0) {
+        ISTGT_ERRLOG("LU%d: lu_disk_uring_lun_shutdown() failed\n", lu->num);
+        /* ignore error */
+      }
     } else if (strcasecmp(spec->disktype, "RAW") == 0) {
       rc = istgt_lu_disk_raw_lun_shutdown(spec, istgt, lu);
       if (rc < 0) {
@@ -415,14 +462,19 @@ int istgt_lu_disk_shutdown(ISTGT_Ptr istgt, ISTGT_LU_Ptr lu) {
       // ISTGT_ERRLOG("LU%d: mutex_destroy() failed\n", lu->num);
       /* ignore error */
     }
-
-    istgt_queue_destroy(&spec->cmd_queue);
-    rc = pthread_mutex_destroy(&spec->cmd_queue_mutex);
+    rc = pthread_cond_destroy(&spec->range_cond);
+    if (rc != 0) {
+      // ISTGT_ERRLOG("LU%d: cond_destroy() failed\n", lu->num);
+      /* ignore error */
+    }
+    rc = pthread_mutex_destroy(&spec->range_mutex);
     if (rc != 0) {
       // ISTGT_ERRLOG("LU%d: mutex_destroy() failed\n", lu->num);
       /* ignore error */
     }
-    rc = pthread_mutex_destroy(&spec->wait_lu_task_mutex);
+
+    istgt_queue_destroy(&spec->cmd_queue);
+    rc = pthread_mutex_destroy(&spec->cmd_queue_mutex);
     if (rc != 0) {
       // ISTGT_ERRLOG("LU%d: mutex_destroy() failed\n", lu->num);
       /* ignore error */
@@ -1906,6 +1958,12 @@ static int istgt_lu_disk_scsi_mode_select_page(ISTGT_LU_DISK* spec,
           }
 #endif  // _WIN32
         }
+        if (!wce && spec->wbufsize != 0) {
+          /* write through from now, nothing left behind */
+          if (istgt_lu_disk_wcache_flush(spec, spec->size, 0) < 0) {
+            ISTGT_ERRLOG("LU%d: write-back failed\n", spec->lu->num);
+          }
+        }
         if (rcd) {
           ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "MODE_SELECT Read cache disable\n");
           spec->read_cache = 0;
@@ -3714,13 +3772,158 @@ static int istgt_lu_disk_scsi_reserve(ISTGT_LU_DISK* spec,
   return 0;
 }
 
+static int istgt_lu_disk_range_conflict(ISTGT_LU_DISK* spec,
+                                        ISTGT_LU_RANGE* range) {
+  ISTGT_LU_RANGE* rp;
+
+  /* only earlier arrivals can block */
+  for (rp = spec->range_head; rp != NULL && rp != range; rp = rp->next) {
+    if (!rp->write && !range->write)
+      continue;
+    if (rp->lba < range->lba + range->len && range->lba < rp->lba + rp->len)
+      return 1;
+  }
+  return 0;
+}
+
+void istgt_lu_disk_range_lock(ISTGT_LU_DISK* spec,
+                              ISTGT_LU_RANGE* range,
+                              uint64_t lba,
+                              uint64_t len,
+                              int write) {
+  range->lba = lba;
+  range->len = len;
+  range->write = write;
+  range->next = NULL;
+
+  MTX_LOCK(&spec->range_mutex);
+  range->prev = spec->range_tail;
+  if (spec->range_tail != NULL) {
+    spec->range_tail->next = range;
+  } else {
+    spec->range_head = range;
+  }
+  spec->range_tail = range;
+  while (istgt_lu_disk_range_conflict(spec, range)) {
+    pthread_cond_wait(&spec->range_cond, &spec->range_mutex);
+  }
+  MTX_UNLOCK(&spec->range_mutex);
+}
+
+/* range lock without waiting, 0 if taken */
+static int istgt_lu_disk_range_trylock(ISTGT_LU_DISK* spec,
+                                       ISTGT_LU_RANGE* range,
+                                       uint64_t lba,
+                                       uint64_t len,
+                                       int write) {
+  range->lba = lba;
+  range->len = len;
+  range->write = write;
+  range->next = NULL;
+
+  MTX_LOCK(&spec->range_mutex);
+  /* not linked yet, checked against all ranges */
+  if (istgt_lu_disk_range_conflict(spec, range)) {
+    MTX_UNLOCK(&spec->range_mutex);
+    return -1;
+  }
+  range->prev = spec->range_tail;
+  if (spec->range_tail != NULL) {
+    spec->range_tail->next = range;
+  } else {
+    spec->range_head = range;
+  }
+  spec->range_tail = range;
+  MTX_UNLOCK(&spec->range_mutex);
+  return 0;
+}
+
+void istgt_lu_disk_range_unlock(ISTGT_LU_DISK* spec, ISTGT_LU_RANGE* range) {
+  MTX_LOCK(&spec->range_mutex);
+  if (range->prev != NULL) {
+    range->prev->next = range->next;
+  } else {
+    spec->range_head = range->next;
+  }
+  if (range->next != NULL) {
+    range->next->prev = range->prev;
+  } else {
+    spec->range_tail = range->prev;
+  }
+  /* wake later arrivals waiting for this range */
+  if (spec->range_head != NULL) {
+    pthread_cond_broadcast(&spec->range_cond);
+  }
+  MTX_UNLOCK(&spec->range_mutex);
+}
+
+static void istgt_lu_disk_io_done(ISTGT_LU_DISK_IO* io);
+
+static void istgt_lu_disk_io_prepare(ISTGT_LU_TASK_Ptr lu_task,
+                                     int type,
+                                     void* buf,
+                                     uint64_t nbytes,
+                                     uint64_t offset) {
+  ISTGT_LU_DISK_IO* io = &lu_task->io;
+
+  io->type = type;
+  io->buf = buf;
+  io->nbytes = nbytes;
+  io->offset = offset;
+  io->result = 0;
+  io->done = istgt_lu_disk_io_done;
+  io->arg = lu_task;
+  lu_task->io_pending = 1;
+}
+
+static int istgt_lu_disk_submit_sync(ISTGT_LU_DISK* spec,
+                                     ISTGT_LU_DISK_IO* io) {
+  switch (io->type) {
+    case ISTGT_LU_DISK_IO_READ:
+      io->result = spec->pread(spec, io->buf, io->nbytes, io->offset);
+      break;
+    case ISTGT_LU_DISK_IO_WRITE:
+      io->result = spec->pwrite(spec, io->buf, io->nbytes, io->offset);
+      break;
+    case ISTGT_LU_DISK_IO_SYNC:
+      io->result = spec->sync(spec, io->nbytes, io->offset);
+      break;
+    default:
+      return -1;
+  }
+  io->done(io);
+  return 0;
+}
+
+/* write back the cached range of a command, MEDIUM ERROR if it failed */
+static int istgt_lu_disk_wcache_flush_cmd(ISTGT_LU_DISK* spec,
+                                          ISTGT_LU_CMD_Ptr lu_cmd,
+                                          uint64_t nbytes,
+                                          uint64_t offset) {
+  uint8_t* sense_data;
+  size_t* sense_len;
+  int rc;
+
+  rc = istgt_lu_disk_wcache_flush(spec, nbytes, offset);
+  if (rc < 0) {
+    ISTGT_ERRLOG("lu_disk_wcache_flush() failed\n");
+    sense_data = lu_cmd->sense_data;
+    sense_len = &lu_cmd->sense_data_len;
+    *sense_len = 0;
+    /* WRITE ERROR - AUTO REALLOCATION FAILED */
+    BUILD_SENSE(MEDIUM_ERROR, 0x0c, 0x02);
+    return -1;
+  }
+  return 0;
+}
+
 static int istgt_lu_disk_lbread(ISTGT_LU_DISK* spec,
                                 CONN_Ptr conn,
                                 ISTGT_LU_CMD_Ptr lu_cmd,
                                 uint64_t lba,
-                                uint32_t len) {
-  UNUSED(conn);
-
+                                uint32_t len,
+                                int fua) {
+  ISTGT_LU_RANGE range;
   uint8_t* data;
   uint64_t maxlba;
   uint64_t llen;
@@ -3765,7 +3968,73 @@ static int istgt_lu_disk_lbread(ISTGT_LU_DISK* spec,
   }
   data = lu_cmd->iobuf;
 
+  if (spec->wbufsize != 0) {
+    if (fua) {
+      /* read from the media, newer data in the cache goes first */
+      rc = istgt_lu_disk_wcache_flush_cmd(spec, lu_cmd, nbytes, offset);
+      if (rc < 0) {
+        return -1;
+      }
+    }
+    if (!lu_cmd->range_held) {
+      istgt_lu_disk_range_lock(spec, &range, lba, llen, 0);
+    }
+    rc = istgt_lu_disk_wcache_read(spec, data, nbytes, offset);
+    if (!lu_cmd->range_held) {
+      istgt_lu_disk_range_unlock(spec, &range);
+    }
+    if (rc < 0) {
+      ISTGT_ERRLOG("lu_disk_wcache_read() failed\n");
+      return -1;
+    }
+    if (rc > 0) {
+      lu_cmd->data = data;
+      lu_cmd->data_len = nbytes;
+      return 0;
+    }
+  }
+
+#ifdef ISTGT_USE_SENDFILE
+  /* the file misses data in the write-back cache */
+  if (lu_cmd->lu_task != NULL && spec->zcopy && conn->data_digest == 0 &&
+      spec->wbufsize == 0) {
+    /*
+     * sent from file by transfer_in. no range is held across network I/O,
+     * an overlapping Simple write is unordered anyway and Ordered tasks
+     * wait for inflight_file.
+     */
+    MTX_LOCK(&spec->cmd_queue_mutex);
+    spec->inflight_file++;
+    MTX_UNLOCK(&spec->cmd_queue_mutex);
+    lu_cmd->lu_task->file_held = 1;
+    lu_cmd->data_file = 1;
+    lu_cmd->data_fd = spec->fd;
+    lu_cmd->data_offset = offset;
+    lu_cmd->data = NULL;
+    lu_cmd->data_len = nbytes;
+    return 0;
+  }
+#endif /* ISTGT_USE_SENDFILE */
+
+  if (lu_cmd->lu_task != NULL) {
+    /* submit after execute, finish by istgt_lu_disk_io_done() */
+    if (!lu_cmd->range_held) {
+      istgt_lu_disk_range_lock(spec, &lu_cmd->lu_task->range, lba, llen, 0);
+    }
+    istgt_lu_disk_io_prepare(
+        lu_cmd->lu_task, ISTGT_LU_DISK_IO_READ, data, nbytes, offset);
+    lu_cmd->data = data;
+    lu_cmd->data_len = nbytes;
+    return 0;
+  }
+
+  if (!lu_cmd->range_held) {
+    istgt_lu_disk_range_lock(spec, &range, lba, llen, 0);
+  }
   rc = spec->pread(spec, data, nbytes, offset);
+  if (!lu_cmd->range_held) {
+    istgt_lu_disk_range_unlock(spec, &range);
+  }
   if (rc < 0) {
     ISTGT_ERRLOG("lu_disk_read() failed\n");
     return -1;
@@ -3783,7 +4052,9 @@ static int istgt_lu_disk_lbwrite(ISTGT_LU_DISK* spec,
                                  CONN_Ptr conn,
                                  ISTGT_LU_CMD_Ptr lu_cmd,
                                  uint64_t lba,
-                                 uint32_t len) {
+                                 uint32_t len,
+                                 int fua) {
+  ISTGT_LU_RANGE range;
   uint8_t* data;
   uint64_t maxlba;
   uint64_t llen;
@@ -3839,7 +4110,40 @@ static int istgt_lu_disk_lbwrite(ISTGT_LU_DISK* spec,
     return -1;
   }
 
+  if (spec->wbufsize != 0) {
+    if (spec->write_cache && !fua) {
+      rc = istgt_lu_disk_wcache_write(spec, data, nbytes, offset);
+      if (rc > 0) {
+        ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "Cached %" PRIu64 " bytes\n", nbytes);
+        lu_cmd->data_len = nbytes;
+        return 0;
+      }
+    }
+    /* write through, older data in the cache must not overwrite it */
+    rc = istgt_lu_disk_wcache_flush_cmd(spec, lu_cmd, nbytes, offset);
+    if (rc < 0) {
+      return -1;
+    }
+  }
+
+  if (lu_cmd->lu_task != NULL && !fua) {
+    /* submit after execute, finish by istgt_lu_disk_io_done() */
+    if (!lu_cmd->range_held) {
+      istgt_lu_disk_range_lock(spec, &lu_cmd->lu_task->range, lba, llen, 1);
+    }
+    istgt_lu_disk_io_prepare(
+        lu_cmd->lu_task, ISTGT_LU_DISK_IO_WRITE, data, nbytes, offset);
+    lu_cmd->data_len = nbytes;
+    return 0;
+  }
+
+  if (!lu_cmd->range_held) {
+    istgt_lu_disk_range_lock(spec, &range, lba, llen, 1);
+  }
   rc = spec->pwrite(spec, data, nbytes, offset);
+  if (!lu_cmd->range_held) {
+    istgt_lu_disk_range_unlock(spec, &range);
+  }
   if (rc < 0 || (uint64_t) rc != nbytes) {
     ISTGT_ERRLOG("lu_disk_write() failed\n");
     return -1;
@@ -3847,6 +4151,14 @@ static int istgt_lu_disk_lbwrite(ISTGT_LU_DISK* spec,
   ISTGT_TRACELOG(
       ISTGT_TRACE_SCSI, "Wrote %" PRId64 "/%" PRIu64 " bytes\n", rc, nbytes);
 
+  if (fua && spec->write_cache) {
+    /* FUA, on the media before GOOD status */
+    if (spec->sync(spec, nbytes, offset) < 0) {
+      ISTGT_ERRLOG("lu_disk_sync() failed\n");
+      return -1;
+    }
+  }
+
   lu_cmd->data_len = rc;
 
   return 0;
@@ -3857,6 +4169,7 @@ static int istgt_lu_disk_lbwrite_same(ISTGT_LU_DISK* spec,
                                       ISTGT_LU_CMD_Ptr lu_cmd,
                                       uint64_t lba,
                                       uint32_t len) {
+  ISTGT_LU_RANGE range;
   uint8_t* data;
   uint64_t maxlba;
   uint64_t llen;
@@ -3928,6 +4241,10 @@ static int istgt_lu_disk_lbwrite_same(ISTGT_LU_DISK* spec,
   }
 
   spec->req_write_cache = 0;
+  if (spec->wbufsize != 0 &&
+      istgt_lu_disk_wcache_flush_cmd(spec, lu_cmd, llen * nbytes, offset) < 0) {
+    return -1;
+  }
 
 #if 0
 	nblocks = 0;
@@ -3947,18 +4264,21 @@ static int istgt_lu_disk_lbwrite_same(ISTGT_LU_DISK* spec,
     nblocks++;
   }
 
+  istgt_lu_disk_range_lock(spec, &range, lba, llen, 1);
   nblocks = 0;
   while (nblocks < llen) {
     uint64_t reqblocks = DMIN64(wblocks, (llen - nblocks));
     uint64_t reqbytes = reqblocks * nbytes;
     rc = spec->pwrite(spec, conn->workbuf, reqbytes, offset);
     if (rc < 0 || (uint64_t) rc != reqbytes) {
+      istgt_lu_disk_range_unlock(spec, &range);
       ISTGT_ERRLOG("lu_disk_pwrite() failed\n");
       return -1;
     }
     offset += reqbytes;
     nblocks += reqblocks;
   }
+  istgt_lu_disk_range_unlock(spec, &range);
 #endif
   ISTGT_TRACELOG(ISTGT_TRACE_SCSI,
                  "Wrote %" PRId64 "/%" PRIu64 " bytes\n",
@@ -3975,6 +4295,7 @@ static int istgt_lu_disk_lbwrite_ats(ISTGT_LU_DISK* spec,
                                      ISTGT_LU_CMD_Ptr lu_cmd,
                                      uint64_t lba,
                                      uint32_t len) {
+  ISTGT_LU_RANGE range;
   uint8_t* data;
   uint64_t maxlba;
   uint64_t llen;
@@ -4042,12 +4363,18 @@ static int istgt_lu_disk_lbwrite_ats(ISTGT_LU_DISK* spec,
   }
 
   spec->req_write_cache = 0;
+  if (spec->wbufsize != 0 &&
+      istgt_lu_disk_wcache_flush_cmd(spec, lu_cmd, nbytes, offset) < 0) {
+    return -1;
+  }
   /* start atomic test and set */
+  istgt_lu_disk_range_lock(spec, &range, lba, llen, 1);
   MTX_LOCK(&spec->ats_mutex);
 
   rc = spec->pread(spec, spec->watsbuf, nbytes, offset);
   if (rc < 0 || (uint64_t) rc != nbytes) {
     MTX_UNLOCK(&spec->ats_mutex);
+    istgt_lu_disk_range_unlock(spec, &range);
     ISTGT_ERRLOG("lu_disk_read() failed\n");
     return -1;
   }
@@ -4059,6 +4386,7 @@ static int istgt_lu_disk_lbwrite_ats(ISTGT_LU_DISK* spec,
 #endif
   if (memcmp(spec->watsbuf, data, nbytes) != 0) {
     MTX_UNLOCK(&spec->ats_mutex);
+    istgt_lu_disk_range_unlock(spec, &range);
     // ISTGT_ERRLOG("compare failed\n");
     /* MISCOMPARE DURING VERIFY OPERATION */
     BUILD_SENSE(MISCOMPARE, 0x1d, 0x00);
@@ -4068,6 +4396,7 @@ static int istgt_lu_disk_lbwrite_ats(ISTGT_LU_DISK* spec,
   rc = spec->pwrite(spec, data + nbytes, nbytes, offset);
   if (rc < 0 || (uint64_t) rc != nbytes) {
     MTX_UNLOCK(&spec->ats_mutex);
+    istgt_lu_disk_range_unlock(spec, &range);
     ISTGT_ERRLOG("lu_disk_pwrite() failed\n");
     return -1;
   }
@@ -4075,6 +4404,7 @@ static int istgt_lu_disk_lbwrite_ats(ISTGT_LU_DISK* spec,
       ISTGT_TRACE_SCSI, "Wrote %" PRId64 "/%" PRIu64 " bytes\n", rc, nbytes);
 
   MTX_UNLOCK(&spec->ats_mutex);
+  istgt_lu_disk_range_unlock(spec, &range);
   /* end atomic test and set */
 
   lu_cmd->data_len = nbytes * 2;
@@ -4088,7 +4418,6 @@ static int istgt_lu_disk_lbsync(ISTGT_LU_DISK* spec,
                                 uint64_t lba,
                                 uint32_t len) {
   UNUSED(conn);
-  UNUSED(lu_cmd);
 
   uint64_t maxlba;
   uint64_t llen;
@@ -4118,6 +4447,21 @@ static int istgt_lu_disk_lbsync(ISTGT_LU_DISK* spec,
     return -1;
   }
 
+  if (spec->wbufsize != 0) {
+    /* dirty data of the range goes to the file before it is synced */
+    rc = istgt_lu_disk_wcache_flush_cmd(spec, lu_cmd, nbytes, offset);
+    if (rc < 0) {
+      return -1;
+    }
+  }
+
+  if (lu_cmd->lu_task != NULL) {
+    /* submit after execute, finish by istgt_lu_disk_io_done() */
+    istgt_lu_disk_io_prepare(
+        lu_cmd->lu_task, ISTGT_LU_DISK_IO_SYNC, NULL, nbytes, offset);
+    return 0;
+  }
+
   rc = spec->sync(spec, nbytes, offset);
   if (rc < 0) {
     ISTGT_ERRLOG("lu_disk_sync() failed\n");
@@ -4297,6 +4641,13 @@ int istgt_lu_disk_reset(ISTGT_LU_Ptr lu, int lun) {
   }
 
   /* re-open file */
+  if (spec->wbufsize != 0) {
+    rc = istgt_lu_disk_wcache_flush(spec, spec->size, 0);
+    if (rc < 0) {
+      ISTGT_ERRLOG("LU%d: LUN%d: write-back failed\n", lu->num, lun);
+      /* ignore error */
+    }
+  }
   if (!spec->lu->readonly) {
     rc = spec->sync(spec, spec->size, 0);
     if (rc < 0) {
@@ -4319,6 +4670,17 @@ int istgt_lu_disk_reset(ISTGT_LU_Ptr lu, int lun) {
   return 0;
 }
 
+/* drop a task from the task set, cmd_queue_mutex must be held */
+static int istgt_lu_disk_clear_task(ISTGT_LU_TASK_Ptr lu_task) {
+  if (lu_task->data_wait) {
+    /* still receiving Data-Out, freed by its connection */
+    lu_task->data_wait = 0;
+    lu_task->abort = 1;
+    return 0;
+  }
+  return istgt_lu_destroy_task(lu_task);
+}
+
 static int istgt_lu_disk_queue_clear_internal(ISTGT_LU_DISK* spec,
                                               const char* initiator_port,
                                               int all_cmds,
@@ -4355,7 +4717,7 @@ static int istgt_lu_disk_queue_clear_internal(ISTGT_LU_DISK* spec,
                 lu_task->lu_cmd.CmdSN,
                 lu_task->lu_cmd.cdb[0],
                 (unsigned long) (now - lu_task->create_time));
-      rc = istgt_lu_destroy_task(lu_task);
+      rc = istgt_lu_disk_clear_task(lu_task);
       if (rc < 0) {
         MTX_UNLOCK(&spec->cmd_queue_mutex);
         ISTGT_ERRLOG("lu_destory_task() failed\n");
@@ -4363,7 +4725,7 @@ static int istgt_lu_disk_queue_clear_internal(ISTGT_LU_DISK* spec,
       }
       continue;
     }
-    rc = istgt_queue_enqueue(&saved_queue, lu_task);
+    rc = istgt_queue_enqueue_node(&saved_queue, &lu_task->qnode, lu_task);
     if (rc < 0) {
       MTX_UNLOCK(&spec->cmd_queue_mutex);
       ISTGT_ERRLOG("queue_enqueue() failed\n");
@@ -4374,7 +4736,7 @@ static int istgt_lu_disk_queue_clear_internal(ISTGT_LU_DISK* spec,
     lu_task = istgt_queue_dequeue(&saved_queue);
     if (lu_task == NULL)
       break;
-    rc = istgt_queue_enqueue(&spec->cmd_queue, lu_task);
+    rc = istgt_queue_enqueue_node(&spec->cmd_queue, &lu_task->qnode, lu_task);
     if (rc < 0) {
       MTX_UNLOCK(&spec->cmd_queue_mutex);
       ISTGT_ERRLOG("queue_enqueue() failed\n");
@@ -4383,32 +4745,6 @@ static int istgt_lu_disk_queue_clear_internal(ISTGT_LU_DISK* spec,
   }
   MTX_UNLOCK(&spec->cmd_queue_mutex);
 
-  /* check wait task */
-  MTX_LOCK(&spec->wait_lu_task_mutex);
-  lu_task = spec->wait_lu_task;
-  if (lu_task != NULL) {
-    if (((all_cmds != 0) || (lu_task->lu_cmd.CmdSN == CmdSN)) &&
-        (strcasecmp(lu_task->initiator_port, initiator_port) == 0)) {
-      /* conn had gone? */
-      rc = pthread_mutex_trylock(&lu_task->trans_mutex);
-      if (rc == 0) {
-        ISTGT_LOG("CmdSN(%u), OP=0x%x, ElapsedTime=%lu aborted\n",
-                  lu_task->lu_cmd.CmdSN,
-                  lu_task->lu_cmd.cdb[0],
-                  (unsigned long) (now - lu_task->create_time));
-        /* force error */
-        lu_task->error = 1;
-        lu_task->abort = 1;
-        rc = pthread_cond_broadcast(&lu_task->trans_cond);
-        if (rc != 0) {
-          /* ignore error */
-        }
-        MTX_UNLOCK(&lu_task->trans_mutex);
-      }
-    }
-  }
-  MTX_UNLOCK(&spec->wait_lu_task_mutex);
-
   rc = istgt_queue_count(&saved_queue);
   if (rc != 0) {
     ISTGT_ERRLOG("temporary queue is not empty\n");
@@ -4549,7 +4885,7 @@ int istgt_lu_disk_queue_clear_all(ISTGT_LU_Ptr lu, int lun) {
               lu_task->lu_cmd.CmdSN,
               lu_task->lu_cmd.cdb[0],
               (unsigned long) (now - lu_task->create_time));
-    rc = istgt_lu_destroy_task(lu_task);
+    rc = istgt_lu_disk_clear_task(lu_task);
     if (rc < 0) {
       MTX_UNLOCK(&spec->cmd_queue_mutex);
       ISTGT_ERRLOG("lu_destory_task() failed\n");
@@ -4558,29 +4894,6 @@ int istgt_lu_disk_queue_clear_all(ISTGT_LU_Ptr lu, int lun) {
   }
   MTX_UNLOCK(&spec->cmd_queue_mutex);
 
-  /* check wait task */
-  MTX_LOCK(&spec->wait_lu_task_mutex);
-  lu_task = spec->wait_lu_task;
-  if (lu_task != NULL) {
-    /* conn had gone? */
-    rc = pthread_mutex_trylock(&lu_task->trans_mutex);
-    if (rc == 0) {
-      ISTGT_LOG("CmdSN(%u), OP=0x%x, ElapsedTime=%lu aborted\n",
-                lu_task->lu_cmd.CmdSN,
-                lu_task->lu_cmd.cdb[0],
-                (unsigned long) (now - lu_task->create_time));
-      /* force error */
-      lu_task->error = 1;
-      lu_task->abort = 1;
-      rc = pthread_cond_broadcast(&lu_task->trans_cond);
-      if (rc != 0) {
-        /* ignore error */
-      }
-      MTX_UNLOCK(&lu_task->trans_mutex);
-    }
-  }
-  MTX_UNLOCK(&spec->wait_lu_task_mutex);
-
   MTX_LOCK(&spec->cmd_queue_mutex);
   rc = istgt_queue_count(&spec->cmd_queue);
   MTX_UNLOCK(&spec->cmd_queue_mutex);
@@ -4592,46 +4905,393 @@ int istgt_lu_disk_queue_clear_all(ISTGT_LU_Ptr lu, int lun) {
   return 0;
 }
 
-int istgt_lu_disk_queue(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
+static int istgt_lu_disk_task_ordered(ISTGT_LU_TASK_Ptr lu_task) {
+  switch (lu_task->lu_cmd.Attr_bit) {
+    case 0x02: /* Ordered */
+    case 0x04: /* ACA (NACA is not supported) */
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static ISTGT_LU_TASK_Ptr istgt_lu_disk_task_next(ISTGT_LU_DISK* spec) {
+  ISTGT_QUEUE_Ptr qp;
   ISTGT_LU_TASK_Ptr lu_task;
+  int first;
+
+  /* cmd_queue_mutex must be held */
+  first = 1;
+  for (qp = spec->cmd_queue.next; qp != NULL && qp != &spec->cmd_queue;
+       qp = qp->next) {
+    lu_task = (ISTGT_LU_TASK_Ptr) qp->elem;
+    if (istgt_lu_disk_task_ordered(lu_task)) {
+      /* Ordered, wait for all older tasks and their Data-In from file */
+      if (first && !lu_task->data_wait && spec->inflight == 0 &&
+          spec->inflight_file == 0) {
+        return lu_task;
+      }
+      return NULL;
+    }
+    if (!lu_task->data_wait) {
+      if (lu_task->lu_cmd.Attr_bit == 0x03) {
+        /* Head of Queue, start immediately */
+        return lu_task;
+      }
+      /* Simple/Untagged, wait for older Ordered task */
+      return spec->inflight_ordered == 0 ? lu_task : NULL;
+    }
+    /* still receiving Data-Out, later tasks except Ordered may pass */
+    first = 0;
+  }
+  return NULL;
+}
+
+static void istgt_lu_disk_task_done(ISTGT_LU_Ptr lu,
+                                    ISTGT_LU_DISK* spec,
+                                    int ordered) {
+  int wakeup;
+
+  MTX_LOCK(&spec->cmd_queue_mutex);
+  spec->inflight--;
+  if (ordered) {
+    spec->inflight_ordered--;
+  }
+  wakeup = 0;
+  if (ordered || spec->inflight == 0) {
+    wakeup = istgt_lu_disk_task_next(spec) != NULL;
+  }
+  MTX_UNLOCK(&spec->cmd_queue_mutex);
+
+  if (wakeup) {
+    /* barrier released, notify all LUN threads */
+    istgt_lu_queue_wakeup(lu, 1);
+  }
+}
+
+void istgt_lu_disk_release_task_file(ISTGT_LU_TASK_Ptr lu_task) {
   ISTGT_LU_Ptr lu;
   ISTGT_LU_DISK* spec;
-  uint8_t* data;
-  uint8_t* cdb;
-  uint32_t allocation_len;
-  int data_len;
-  int data_alloc_len;
-  uint8_t* sense_data;
-  size_t* sense_len;
-  int lun_i;
-  int maxq;
-  int qcnt;
+  int wakeup;
+
+  lu = lu_task->lu_cmd.lu;
+  spec = (ISTGT_LU_DISK*) lu->lun[lu_task->lun].spec;
+  lu_task->file_held = 0;
+  MTX_LOCK(&spec->cmd_queue_mutex);
+  spec->inflight_file--;
+  wakeup = 0;
+  if (spec->inflight_file == 0) {
+    wakeup = istgt_lu_disk_task_next(spec) != NULL;
+  }
+  MTX_UNLOCK(&spec->cmd_queue_mutex);
+
+  if (wakeup) {
+    /* an Ordered task may start now */
+    istgt_lu_queue_wakeup(lu, 1);
+  }
+}
+
+/* take a task whose Data-Out failed out of the task set */
+void istgt_lu_disk_queue_unlink(ISTGT_LU_TASK_Ptr lu_task) {
+  ISTGT_LU_Ptr lu;
+  ISTGT_LU_DISK* spec;
+  int wakeup;
+
+  lu = lu_task->lu_cmd.lu;
+  spec = (ISTGT_LU_DISK*) lu->lun[lu_task->lun].spec;
+  wakeup = 0;
+  MTX_LOCK(&spec->cmd_queue_mutex);
+  if (lu_task->data_wait) {
+    lu_task->data_wait = 0;
+    (void) istgt_queue_remove_node(&spec->cmd_queue, &lu_task->qnode);
+    wakeup = istgt_lu_disk_task_next(spec) != NULL;
+  }
+  MTX_UNLOCK(&spec->cmd_queue_mutex);
+
+  if (wakeup) {
+    /* barrier removed */
+    istgt_lu_queue_wakeup(lu, 1);
+  }
+}
+
+static int istgt_lu_disk_queue_transfer_out(CONN_Ptr conn,
+                                            ISTGT_LU_TASK_Ptr lu_task) {
+  ISTGT_LU_CMD_Ptr lu_cmd;
   int rc;
 
-  if (lu_cmd == NULL)
-    return -1;
-  lu = lu_cmd->lu;
-  if (lu == NULL) {
-    lu_cmd->status = ISTGT_SCSI_STATUS_CHECK_CONDITION;
+  /* receive whole data on the connection thread */
+  lu_cmd = &lu_task->lu_cmd;
+  lu_cmd->lu_task = lu_task;
+  lu_cmd->iobuf = lu_task->iobuf;
+  rc = istgt_iscsi_transfer_out(
+      conn, lu_cmd, lu_cmd->iobuf, lu_cmd->iobufsize, lu_cmd->transfer_len);
+  if (rc < 0) {
+    ISTGT_ERRLOG("iscsi_transfer_out() failed on %s(%s)\n",
+                 conn->target_port,
+                 conn->initiator_port);
     return -1;
   }
-  spec = NULL;
-  cdb = lu_cmd->cdb;
-  data = lu_cmd->data;
-  data_alloc_len = lu_cmd->alloc_len;
-  sense_data = lu_cmd->sense_data;
-  sense_len = &lu_cmd->sense_data_len;
-  *sense_len = 0;
 
-  lun_i = istgt_lu_islun2lun(lu_cmd->lun);
-  if (lun_i >= lu->maxlun) {
-#ifdef ISTGT_TRACE_DISK
-    ISTGT_ERRLOG("LU%d: LUN%d invalid\n", lu->num, lun_i);
-#endif /* ISTGT_TRACE_DISK */
-    if (cdb[0] == SPC_INQUIRY) {
-      allocation_len = DGET16(&cdb[3]);
-      if (allocation_len > (size_t) data_alloc_len) {
-        ISTGT_ERRLOG("data_alloc_len(%d) too small\n", data_alloc_len);
+  /* need response after execution */
+  lu_task->req_execute = 1;
+  return 0;
+}
+
+/* insert lu_task by task attribute and wake up a LU thread */
+static int istgt_lu_disk_queue_insert(ISTGT_LU_Ptr lu,
+                                      ISTGT_LU_DISK* spec,
+                                      ISTGT_LU_TASK_Ptr lu_task) {
+  ISTGT_LU_CMD_Ptr lu_cmd = &lu_task->lu_cmd;
+  int maxq;
+  int qcnt;
+  int rc;
+
+  MTX_LOCK(&spec->cmd_queue_mutex);
+  rc = istgt_queue_count(&spec->cmd_queue);
+  maxq = spec->queue_depth * lu->istgt->MaxSessions;
+  if (rc > maxq) {
+    MTX_UNLOCK(&spec->cmd_queue_mutex);
+    return ISTGT_LU_TASK_RESULT_QUEUE_FULL;
+  }
+  qcnt = rc;
+  ISTGT_TRACELOG(ISTGT_TRACE_SCSI,
+                 "Queue(%d), CmdSN=%u, OP=0x%x, LUN=0x%16.16" PRIx64 "\n",
+                 qcnt,
+                 lu_cmd->CmdSN,
+                 lu_cmd->cdb[0],
+                 lu_cmd->lun);
+
+  /* enqueue task to LUN */
+  switch (lu_cmd->Attr_bit) {
+    case 0x03: /* Head of Queue */
+      ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "insert Head of Queue\n");
+      rc = istgt_queue_enqueue_first_node(
+          &spec->cmd_queue, &lu_task->qnode, lu_task);
+      break;
+    case 0x00: /* Untagged */
+      ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "insert Untagged\n");
+      rc = istgt_queue_enqueue_node(&spec->cmd_queue, &lu_task->qnode, lu_task);
+      break;
+    case 0x01: /* Simple */
+      ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "insert Simple\n");
+      rc = istgt_queue_enqueue_node(&spec->cmd_queue, &lu_task->qnode, lu_task);
+      break;
+    case 0x02: /* Ordered */
+      ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "insert Ordered\n");
+      rc = istgt_queue_enqueue_node(&spec->cmd_queue, &lu_task->qnode, lu_task);
+      break;
+    case 0x04: /* ACA */
+      ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "insert ACA\n");
+      rc = istgt_queue_enqueue_node(&spec->cmd_queue, &lu_task->qnode, lu_task);
+      break;
+    default: /* Reserved */
+      ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "insert Reserved Attribute\n");
+      rc = istgt_queue_enqueue_node(&spec->cmd_queue, &lu_task->qnode, lu_task);
+      break;
+  }
+  MTX_UNLOCK(&spec->cmd_queue_mutex);
+  if (rc < 0) {
+    ISTGT_ERRLOG("queue_enqueue() failed\n");
+    return -1;
+  }
+
+  /* notify one of LUN threads */
+  istgt_lu_queue_wakeup(lu, 0);
+  return ISTGT_LU_TASK_RESULT_QUEUE_OK;
+}
+
+/* LBA range of a plain READ/WRITE, 0 for other commands */
+static int istgt_lu_disk_rw_range(uint8_t* cdb,
+                                  uint64_t* lba,
+                                  uint64_t* len,
+                                  int* write,
+                                  int* fua) {
+  *fua = 0;
+  switch (cdb[0]) {
+    case SBC_READ_6:
+    case SBC_WRITE_6:
+      *lba = (uint64_t)(DGET24(&cdb[1]) & 0x001fffffU);
+      *len = (uint64_t) DGET8(&cdb[4]);
+      if (*len == 0) {
+        *len = 256;
+      }
+      break;
+    case SBC_READ_10:
+    case SBC_WRITE_10:
+      *fua = BGET8(&cdb[1], 3);
+      *lba = (uint64_t) DGET32(&cdb[2]);
+      *len = (uint64_t) DGET16(&cdb[7]);
+      break;
+    case SBC_READ_12:
+    case SBC_WRITE_12:
+      *fua = BGET8(&cdb[1], 3);
+      *lba = (uint64_t) DGET32(&cdb[2]);
+      *len = (uint64_t) DGET32(&cdb[6]);
+      break;
+    case SBC_READ_16:
+    case SBC_WRITE_16:
+      *fua = BGET8(&cdb[1], 3);
+      *lba = (uint64_t) DGET64(&cdb[2]);
+      *len = (uint64_t) DGET32(&cdb[10]);
+      break;
+    default:
+      return 0;
+  }
+  *write = cdb[0] == SBC_WRITE_6 || cdb[0] == SBC_WRITE_10 ||
+           cdb[0] == SBC_WRITE_12 || cdb[0] == SBC_WRITE_16;
+  return 1;
+}
+
+/* take the range of a READ/WRITE that can run without waiting, 1 if held */
+static int istgt_lu_disk_range_nowait(ISTGT_LU_DISK* spec,
+                                      ISTGT_LU_CMD_Ptr lu_cmd,
+                                      ISTGT_LU_RANGE* range) {
+  uint64_t lba;
+  uint64_t len;
+  int write;
+  int fua;
+
+  if (!istgt_lu_disk_rw_range(lu_cmd->cdb, &lba, &len, &write, &fua))
+    return 0;
+  if (write && fua) {
+    /* synced to the media */
+    return 0;
+  }
+  if (spec->wbufsize != 0 && (write || fua)) {
+    /* the write-back cache waits for space and takes ranges itself */
+    return 0;
+  }
+  return istgt_lu_disk_range_trylock(spec, range, lba, len, write) == 0;
+}
+
+/* plain READ/WRITE bypassing the queue while the LUN is (nearly) idle */
+static int istgt_lu_disk_inline_start(ISTGT_LU_Ptr lu,
+                                      ISTGT_LU_DISK* spec,
+                                      ISTGT_LU_CMD_Ptr lu_cmd,
+                                      ISTGT_LU_RANGE* range) {
+  int ok;
+
+  if (lu->inline_depth == 0)
+    return 0;
+  switch (lu_cmd->cdb[0]) {
+    case SBC_READ_6:
+    case SBC_READ_10:
+    case SBC_READ_12:
+    case SBC_READ_16:
+      if (lu_cmd->transfer_len > lu_cmd->iobufsize)
+        return 0;
+      break;
+    case SBC_WRITE_6:
+    case SBC_WRITE_10:
+    case SBC_WRITE_12:
+    case SBC_WRITE_16:
+      /* no Data-Out to wait for */
+      if (lu_cmd->pdu->data_segment_len < lu_cmd->transfer_len)
+        return 0;
+      break;
+    default:
+      return 0;
+  }
+  if (lu_cmd->Attr_bit != 0x00 && lu_cmd->Attr_bit != 0x01) {
+    /* Untagged or Simple only, others take the queue ordering */
+    return 0;
+  }
+
+  MTX_LOCK(&spec->cmd_queue_mutex);
+  ok = istgt_queue_count(&spec->cmd_queue) == 0 &&
+       spec->inflight_ordered == 0 && spec->inflight < lu->inline_depth;
+  if (ok) {
+    /* a later Ordered task waits for this one */
+    spec->inflight++;
+  }
+  MTX_UNLOCK(&spec->cmd_queue_mutex);
+  if (!ok)
+    return 0;
+
+  /* the caller may be a reactor, never wait for a range or exec lock */
+  if (!istgt_lu_disk_range_nowait(spec, lu_cmd, range)) {
+    istgt_lu_disk_task_done(lu, spec, 0);
+    return 0;
+  }
+  if (istgt_lu_exec_trylock(lu, 1) < 0) {
+    istgt_lu_disk_range_unlock(spec, range);
+    istgt_lu_disk_task_done(lu, spec, 0);
+    return 0;
+  }
+  return 1;
+}
+
+static int istgt_lu_disk_inline_execute(CONN_Ptr conn,
+                                        ISTGT_LU_Ptr lu,
+                                        ISTGT_LU_DISK* spec,
+                                        ISTGT_LU_CMD_Ptr lu_cmd,
+                                        ISTGT_LU_RANGE* range) {
+  int rc;
+
+  ISTGT_TRACELOG(ISTGT_TRACE_SCSI,
+                 "LU%d: inline CmdSN=%u, OP=0x%x\n",
+                 lu->num,
+                 lu_cmd->CmdSN,
+                 lu_cmd->cdb[0]);
+  if (lu_cmd->W_bit) {
+    /* written from the immediate data as the LU thread would */
+    lu_cmd->iobuf = lu_cmd->pdu->data;
+    lu_cmd->iobufsize = lu_cmd->pdu->data_segment_len;
+  }
+  /* range and exec lock taken by istgt_lu_disk_inline_start() */
+  lu_cmd->range_held = 1;
+  rc = istgt_lu_disk_execute(conn, lu_cmd);
+  lu_cmd->range_held = 0;
+  istgt_lu_exec_unlock(lu, 1);
+  istgt_lu_disk_range_unlock(spec, range);
+  istgt_lu_disk_task_done(lu, spec, 0);
+  if (rc < 0) {
+    ISTGT_ERRLOG("lu_disk_execute() failed\n");
+    return -1;
+  }
+  return ISTGT_LU_TASK_RESULT_IMMEDIATE;
+}
+
+int istgt_lu_disk_queue(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
+  ISTGT_LU_RANGE range;
+  ISTGT_LU_TASK_Ptr lu_task;
+  int data_out;
+  ISTGT_LU_Ptr lu;
+  ISTGT_LU_DISK* spec;
+  uint8_t* data;
+  uint8_t* cdb;
+  uint32_t allocation_len;
+  int data_len;
+  int data_alloc_len;
+  uint8_t* sense_data;
+  size_t* sense_len;
+  int lun_i;
+  int rc;
+
+  if (lu_cmd == NULL)
+    return -1;
+  lu = lu_cmd->lu;
+  if (lu == NULL) {
+    lu_cmd->status = ISTGT_SCSI_STATUS_CHECK_CONDITION;
+    return -1;
+  }
+  spec = NULL;
+  cdb = lu_cmd->cdb;
+  data = lu_cmd->data;
+  data_alloc_len = lu_cmd->alloc_len;
+  sense_data = lu_cmd->sense_data;
+  sense_len = &lu_cmd->sense_data_len;
+  *sense_len = 0;
+
+  lun_i = istgt_lu_islun2lun(lu_cmd->lun);
+  if (lun_i >= lu->maxlun) {
+#ifdef ISTGT_TRACE_DISK
+    ISTGT_ERRLOG("LU%d: LUN%d invalid\n", lu->num, lun_i);
+#endif /* ISTGT_TRACE_DISK */
+    if (cdb[0] == SPC_INQUIRY) {
+      allocation_len = DGET16(&cdb[3]);
+      if (allocation_len > (size_t) data_alloc_len) {
+        ISTGT_ERRLOG("data_alloc_len(%d) too small\n", data_alloc_len);
         lu_cmd->status = ISTGT_SCSI_STATUS_CHECK_CONDITION;
         return -1;
       }
@@ -4664,22 +5324,42 @@ int istgt_lu_disk_queue(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
   }
   /* ready to enqueue, spec is valid for LUN access */
 
+  if (istgt_lu_disk_inline_start(lu, spec, lu_cmd, &range)) {
+    /* no LU thread and result queue round trip at low queue depth */
+    return istgt_lu_disk_inline_execute(conn, lu, spec, lu_cmd, &range);
+  }
+
   /* allocate task and copy LU_CMD(PDU) */
-  lu_task = xmalloc(sizeof *lu_task);
+  lu_task = istgt_pool_alloc(sizeof *lu_task);
   memset(lu_task, 0, sizeof *lu_task);
   rc = istgt_lu_create_task(conn, lu_cmd, lu_task, lun_i);
+  if (rc == ISTGT_LU_TASK_RESULT_QUEUE_FULL) {
+    /* no room for its buffer, the initiator retries */
+    lu_cmd->data_len = 0;
+    lu_cmd->status = ISTGT_SCSI_STATUS_TASK_SET_FULL;
+    rc = istgt_lu_destroy_task(lu_task);
+    if (rc < 0) {
+      ISTGT_ERRLOG("lu_destroy_task() failed\n");
+      return -1;
+    }
+    return ISTGT_LU_TASK_RESULT_QUEUE_FULL;
+  }
   if (rc < 0) {
     ISTGT_ERRLOG("lu_create_task() failed\n");
-    xfree(lu_task);
+    istgt_pool_free(lu_task);
     return -1;
   }
+  data_out = lu_cmd->W_bit &&
+             lu_cmd->pdu->data_segment_len < lu_cmd->transfer_len;
+  if (data_out) {
+    /* hold its place in the task set while Data-Out is received */
+    lu_task->data_wait = 1;
+  }
 
   /* enqueue SCSI command */
-  MTX_LOCK(&spec->cmd_queue_mutex);
-  rc = istgt_queue_count(&spec->cmd_queue);
-  maxq = spec->queue_depth * lu->istgt->MaxSessions;
-  if (rc > maxq) {
-    MTX_UNLOCK(&spec->cmd_queue_mutex);
+  rc = istgt_lu_disk_queue_insert(lu, spec, lu_task);
+  if (rc == ISTGT_LU_TASK_RESULT_QUEUE_FULL) {
+    lu_task->data_wait = 0;
     lu_cmd->data_len = 0;
     lu_cmd->status = ISTGT_SCSI_STATUS_TASK_SET_FULL;
     rc = istgt_lu_destroy_task(lu_task);
@@ -4689,45 +5369,8 @@ int istgt_lu_disk_queue(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
     }
     return ISTGT_LU_TASK_RESULT_QUEUE_FULL;
   }
-  qcnt = rc;
-  ISTGT_TRACELOG(ISTGT_TRACE_SCSI,
-                 "Queue(%d), CmdSN=%u, OP=0x%x, LUN=0x%16.16" PRIx64 "\n",
-                 qcnt,
-                 lu_cmd->CmdSN,
-                 lu_cmd->cdb[0],
-                 lu_cmd->lun);
-
-  /* enqueue task to LUN */
-  switch (lu_cmd->Attr_bit) {
-    case 0x03: /* Head of Queue */
-      ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "insert Head of Queue\n");
-      rc = istgt_queue_enqueue_first(&spec->cmd_queue, lu_task);
-      break;
-    case 0x00: /* Untagged */
-      ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "insert Untagged\n");
-      rc = istgt_queue_enqueue(&spec->cmd_queue, lu_task);
-      break;
-    case 0x01: /* Simple */
-      ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "insert Simple\n");
-      rc = istgt_queue_enqueue(&spec->cmd_queue, lu_task);
-      break;
-    case 0x02: /* Ordered */
-      ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "insert Ordered\n");
-      rc = istgt_queue_enqueue(&spec->cmd_queue, lu_task);
-      break;
-    case 0x04: /* ACA */
-      ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "insert ACA\n");
-      rc = istgt_queue_enqueue(&spec->cmd_queue, lu_task);
-      break;
-    default: /* Reserved */
-      ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "insert Reserved Attribute\n");
-      rc = istgt_queue_enqueue(&spec->cmd_queue, lu_task);
-      break;
-  }
-  MTX_UNLOCK(&spec->cmd_queue_mutex);
   if (rc < 0) {
-    ISTGT_ERRLOG("queue_enqueue() failed\n");
-  error_return:
+    lu_task->data_wait = 0;
     rc = istgt_lu_destroy_task(lu_task);
     if (rc < 0) {
       ISTGT_ERRLOG("lu_destroy_task() failed\n");
@@ -4736,19 +5379,56 @@ int istgt_lu_disk_queue(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
     return -1;
   }
 
-  /* notify LUN thread */
-  MTX_LOCK(&lu->queue_mutex);
-  lu->queue_check = 1;
-  rc = pthread_cond_broadcast(&lu->queue_cond);
-  MTX_UNLOCK(&lu->queue_mutex);
-  if (rc != 0) {
-    ISTGT_ERRLOG("LU%d: cond_broadcast() failed\n", lu->num);
-    goto error_return;
+  if (data_out) {
+    /* LU threads never wait for Data-Out */
+    rc = istgt_iscsi_transfer_out_async(conn, lu_task);
+    if (rc > 0) {
+      /* ready by istgt_lu_disk_queue_ready() after the last Data-Out */
+      return ISTGT_LU_TASK_RESULT_QUEUE_OK;
+    }
+    if (rc == 0) {
+      rc = istgt_lu_disk_queue_transfer_out(conn, lu_task);
+    }
+    if (rc < 0) {
+      (void) istgt_lu_destroy_task(lu_task);
+      return -1;
+    }
+    rc = istgt_lu_disk_queue_ready(lu_task);
+    if (rc < 0) {
+      return -1;
+    }
   }
 
   return ISTGT_LU_TASK_RESULT_QUEUE_OK;
 }
 
+/* Data-Out of lu_task was received, owns lu_task */
+int istgt_lu_disk_queue_ready(ISTGT_LU_TASK_Ptr lu_task) {
+  ISTGT_LU_Ptr lu = lu_task->lu_cmd.lu;
+  ISTGT_LU_DISK* spec;
+  int wakeup;
+
+  spec = (ISTGT_LU_DISK*) lu->lun[lu_task->lun].spec;
+  /* need response after execution */
+  lu_task->req_execute = 1;
+  /* in the task set since istgt_lu_disk_queue() */
+  MTX_LOCK(&spec->cmd_queue_mutex);
+  if (lu_task->abort) {
+    /* cleared while receiving */
+    MTX_UNLOCK(&spec->cmd_queue_mutex);
+    (void) istgt_lu_destroy_task(lu_task);
+    return 0;
+  }
+  lu_task->data_wait = 0;
+  wakeup = istgt_lu_disk_task_next(spec) != NULL;
+  MTX_UNLOCK(&spec->cmd_queue_mutex);
+
+  if (wakeup) {
+    istgt_lu_queue_wakeup(lu, 1);
+  }
+  return 0;
+}
+
 int istgt_lu_disk_queue_count(ISTGT_LU_Ptr lu, int* lun) {
   ISTGT_LU_DISK* spec;
   int qcnt;
@@ -4780,6 +5460,11 @@ int istgt_lu_disk_queue_count(ISTGT_LU_Ptr lu, int* lun) {
 
     MTX_LOCK(&spec->cmd_queue_mutex);
     qcnt = istgt_queue_count(&spec->cmd_queue);
+    if (qcnt > 0 &&
+        istgt_lu_disk_task_next(spec) == NULL) {
+      /* blocked by task attribute */
+      qcnt = 0;
+    }
     MTX_UNLOCK(&spec->cmd_queue_mutex);
     if (qcnt > 0) {
       ISTGT_TRACELOG(
@@ -4797,39 +5482,165 @@ int istgt_lu_disk_queue_count(ISTGT_LU_Ptr lu, int* lun) {
   return qcnt;
 }
 
-int istgt_lu_disk_queue_start(ISTGT_LU_Ptr lu, int lun) {
-  ISTGT_Ptr istgt;
+static int istgt_lu_disk_exec_shared(const uint8_t* cdb) {
+  /* media access only, can run with other shared commands */
+  switch (cdb[0]) {
+    case SBC_READ_6:
+    case SBC_READ_10:
+    case SBC_READ_12:
+    case SBC_READ_16:
+    case SBC_WRITE_6:
+    case SBC_WRITE_10:
+    case SBC_WRITE_12:
+    case SBC_WRITE_16:
+    case SBC_WRITE_AND_VERIFY_10:
+    case SBC_WRITE_AND_VERIFY_12:
+    case SBC_WRITE_AND_VERIFY_16:
+    case SBC_VERIFY_10:
+    case SBC_VERIFY_12:
+    case SBC_VERIFY_16:
+    case SBC_SYNCHRONIZE_CACHE_10:
+    case SBC_SYNCHRONIZE_CACHE_16:
+      return 1;
+    default:
+      /* WRITE SAME uses conn->workbuf, COMPARE AND WRITE must be atomic */
+      return 0;
+  }
+}
+
+static void istgt_lu_disk_io_done(ISTGT_LU_DISK_IO* io) {
+  ISTGT_LU_TASK_Ptr lu_task = (ISTGT_LU_TASK_Ptr) io->arg;
+  ISTGT_LU_CMD_Ptr lu_cmd = &lu_task->lu_cmd;
+  ISTGT_LU_Ptr lu = lu_cmd->lu;
   ISTGT_LU_DISK* spec;
-  ISTGT_LU_TASK_Ptr lu_task;
   CONN_Ptr conn;
-  ISTGT_LU_CMD_Ptr lu_cmd;
-  struct timespec abstime;
-  time_t start, now;
-  uint8_t* iobuf;
-  char tmp[1];
-  int abort_task = 0;
+  int ordered;
+  int error;
   int rc;
 
-  if (lun < 0 || lun >= lu->maxlun) {
-    return -1;
+  spec = (ISTGT_LU_DISK*) lu->lun[lu_task->lun].spec;
+  if (io->type != ISTGT_LU_DISK_IO_SYNC) {
+    istgt_lu_disk_range_unlock(spec, &lu_task->range);
   }
 
-  ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "LU%d: LUN%d queue start\n", lu->num, lun);
-  spec = (ISTGT_LU_DISK*) lu->lun[lun].spec;
-  if (spec == NULL)
+  error = 0;
+  switch (io->type) {
+    case ISTGT_LU_DISK_IO_READ:
+      if (io->result < 0) {
+        ISTGT_ERRLOG("lu_disk_read() failed\n");
+        error = 1;
+        break;
+      }
+      ISTGT_TRACELOG(ISTGT_TRACE_SCSI,
+                     "Read %" PRId64 "/%" PRIu64 " bytes\n",
+                     io->result,
+                     io->nbytes);
+      lu_cmd->data_len = io->result;
+      break;
+    case ISTGT_LU_DISK_IO_WRITE:
+      if (io->result < 0 || (uint64_t) io->result != io->nbytes) {
+        ISTGT_ERRLOG("lu_disk_write() failed\n");
+        error = 1;
+        break;
+      }
+      ISTGT_TRACELOG(ISTGT_TRACE_SCSI,
+                     "Wrote %" PRId64 "/%" PRIu64 " bytes\n",
+                     io->result,
+                     io->nbytes);
+      lu_cmd->data_len = io->result;
+      break;
+    default:
+      if (io->result < 0) {
+        ISTGT_ERRLOG("lu_disk_sync() failed\n");
+        error = 1;
+      }
+      break;
+  }
+  if (error) {
+    lu_cmd->data_len = 0;
+    lu_cmd->status = ISTGT_SCSI_STATUS_CHECK_CONDITION;
+  }
+  lu_task->io_pending = 0;
+  ordered = istgt_lu_disk_task_ordered(lu_task);
+  istgt_lu_exec_unlock(lu, istgt_lu_disk_exec_shared(lu_cmd->cdb));
+
+  /* response, lu_task belongs to the connection now */
+  conn = lu_task->conn;
+  rc = istgt_iscsi_queue_result(conn, lu_task);
+  if (rc < 0) {
+    ISTGT_ERRLOG("lu_disk_queue_result() failed\n");
+    istgt_lu_destroy_task(lu_task);
+  }
+  istgt_lu_disk_task_done(lu, spec, ordered);
+  /* conn may be freed after this */
+  __atomic_sub_fetch(&conn->lu_tasks, 1, __ATOMIC_SEQ_CST);
+}
+
+/* 0 = responded, 1 = completion pending in backend, -1 = error */
+static int istgt_lu_disk_queue_execute(CONN_Ptr conn,
+                                       ISTGT_LU_DISK* spec,
+                                       ISTGT_LU_TASK_Ptr lu_task) {
+  ISTGT_LU_CMD_Ptr lu_cmd = &lu_task->lu_cmd;
+  int shared;
+  int rc;
+
+  shared = istgt_lu_disk_exec_shared(lu_cmd->cdb);
+  if (lu_cmd->range_held) {
+    /* taken by istgt_lu_disk_queue_start() without waiting */
+    shared = 1;
+  } else {
+    istgt_lu_exec_lock(lu_cmd->lu, shared);
+  }
+  rc = istgt_lu_disk_execute(conn, lu_cmd);
+  if (rc < 0) {
+    istgt_lu_exec_unlock(lu_cmd->lu, shared);
+    if (lu_cmd->range_held) {
+      istgt_lu_disk_range_unlock(spec, &lu_task->range);
+      lu_cmd->range_held = 0;
+    }
+    ISTGT_ERRLOG("lu_disk_execute() failed\n");
     return -1;
+  }
+  lu_task->execute = 1;
 
-  MTX_LOCK(&spec->cmd_queue_mutex);
-  lu_task = istgt_queue_dequeue(&spec->cmd_queue);
-  MTX_UNLOCK(&spec->cmd_queue_mutex);
-  if (lu_task == NULL) {
-    /* cleared or empty queue */
-    return 0;
+  if (lu_task->io_pending) {
+    /* exec lock and response are handled by istgt_lu_disk_io_done() */
+    rc = spec->submit(spec, &lu_task->io);
+    if (rc < 0) {
+      ISTGT_ERRLOG("lu_disk_submit() failed\n");
+      lu_task->io.result = -1;
+      lu_task->io.done(&lu_task->io);
+    }
+    return 1;
   }
+  istgt_lu_exec_unlock(lu_cmd->lu, shared);
+  if (lu_cmd->range_held) {
+    /* not handed to the backend */
+    istgt_lu_disk_range_unlock(spec, &lu_task->range);
+    lu_cmd->range_held = 0;
+  }
+
+  /* response */
+  return istgt_iscsi_queue_result(conn, lu_task);
+}
+
+static int istgt_lu_disk_queue_exec(ISTGT_LU_Ptr lu,
+                                    int lun,
+                                    ISTGT_LU_DISK* spec,
+                                    ISTGT_LU_TASK_Ptr lu_task) {
+  ISTGT_Ptr istgt;
+  CONN_Ptr conn;
+  ISTGT_LU_CMD_Ptr lu_cmd;
+  uint8_t* iobuf;
+  int abort_task = 0;
+  int pending = 0;
+  int rc;
+
   lu_task->thread = pthread_self();
   conn = lu_task->conn;
   istgt = conn->istgt;
   lu_cmd = &lu_task->lu_cmd;
+  lu_cmd->lu_task = lu_task;
 
 /* XXX need pre-allocate? */
 #if 0
@@ -4843,7 +5654,6 @@ int istgt_lu_disk_queue_start(ISTGT_LU_Ptr lu, int lun) {
   lu_cmd->sense_data = lu_task->sense_data;
   lu_cmd->sense_data_len = 0;
 
-  tmp[0] = 'Q';
   if (lu_cmd->W_bit) {
     if (lu_cmd->pdu->data_segment_len >= lu_cmd->transfer_len) {
       ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
@@ -4861,11 +5671,8 @@ int istgt_lu_disk_queue_start(ISTGT_LU_Ptr lu, int lun) {
 #endif
       lu_cmd->iobuf = iobuf;
 
-      MTX_LOCK(&lu_cmd->lu->mutex);
-      rc = istgt_lu_disk_execute(conn, lu_cmd);
-      MTX_UNLOCK(&lu_cmd->lu->mutex);
+      rc = istgt_lu_disk_queue_execute(conn, spec, lu_task);
       if (rc < 0) {
-        ISTGT_ERRLOG("lu_disk_execute() failed\n");
       error_return:
         rc = istgt_lu_destroy_task(lu_task);
         if (rc < 0) {
@@ -4874,230 +5681,24 @@ int istgt_lu_disk_queue_start(ISTGT_LU_Ptr lu, int lun) {
         }
         return -1;
       }
-      lu_task->execute = 1;
-
-      /* response */
-      if (conn->use_sender == 0) {
-        MTX_LOCK(&conn->task_queue_mutex);
-        rc = istgt_queue_enqueue(&conn->task_queue, lu_task);
-        MTX_UNLOCK(&conn->task_queue_mutex);
-        if (rc < 0) {
-          ISTGT_ERRLOG("queue_enqueue() failed\n");
-          goto error_return;
-        }
-        rc = istgt_control_pipe_write(&conn->task_pipe, tmp, 1);
-        if (rc < 0 || rc != 1) {
-          ISTGT_ERRLOG("write() failed\n");
-          goto error_return;
-        }
-      } else {
-        MTX_LOCK(&conn->result_queue_mutex);
-        rc = istgt_queue_enqueue(&conn->result_queue, lu_task);
-        if (rc < 0) {
-          MTX_UNLOCK(&conn->result_queue_mutex);
-          ISTGT_ERRLOG("queue_enqueue() failed\n");
-          goto error_return;
-        }
-        rc = pthread_cond_broadcast(&conn->result_queue_cond);
-        MTX_UNLOCK(&conn->result_queue_mutex);
-        if (rc != 0) {
-          ISTGT_ERRLOG("cond_broadcast() failed\n");
-          goto error_return;
-        }
-      }
-
-#if 0
-			/* write cache */
-			if (spec->req_write_cache) {
-				MTX_LOCK(&lu->mutex);
-				rc = istgt_lu_disk_write_cache(spec, conn);
-				MTX_UNLOCK(&lu->mutex);
-				if (rc < 0) {
-					ISTGT_ERRLOG("disk_write_cache() failed\n");
-					return -1;
-				}
-			}
-#endif
+      pending = rc;
     } else {
       ISTGT_TRACELOG(
           ISTGT_TRACE_DEBUG, "LU%d: LUN%d Task Write Start\n", lu->num, lun);
 
-#if 0
-			MTX_LOCK(&spec->wait_lu_task_mutex);
-			spec->wait_lu_task = NULL;
-			MTX_UNLOCK(&spec->wait_lu_task_mutex);
-#endif
-      rc = pthread_mutex_init(&lu_task->trans_mutex, NULL);
-      if (rc != 0) {
-        ISTGT_ERRLOG("mutex_init() failed\n");
-        goto error_return;
-      }
-      rc = pthread_cond_init(&lu_task->trans_cond, NULL);
-      if (rc != 0) {
-        ISTGT_ERRLOG("cond_init() failed\n");
-        goto error_return;
-      }
-      rc = pthread_cond_init(&lu_task->exec_cond, NULL);
-      if (rc != 0) {
-        ISTGT_ERRLOG("cond_init() failed\n");
-        goto error_return;
-      }
-      lu_task->use_cond = 1;
-#if 0
-			lu_cmd->iobufsize = lu_cmd->transfer_len + 65536;
-			iobuf = xmalloc(lu_cmd->iobufsize);
-			lu_task->iobuf = iobuf;
-#else
-      lu_cmd->iobufsize = lu_task->lu_cmd.iobufsize;
-      iobuf = lu_task->iobuf;
-#endif
-      lu_cmd->iobuf = iobuf;
-      lu_task->req_transfer_out = 1;
-      memset(&abstime, 0, sizeof abstime);
-      abstime.tv_sec = 0;
-      abstime.tv_nsec = 0;
-
-      MTX_LOCK(&conn->task_queue_mutex);
-      rc = istgt_queue_enqueue(&conn->task_queue, lu_task);
-      MTX_UNLOCK(&conn->task_queue_mutex);
-      if (rc < 0) {
-        MTX_UNLOCK(&lu_task->trans_mutex);
-        ISTGT_ERRLOG("queue_enqueue() failed\n");
-        goto error_return;
-      }
-      rc = istgt_control_pipe_write(&conn->task_pipe, tmp, 1);
-      if (rc < 0 || rc != 1) {
-        MTX_UNLOCK(&lu_task->trans_mutex);
-        ISTGT_ERRLOG("write() failed\n");
-        goto error_return;
-      }
-
-      start = now = time(NULL);
-      abstime.tv_sec = now + (lu_task->condwait / 1000);
-      abstime.tv_nsec = (lu_task->condwait % 1000) * 1000000;
-#if 0
-			ISTGT_LOG("wait CmdSN=%u\n", lu_task->lu_cmd.CmdSN);
-#endif
-      MTX_LOCK(&lu_task->trans_mutex);
-      MTX_LOCK(&spec->wait_lu_task_mutex);
-      spec->wait_lu_task = lu_task;
-      MTX_UNLOCK(&spec->wait_lu_task_mutex);
-      rc = 0;
-      while (lu_task->req_transfer_out == 1) {
-        rc = pthread_cond_timedwait(
-            &lu_task->trans_cond, &lu_task->trans_mutex, &abstime);
-        if (rc == ETIMEDOUT) {
-          if (lu_task->req_transfer_out == 1) {
-            lu_task->error = 1;
-            MTX_LOCK(&spec->wait_lu_task_mutex);
-            spec->wait_lu_task = NULL;
-            MTX_UNLOCK(&spec->wait_lu_task_mutex);
-            MTX_UNLOCK(&lu_task->trans_mutex);
-            now = time(NULL);
-            ISTGT_ERRLOG(
-                "timeout trans_cond CmdSN=%u "
-                "(time=%d)\n",
-                lu_task->lu_cmd.CmdSN,
-                istgt_difftime(now, start));
-            /* timeout */
-            return -1;
-          }
-          /* OK cond */
-          rc = 0;
-          break;
-        }
-        if (lu_task->error != 0) {
-          rc = -1;
-          break;
-        }
-        if (rc != 0) {
-          break;
-        }
-      }
-      MTX_LOCK(&spec->wait_lu_task_mutex);
-      spec->wait_lu_task = NULL;
-      MTX_UNLOCK(&spec->wait_lu_task_mutex);
-      MTX_UNLOCK(&lu_task->trans_mutex);
-      if (rc != 0) {
-        if (rc < 0) {
-          lu_task->error = 1;
-          if (lu_task->abort) {
-            ISTGT_WARNLOG("transfer abort CmdSN=%u\n", lu_task->lu_cmd.CmdSN);
-            return -2;
-          } else {
-            ISTGT_ERRLOG("transfer error CmdSN=%u\n", lu_task->lu_cmd.CmdSN);
-            return -1;
-          }
-        }
-        if (rc == ETIMEDOUT) {
-          lu_task->error = 1;
-          now = time(NULL);
-          ISTGT_ERRLOG("timeout trans_cond CmdSN=%u (time=%d)\n",
-                       lu_task->lu_cmd.CmdSN,
-                       istgt_difftime(now, start));
-          return -1;
-        }
-        lu_task->error = 1;
-        ISTGT_ERRLOG("cond_timedwait rc=%d\n", rc);
-        return -1;
-      }
+      /* Data-Out was received by the connection before queueing,
+       * iobuf may be the one taken over from the R2T task */
 
       if (lu_task->req_execute == 0) {
         ISTGT_ERRLOG("wrong request\n");
         goto error_return;
       }
-      MTX_LOCK(&lu_cmd->lu->mutex);
-      rc = istgt_lu_disk_execute(conn, lu_cmd);
-      MTX_UNLOCK(&lu_cmd->lu->mutex);
+      rc = istgt_lu_disk_queue_execute(conn, spec, lu_task);
       if (rc < 0) {
         lu_task->error = 1;
-        ISTGT_ERRLOG("lu_disk_execute() failed\n");
         goto error_return;
       }
-      lu_task->execute = 1;
-
-      /* response */
-      if (conn->use_sender == 0) {
-        MTX_LOCK(&conn->task_queue_mutex);
-        rc = istgt_queue_enqueue(&conn->task_queue, lu_task);
-        MTX_UNLOCK(&conn->task_queue_mutex);
-        if (rc < 0) {
-          ISTGT_ERRLOG("queue_enqueue() failed\n");
-          goto error_return;
-        }
-        rc = istgt_control_pipe_write(&conn->task_pipe, tmp, 1);
-        if (rc < 0 || rc != 1) {
-          ISTGT_ERRLOG("write() failed\n");
-          goto error_return;
-        }
-      } else {
-        MTX_LOCK(&conn->result_queue_mutex);
-        rc = istgt_queue_enqueue(&conn->result_queue, lu_task);
-        if (rc < 0) {
-          MTX_UNLOCK(&conn->result_queue_mutex);
-          ISTGT_ERRLOG("queue_enqueue() failed\n");
-          goto error_return;
-        }
-        rc = pthread_cond_broadcast(&conn->result_queue_cond);
-        MTX_UNLOCK(&conn->result_queue_mutex);
-        if (rc != 0) {
-          ISTGT_ERRLOG("cond_broadcast() failed\n");
-          goto error_return;
-        }
-      }
-
-#if 0
-			/* write cache */
-			if (spec->req_write_cache) {
-				MTX_LOCK(&lu->mutex);
-				rc = istgt_lu_disk_write_cache(spec, conn);
-				MTX_UNLOCK(&lu->mutex);
-				if (rc < 0) {
-					ISTGT_ERRLOG("disk_write_cache() failed\n");
-					return -1;
-				}
-			}
-#endif
+      pending = rc;
     }
   } else {
     ISTGT_TRACELOG(
@@ -5111,44 +5712,11 @@ int istgt_lu_disk_queue_start(ISTGT_LU_Ptr lu, int lun) {
     iobuf = lu_task->iobuf;
 #endif
     lu_cmd->iobuf = iobuf;
-    MTX_LOCK(&lu_cmd->lu->mutex);
-    rc = istgt_lu_disk_execute(conn, lu_cmd);
-    MTX_UNLOCK(&lu_cmd->lu->mutex);
+    rc = istgt_lu_disk_queue_execute(conn, spec, lu_task);
     if (rc < 0) {
-      ISTGT_ERRLOG("lu_disk_execute() failed\n");
       goto error_return;
     }
-    lu_task->execute = 1;
-
-    /* response */
-    if (conn->use_sender == 0) {
-      MTX_LOCK(&conn->task_queue_mutex);
-      rc = istgt_queue_enqueue(&conn->task_queue, lu_task);
-      MTX_UNLOCK(&conn->task_queue_mutex);
-      if (rc < 0) {
-        ISTGT_ERRLOG("queue_enqueue() failed\n");
-        goto error_return;
-      }
-      rc = istgt_control_pipe_write(&conn->task_pipe, tmp, 1);
-      if (rc < 0 || rc != 1) {
-        ISTGT_ERRLOG("write() failed\n");
-        goto error_return;
-      }
-    } else {
-      MTX_LOCK(&conn->result_queue_mutex);
-      rc = istgt_queue_enqueue(&conn->result_queue, lu_task);
-      if (rc < 0) {
-        MTX_UNLOCK(&conn->result_queue_mutex);
-        ISTGT_ERRLOG("queue_enqueue() failed\n");
-        goto error_return;
-      }
-      rc = pthread_cond_broadcast(&conn->result_queue_cond);
-      MTX_UNLOCK(&conn->result_queue_mutex);
-      if (rc != 0) {
-        ISTGT_ERRLOG("cond_broadcast() failed\n");
-        goto error_return;
-      }
-    }
+    pending = rc;
   }
 
   ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "LU%d: LUN%d queue end\n", lu->num, lun);
@@ -5157,7 +5725,81 @@ int istgt_lu_disk_queue_start(ISTGT_LU_Ptr lu, int lun) {
     ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "Abort Task\n");
     return -1;
   }
-  return 0;
+  return pending;
+}
+
+/*
+ * start the first ready task. with nowait (a reactor) only a READ/WRITE
+ * whose range and exec lock are free is started, 1 is returned if the
+ * task is left for a LU thread.
+ */
+int istgt_lu_disk_queue_start(ISTGT_LU_Ptr lu, int lun, int nowait) {
+  ISTGT_LU_DISK* spec;
+  ISTGT_LU_TASK_Ptr lu_task;
+  CONN_Ptr conn;
+  int ordered;
+  int rc;
+
+  if (lun < 0 || lun >= lu->maxlun) {
+    return -1;
+  }
+
+  ISTGT_TRACELOG(ISTGT_TRACE_SCSI, "LU%d: LUN%d queue start\n", lu->num, lun);
+  spec = (ISTGT_LU_DISK*) lu->lun[lun].spec;
+  if (spec == NULL)
+    return -1;
+
+  MTX_LOCK(&spec->cmd_queue_mutex);
+  lu_task = istgt_lu_disk_task_next(spec);
+  if (lu_task == NULL) {
+    MTX_UNLOCK(&spec->cmd_queue_mutex);
+    /* cleared, empty queue or blocked by task attribute */
+    return 0;
+  }
+  if (nowait) {
+    if (!istgt_lu_disk_range_nowait(spec, &lu_task->lu_cmd, &lu_task->range)) {
+      MTX_UNLOCK(&spec->cmd_queue_mutex);
+      return 1;
+    }
+    if (istgt_lu_exec_trylock(lu, 1) < 0) {
+      istgt_lu_disk_range_unlock(spec, &lu_task->range);
+      MTX_UNLOCK(&spec->cmd_queue_mutex);
+      return 1;
+    }
+    lu_task->lu_cmd.range_held = 1;
+  }
+  (void) istgt_queue_remove_node(&spec->cmd_queue, &lu_task->qnode);
+  ordered = istgt_lu_disk_task_ordered(lu_task);
+  spec->inflight++;
+  if (ordered) {
+    spec->inflight_ordered++;
+  }
+  /* no longer cleared, the connection waits for it */
+  conn = lu_task->conn;
+  __atomic_add_fetch(&conn->lu_tasks, 1, __ATOMIC_SEQ_CST);
+  MTX_UNLOCK(&spec->cmd_queue_mutex);
+
+  rc = istgt_lu_disk_queue_exec(lu, lun, spec, lu_task);
+  if (rc == 1) {
+    /* finished by backend completion */
+    return 0;
+  }
+  istgt_lu_disk_task_done(lu, spec, ordered);
+  __atomic_sub_fetch(&conn->lu_tasks, 1, __ATOMIC_SEQ_CST);
+  return rc;
+}
+
+/* end of a batch of queue_start, backend requests are started together */
+void istgt_lu_disk_queue_flush(ISTGT_LU_Ptr lu) {
+  ISTGT_LU_DISK* spec;
+  int i;
+
+  for (i = 0; i < lu->maxlun; i++) {
+    spec = (ISTGT_LU_DISK*) lu->lun[i].spec;
+    if (spec != NULL && spec->flush != NULL) {
+      (void) spec->flush(spec);
+    }
+  }
 }
 
 int istgt_lu_disk_execute(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
@@ -5759,7 +6401,7 @@ int istgt_lu_disk_execute(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
                      "READ_6(lba %" PRIu64 ", len %u blocks)\n",
                      lba,
                      transfer_len);
-      rc = istgt_lu_disk_lbread(spec, conn, lu_cmd, lba, transfer_len);
+      rc = istgt_lu_disk_lbread(spec, conn, lu_cmd, lba, transfer_len, 0);
       if (rc < 0) {
         ISTGT_ERRLOG("lu_disk_lbread() failed\n");
         lu_cmd->status = ISTGT_SCSI_STATUS_CHECK_CONDITION;
@@ -5796,7 +6438,7 @@ int istgt_lu_disk_execute(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
         break;
       }
 
-      rc = istgt_lu_disk_lbread(spec, conn, lu_cmd, lba, transfer_len);
+      rc = istgt_lu_disk_lbread(spec, conn, lu_cmd, lba, transfer_len, fua);
       if (rc < 0) {
         ISTGT_ERRLOG("lu_disk_lbread() failed\n");
         lu_cmd->status = ISTGT_SCSI_STATUS_CHECK_CONDITION;
@@ -5833,7 +6475,7 @@ int istgt_lu_disk_execute(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
         break;
       }
 
-      rc = istgt_lu_disk_lbread(spec, conn, lu_cmd, lba, transfer_len);
+      rc = istgt_lu_disk_lbread(spec, conn, lu_cmd, lba, transfer_len, fua);
       if (rc < 0) {
         ISTGT_ERRLOG("lu_disk_lbread() failed\n");
         lu_cmd->status = ISTGT_SCSI_STATUS_CHECK_CONDITION;
@@ -5870,7 +6512,7 @@ int istgt_lu_disk_execute(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
         break;
       }
 
-      rc = istgt_lu_disk_lbread(spec, conn, lu_cmd, lba, transfer_len);
+      rc = istgt_lu_disk_lbread(spec, conn, lu_cmd, lba, transfer_len, fua);
       if (rc < 0) {
         ISTGT_ERRLOG("lu_disk_lbread() failed\n");
         lu_cmd->status = ISTGT_SCSI_STATUS_CHECK_CONDITION;
@@ -5904,7 +6546,7 @@ int istgt_lu_disk_execute(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
                      "WRITE_6(lba %" PRIu64 ", len %u blocks)\n",
                      lba,
                      transfer_len);
-      rc = istgt_lu_disk_lbwrite(spec, conn, lu_cmd, lba, transfer_len);
+      rc = istgt_lu_disk_lbwrite(spec, conn, lu_cmd, lba, transfer_len, 0);
       if (rc < 0) {
         ISTGT_ERRLOG("lu_disk_lbwrite() failed\n");
         lu_cmd->status = ISTGT_SCSI_STATUS_CHECK_CONDITION;
@@ -5929,6 +6571,10 @@ int istgt_lu_disk_execute(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
       dpo = BGET8(&cdb[1], 4);
       fua = BGET8(&cdb[1], 3);
       fua_nv = BGET8(&cdb[1], 1);
+      if (cdb[0] == SBC_WRITE_AND_VERIFY_10) {
+        /* verified on the media, not in the cache */
+        fua = 1;
+      }
       lba = (uint64_t) DGET32(&cdb[2]);
       transfer_len = (uint32_t) DGET16(&cdb[7]);
       ISTGT_TRACELOG(ISTGT_TRACE_SCSI,
@@ -5942,7 +6588,7 @@ int istgt_lu_disk_execute(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
         break;
       }
 
-      rc = istgt_lu_disk_lbwrite(spec, conn, lu_cmd, lba, transfer_len);
+      rc = istgt_lu_disk_lbwrite(spec, conn, lu_cmd, lba, transfer_len, fua);
       if (rc < 0) {
         ISTGT_ERRLOG("lu_disk_lbwrite() failed\n");
         lu_cmd->status = ISTGT_SCSI_STATUS_CHECK_CONDITION;
@@ -5967,6 +6613,10 @@ int istgt_lu_disk_execute(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
       dpo = BGET8(&cdb[1], 4);
       fua = BGET8(&cdb[1], 3);
       fua_nv = BGET8(&cdb[1], 1);
+      if (cdb[0] == SBC_WRITE_AND_VERIFY_12) {
+        /* verified on the media, not in the cache */
+        fua = 1;
+      }
       lba = (uint64_t) DGET32(&cdb[2]);
       transfer_len = (uint32_t) DGET32(&cdb[6]);
       ISTGT_TRACELOG(ISTGT_TRACE_SCSI,
@@ -5980,7 +6630,7 @@ int istgt_lu_disk_execute(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
         break;
       }
 
-      rc = istgt_lu_disk_lbwrite(spec, conn, lu_cmd, lba, transfer_len);
+      rc = istgt_lu_disk_lbwrite(spec, conn, lu_cmd, lba, transfer_len, fua);
       if (rc < 0) {
         ISTGT_ERRLOG("lu_disk_lbwrite() failed\n");
         lu_cmd->status = ISTGT_SCSI_STATUS_CHECK_CONDITION;
@@ -6005,6 +6655,10 @@ int istgt_lu_disk_execute(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
       dpo = BGET8(&cdb[1], 4);
       fua = BGET8(&cdb[1], 3);
       fua_nv = BGET8(&cdb[1], 1);
+      if (cdb[0] == SBC_WRITE_AND_VERIFY_16) {
+        /* verified on the media, not in the cache */
+        fua = 1;
+      }
       lba = (uint64_t) DGET64(&cdb[2]);
       transfer_len = (uint32_t) DGET32(&cdb[10]);
       ISTGT_TRACELOG(ISTGT_TRACE_SCSI,
@@ -6018,7 +6672,7 @@ int istgt_lu_disk_execute(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd) {
         break;
       }
 
-      rc = istgt_lu_disk_lbwrite(spec, conn, lu_cmd, lba, transfer_len);
+      rc = istgt_lu_disk_lbwrite(spec, conn, lu_cmd, lba, transfer_len, fua);
       if (rc < 0) {
         ISTGT_ERRLOG("lu_disk_lbwrite() failed\n");
         lu_cmd->status = ISTGT_SCSI_STATUS_CHECK_CONDITION;
@@ -136,6 +136,7 @@ int istgt_lu_disk_raw_lun_init(ISTGT_LU_DISK* spec,
   spec->pwrite = istgt_lu_disk_pwrite_raw;
   spec->sync = istgt_lu_disk_sync_raw;
   spec->allocate = istgt_lu_disk_allocate_raw;
+  spec->zcopy = 1;
 
   spec->blocklen = lu->blocklen;
   if (spec->blocklen != 512 && spec->blocklen != 1024 &&
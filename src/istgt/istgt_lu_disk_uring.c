@@ -0,0 +1,682 @@
+/*
+ * Copyright (C) 2008-2012 Daisuke Aoyama <aoyama@peach.ne.jp>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+
+#include "istgt_log.h"
+#include "istgt_lu.h"
+#include "istgt_misc.h"
+#include "istgt_platform.h"
+#include "istgt_proto.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+/* READ, WRITE and FALLOCATE came with 5.6 */
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define USE_LU_DISK_URING 1
+#endif
+#endif
+#endif
+
+#ifdef USE_LU_DISK_URING
+
+#define ISTGT_LU_DISK_URING_ENTRIES 256
+
+/*
+ * Requests of the queued tasks are only written to the SQ by submit(),
+ * the LU thread or home reactor enters them all with one io_uring_enter()
+ * from flush() at the end of its batch. A blocking request from
+ * pread/pwrite/sync enters everything prepared so far right away.
+ *
+ * Buffers are not registered, READ_FIXED/WRITE_FIXED would need them in a
+ * few stable regions. A task buffer is a pool block that goes back to the
+ * system over PoolMemory, and immediate data and the write cache have
+ * their own allocations, so there is nothing fixed to register.
+ */
+
+typedef struct istgt_lu_disk_uring_t {
+  int ring_fd;
+  unsigned int entries;
+  int fixed_file;
+
+  void* sq_ptr;
+  size_t sq_len;
+  void* cq_ptr;
+  size_t cq_len;
+  struct io_uring_sqe* sqes;
+  size_t sqes_len;
+
+  unsigned int* sq_head;
+  unsigned int* sq_tail;
+  unsigned int* sq_mask;
+  unsigned int* sq_array;
+  unsigned int* cq_head;
+  unsigned int* cq_tail;
+  unsigned int* cq_mask;
+  struct io_uring_cqe* cqes;
+
+  /* submission side */
+  pthread_mutex_t sq_mutex;
+  pthread_cond_t sq_cond;
+  int inflight; /* prepared or in the kernel */
+  int prepared; /* in the SQ, not entered yet */
+
+  /* completion side */
+  pthread_t thread;
+  pthread_mutex_t cq_mutex;
+  pthread_cond_t cq_cond;
+} ISTGT_LU_DISK_URING;
+
+/* blocking request from pread/pwrite/sync */
+typedef struct istgt_lu_disk_uring_wait_t {
+  ISTGT_LU_DISK_IO io;
+  ISTGT_LU_DISK_URING* ring;
+  int done;
+} ISTGT_LU_DISK_URING_WAIT;
+
+static int istgt_uring_setup(unsigned int entries,
+                             struct io_uring_params* p) {
+  return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int istgt_uring_enter(int fd,
+                             unsigned int to_submit,
+                             unsigned int min_complete,
+                             unsigned int flags) {
+  return (int) syscall(
+      __NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int istgt_uring_register(int fd,
+                                unsigned int opcode,
+                                void* arg,
+                                unsigned int nr_args) {
+  return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void istgt_lu_disk_uring_unmap(ISTGT_LU_DISK_URING* ring) {
+  if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+    munmap(ring->sqes, ring->sqes_len);
+  if (ring->cq_ptr != NULL && ring->cq_ptr != MAP_FAILED &&
+      ring->cq_ptr != ring->sq_ptr)
+    munmap(ring->cq_ptr, ring->cq_len);
+  if (ring->sq_ptr != NULL && ring->sq_ptr != MAP_FAILED)
+    munmap(ring->sq_ptr, ring->sq_len);
+  ring->sqes = NULL;
+  ring->cq_ptr = NULL;
+  ring->sq_ptr = NULL;
+}
+
+static int istgt_lu_disk_uring_create(ISTGT_LU_DISK_URING* ring) {
+  struct io_uring_params p;
+  uint8_t* sq;
+  uint8_t* cq;
+
+  memset(&p, 0, sizeof p);
+  ring->ring_fd = istgt_uring_setup(ISTGT_LU_DISK_URING_ENTRIES, &p);
+  if (ring->ring_fd < 0) {
+    return -1;
+  }
+  ring->entries = p.sq_entries;
+  if (p.cq_entries < ring->entries) {
+    ring->entries = p.cq_entries;
+  }
+
+  ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ring->cq_len > ring->sq_len)
+      ring->sq_len = ring->cq_len;
+    ring->cq_len = ring->sq_len;
+  }
+  ring->sq_ptr = mmap(NULL,
+                      ring->sq_len,
+                      PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE,
+                      ring->ring_fd,
+                      IORING_OFF_SQ_RING);
+  if (ring->sq_ptr == MAP_FAILED) {
+    goto error_return;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->cq_ptr = ring->sq_ptr;
+  } else {
+    ring->cq_ptr = mmap(NULL,
+                        ring->cq_len,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE,
+                        ring->ring_fd,
+                        IORING_OFF_CQ_RING);
+    if (ring->cq_ptr == MAP_FAILED) {
+      goto error_return;
+    }
+  }
+  ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL,
+                    ring->sqes_len,
+                    PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE,
+                    ring->ring_fd,
+                    IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    goto error_return;
+  }
+
+  sq = (uint8_t*) ring->sq_ptr;
+  cq = (uint8_t*) ring->cq_ptr;
+  ring->sq_head = (unsigned int*) (sq + p.sq_off.head);
+  ring->sq_tail = (unsigned int*) (sq + p.sq_off.tail);
+  ring->sq_mask = (unsigned int*) (sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned int*) (sq + p.sq_off.array);
+  ring->cq_head = (unsigned int*) (cq + p.cq_off.head);
+  ring->cq_tail = (unsigned int*) (cq + p.cq_off.tail);
+  ring->cq_mask = (unsigned int*) (cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+  return 0;
+
+error_return:
+  istgt_lu_disk_uring_unmap(ring);
+  close(ring->ring_fd);
+  ring->ring_fd = -1;
+  return -1;
+}
+
+/*
+ * enter the prepared entries with sq_mutex held. on failure the entries
+ * not consumed by the kernel are taken back and their requests returned
+ * in failed, the caller completes them after unlocking.
+ */
+static int istgt_lu_disk_uring_enter_locked(ISTGT_LU_DISK_URING* ring,
+                                            ISTGT_LU_DISK_IO** failed) {
+  unsigned int head, tail;
+  int nfailed;
+  int rc;
+
+  nfailed = 0;
+  while (ring->prepared > 0) {
+    rc = istgt_uring_enter(ring->ring_fd, ring->prepared, 0, 0);
+    if (rc < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+      continue;
+    }
+    if (rc <= 0) {
+      ISTGT_ERRLOG("io_uring_enter() failed (errno=%d)\n", errno);
+      head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+      tail = *ring->sq_tail;
+      for (; head != tail; head++) {
+        failed[nfailed++] = (ISTGT_LU_DISK_IO*) (uintptr_t) ring
+                                ->sqes[ring->sq_array[head & *ring->sq_mask]]
+                                .user_data;
+      }
+      __atomic_store_n(ring->sq_tail, *ring->sq_head, __ATOMIC_RELEASE);
+      ring->prepared = 0;
+      ring->inflight -= nfailed;
+      pthread_cond_broadcast(&ring->sq_cond);
+      break;
+    }
+    ring->prepared -= rc;
+  }
+  return nfailed;
+}
+
+static void istgt_lu_disk_uring_fail(ISTGT_LU_DISK_IO** failed, int nfailed) {
+  int i;
+
+  for (i = 0; i < nfailed; i++) {
+    if (failed[i] != NULL) {
+      failed[i]->result = -1;
+      failed[i]->done(failed[i]);
+    }
+  }
+}
+
+/*
+ * write a request to the SQ, entered now or by the next flush. -1 only if
+ * the request itself failed to enter, its done() has been called then.
+ */
+static int istgt_lu_disk_uring_push(ISTGT_LU_DISK_URING* ring,
+                                    int fd,
+                                    int opcode,
+                                    void* buf,
+                                    uint64_t len,
+                                    uint64_t offset,
+                                    void* user_data,
+                                    int enter) {
+  ISTGT_LU_DISK_IO* failed[ISTGT_LU_DISK_URING_ENTRIES];
+  struct io_uring_sqe* sqe;
+  unsigned int tail, idx;
+  int nfailed;
+  int i;
+
+retry:
+  MTX_LOCK(&ring->sq_mutex);
+  /* never post more than the CQ can hold */
+  while (ring->inflight >= (int) ring->entries) {
+    if (ring->prepared > 0) {
+      /* completions only come for entered requests */
+      nfailed = istgt_lu_disk_uring_enter_locked(ring, failed);
+      if (nfailed != 0) {
+        MTX_UNLOCK(&ring->sq_mutex);
+        istgt_lu_disk_uring_fail(failed, nfailed);
+        goto retry;
+      }
+      continue;
+    }
+    pthread_cond_wait(&ring->sq_cond, &ring->sq_mutex);
+  }
+  tail = *ring->sq_tail;
+  idx = tail & *ring->sq_mask;
+  sqe = &ring->sqes[idx];
+  memset(sqe, 0, sizeof *sqe);
+  sqe->opcode = (uint8_t) opcode;
+  if (fd >= 0 && ring->fixed_file) {
+    sqe->fd = 0;
+    sqe->flags = IOSQE_FIXED_FILE;
+  } else {
+    sqe->fd = fd;
+  }
+  sqe->off = offset;
+  sqe->addr = (uint64_t) (uintptr_t) buf;
+  sqe->len = (uint32_t) len;
+  sqe->user_data = (uint64_t) (uintptr_t) user_data;
+  ring->sq_array[idx] = idx;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ring->prepared++;
+  ring->inflight++;
+  nfailed = 0;
+  if (enter) {
+    nfailed = istgt_lu_disk_uring_enter_locked(ring, failed);
+  }
+  MTX_UNLOCK(&ring->sq_mutex);
+
+  istgt_lu_disk_uring_fail(failed, nfailed);
+  for (i = 0; i < nfailed; i++) {
+    if (failed[i] == user_data)
+      return -1;
+  }
+  return 0;
+}
+
+static void* istgt_lu_disk_uring_completer(void* arg) {
+  ISTGT_LU_DISK_URING* ring = (ISTGT_LU_DISK_URING*) arg;
+  ISTGT_LU_DISK_IO* io;
+  struct io_uring_cqe* cqe;
+  unsigned int head, tail;
+  int stop;
+  int rc;
+  int n;
+
+  stop = 0;
+  while (!stop) {
+    rc = istgt_uring_enter(ring->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+    if (rc < 0 && errno != EINTR && errno != EAGAIN) {
+      ISTGT_ERRLOG("io_uring_enter() failed (errno=%d)\n", errno);
+      break;
+    }
+    n = 0;
+    head = *ring->cq_head;
+    tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      cqe = &ring->cqes[head & *ring->cq_mask];
+      io = (ISTGT_LU_DISK_IO*) (uintptr_t) cqe->user_data;
+      rc = cqe->res;
+      head++;
+      __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+      n++;
+      if (io == NULL) {
+        /* shutdown request */
+        stop = 1;
+        continue;
+      }
+      if (rc < 0) {
+        ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "io_uring request error=%d\n", -rc);
+      }
+      io->result = rc < 0 ? -1 : rc;
+      io->done(io);
+    }
+    if (n != 0) {
+      MTX_LOCK(&ring->sq_mutex);
+      ring->inflight -= n;
+      pthread_cond_broadcast(&ring->sq_cond);
+      MTX_UNLOCK(&ring->sq_mutex);
+    }
+  }
+  return NULL;
+}
+
+static int istgt_lu_disk_uring_type2op(int type) {
+  switch (type) {
+    case ISTGT_LU_DISK_IO_READ:
+      return IORING_OP_READ;
+    case ISTGT_LU_DISK_IO_WRITE:
+      return IORING_OP_WRITE;
+    case ISTGT_LU_DISK_IO_SYNC:
+      return IORING_OP_FSYNC;
+    default:
+      return -1;
+  }
+}
+
+static int istgt_lu_disk_submit_uring(ISTGT_LU_DISK* spec,
+                                      ISTGT_LU_DISK_IO* io) {
+  ISTGT_LU_DISK_URING* ring = (ISTGT_LU_DISK_URING*) spec->exspec;
+  int opcode;
+
+  opcode = istgt_lu_disk_uring_type2op(io->type);
+  if (opcode < 0) {
+    return -1;
+  }
+  if (io->type == ISTGT_LU_DISK_IO_WRITE && io->offset > spec->fsize) {
+    spec->fsize = io->offset;
+  }
+  if (io->type == ISTGT_LU_DISK_IO_SYNC) {
+    return istgt_lu_disk_uring_push(
+        ring, spec->fd, opcode, NULL, 0, 0, io, 0);
+  }
+  return istgt_lu_disk_uring_push(
+      ring, spec->fd, opcode, io->buf, io->nbytes, io->offset, io, 0);
+}
+
+/* enter the requests prepared by submit() */
+static int istgt_lu_disk_flush_uring(ISTGT_LU_DISK* spec) {
+  ISTGT_LU_DISK_URING* ring = (ISTGT_LU_DISK_URING*) spec->exspec;
+  ISTGT_LU_DISK_IO* failed[ISTGT_LU_DISK_URING_ENTRIES];
+  int nfailed;
+
+  MTX_LOCK(&ring->sq_mutex);
+  nfailed = istgt_lu_disk_uring_enter_locked(ring, failed);
+  MTX_UNLOCK(&ring->sq_mutex);
+  istgt_lu_disk_uring_fail(failed, nfailed);
+  return nfailed == 0 ? 0 : -1;
+}
+
+static void istgt_lu_disk_uring_wakeup(ISTGT_LU_DISK_IO* io) {
+  ISTGT_LU_DISK_URING_WAIT* req = (ISTGT_LU_DISK_URING_WAIT*) io->arg;
+  ISTGT_LU_DISK_URING* ring = req->ring;
+
+  MTX_LOCK(&ring->cq_mutex);
+  req->done = 1;
+  pthread_cond_broadcast(&ring->cq_cond);
+  MTX_UNLOCK(&ring->cq_mutex);
+}
+
+static int64_t istgt_lu_disk_uring_io(ISTGT_LU_DISK* spec,
+                                      int opcode,
+                                      void* buf,
+                                      uint64_t len,
+                                      uint64_t offset) {
+  ISTGT_LU_DISK_URING* ring = (ISTGT_LU_DISK_URING*) spec->exspec;
+  ISTGT_LU_DISK_URING_WAIT req;
+
+  memset(&req, 0, sizeof req);
+  req.ring = ring;
+  req.io.done = istgt_lu_disk_uring_wakeup;
+  req.io.arg = &req;
+  /* done() is called even if it fails to enter */
+  (void) istgt_lu_disk_uring_push(
+      ring, spec->fd, opcode, buf, len, offset, &req.io, 1);
+  MTX_LOCK(&ring->cq_mutex);
+  while (!req.done) {
+    pthread_cond_wait(&ring->cq_cond, &ring->cq_mutex);
+  }
+  MTX_UNLOCK(&ring->cq_mutex);
+  return req.io.result;
+}
+
+static int istgt_lu_disk_open_uring(ISTGT_LU_DISK* spec, int flags, int mode) {
+  ISTGT_LU_DISK_URING* ring = (ISTGT_LU_DISK_URING*) spec->exspec;
+  int rc;
+
+  rc = open(spec->file, flags, mode);
+  if (rc < 0) {
+    return -1;
+  }
+  spec->fd = rc;
+
+  /* registered file saves the fget/fput per request */
+  rc = istgt_uring_register(ring->ring_fd, IORING_REGISTER_FILES, &spec->fd, 1);
+  ring->fixed_file = (rc == 0);
+  return 0;
+}
+
+static int istgt_lu_disk_close_uring(ISTGT_LU_DISK* spec) {
+  ISTGT_LU_DISK_URING* ring = (ISTGT_LU_DISK_URING*) spec->exspec;
+  int rc;
+
+  if (spec->fd == -1)
+    return 0;
+  if (ring->fixed_file) {
+    istgt_uring_register(ring->ring_fd, IORING_UNREGISTER_FILES, NULL, 0);
+    ring->fixed_file = 0;
+  }
+  rc = close(spec->fd);
+  if (rc < 0) {
+    return -1;
+  }
+  spec->fd = -1;
+  return 0;
+}
+
+static int64_t istgt_lu_disk_pread_uring(ISTGT_LU_DISK* spec,
+                                         void* buf,
+                                         uint64_t nbytes,
+                                         uint64_t offset) {
+  return istgt_lu_disk_uring_io(spec, IORING_OP_READ, buf, nbytes, offset);
+}
+
+static int64_t istgt_lu_disk_pwrite_uring(ISTGT_LU_DISK* spec,
+                                          const void* buf,
+                                          uint64_t nbytes,
+                                          uint64_t offset) {
+  int64_t rc;
+
+  rc = istgt_lu_disk_uring_io(
+      spec, IORING_OP_WRITE, (void*) buf, nbytes, offset);
+  if (rc < 0)
+    return -1;
+
+  if (offset > spec->fsize) {
+    spec->fsize = offset;
+  }
+  return rc;
+}
+
+static int64_t istgt_lu_disk_sync_uring(ISTGT_LU_DISK* spec,
+                                        uint64_t nbytes,
+                                        uint64_t offset) {
+  UNUSED(nbytes);
+  UNUSED(offset);
+
+  return istgt_lu_disk_uring_io(spec, IORING_OP_FSYNC, NULL, 0, 0);
+}
+
+static int istgt_lu_disk_allocate_uring(ISTGT_LU_DISK* spec) {
+  uint8_t* data;
+  uint64_t fsize;
+  uint64_t size;
+  uint64_t nbytes;
+  uint64_t offset;
+  int64_t rc;
+
+  size = spec->size;
+  nbytes = spec->blocklen;
+
+  fsize = istgt_lu_get_filesize(spec->file);
+  if (fsize > size) {
+    return 0;
+  }
+  spec->fsize = fsize;
+
+  /* allocate complete size, fallocate takes the length in addr */
+  offset = size - nbytes;
+  rc = istgt_lu_disk_uring_io(
+      spec, IORING_OP_FALLOCATE, (void*) (uintptr_t) nbytes, 0, offset);
+  if (rc == 0) {
+    return 0;
+  }
+
+  /* filesystem without fallocate, write the last block */
+  data = xmalloc(nbytes);
+  memset(data, 0, nbytes);
+  rc = istgt_lu_disk_pread_uring(spec, data, nbytes, offset);
+  /* EOF is OK */
+  if (rc == -1) {
+    ISTGT_ERRLOG("lu_disk_read() failed\n");
+    xfree(data);
+    return -1;
+  }
+  rc = istgt_lu_disk_pwrite_uring(spec, data, nbytes, offset);
+  if (rc == -1 || (uint64_t) rc != nbytes) {
+    ISTGT_ERRLOG("lu_disk_write() failed\n");
+    xfree(data);
+    return -1;
+  }
+  xfree(data);
+  return 0;
+}
+
+int istgt_lu_disk_uring_lun_init(ISTGT_LU_DISK* spec,
+                                 ISTGT_Ptr istgt,
+                                 ISTGT_LU_Ptr lu) {
+  ISTGT_LU_DISK_URING* ring;
+  int rc;
+
+  /* same media checks as raw */
+  rc = istgt_lu_disk_raw_lun_init(spec, istgt, lu);
+  if (rc < 0) {
+    return -1;
+  }
+
+  ring = xmalloc(sizeof *ring);
+  memset(ring, 0, sizeof *ring);
+  rc = istgt_lu_disk_uring_create(ring);
+  if (rc < 0) {
+    ISTGT_WARNLOG("LU%d: LUN%d: io_uring not available (errno=%d), use raw\n",
+                  spec->num,
+                  spec->lun,
+                  errno);
+    xfree(ring);
+    spec->disktype = "RAW";
+    return 0;
+  }
+  pthread_mutex_init(&ring->sq_mutex, NULL);
+  pthread_cond_init(&ring->sq_cond, NULL);
+  pthread_mutex_init(&ring->cq_mutex, NULL);
+  pthread_cond_init(&ring->cq_cond, NULL);
+  rc = pthread_create(
+      &ring->thread, NULL, &istgt_lu_disk_uring_completer, ring);
+  if (rc != 0) {
+    ISTGT_ERRLOG("LU%d: pthread_create() failed\n", spec->num);
+    istgt_lu_disk_uring_unmap(ring);
+    close(ring->ring_fd);
+    xfree(ring);
+    return -1;
+  }
+#ifdef HAVE_PTHREAD_SET_NAME_NP
+  {
+    char buf[MAX_TMPBUF];
+    snprintf(buf, sizeof buf, "luuring #%d.%d", spec->num, spec->lun);
+    pthread_set_name_np(ring->thread, buf);
+  }
+#endif
+
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG,
+                 "LU%d: LUN%d io_uring entries=%u\n",
+                 spec->num,
+                 spec->lun,
+                 ring->entries);
+  spec->exspec = ring;
+  spec->open = istgt_lu_disk_open_uring;
+  spec->close = istgt_lu_disk_close_uring;
+  spec->pread = istgt_lu_disk_pread_uring;
+  spec->pwrite = istgt_lu_disk_pwrite_uring;
+  spec->sync = istgt_lu_disk_sync_uring;
+  spec->allocate = istgt_lu_disk_allocate_uring;
+  spec->submit = istgt_lu_disk_submit_uring;
+  spec->flush = istgt_lu_disk_flush_uring;
+  return 0;
+}
+
+int istgt_lu_disk_uring_lun_shutdown(ISTGT_LU_DISK* spec,
+                                     ISTGT_Ptr istgt,
+                                     ISTGT_LU_Ptr lu) {
+  ISTGT_LU_DISK_URING* ring = (ISTGT_LU_DISK_URING*) spec->exspec;
+  int rc;
+
+  rc = istgt_lu_disk_raw_lun_shutdown(spec, istgt, lu);
+
+  if (ring != NULL) {
+    /* NOP without request stops the completer */
+    if (istgt_lu_disk_uring_push(
+            ring, -1, IORING_OP_NOP, NULL, 0, 0, NULL, 1) == 0) {
+      pthread_join(ring->thread, NULL);
+    }
+    istgt_lu_disk_uring_unmap(ring);
+    close(ring->ring_fd);
+    pthread_cond_destroy(&ring->cq_cond);
+    pthread_mutex_destroy(&ring->cq_mutex);
+    pthread_cond_destroy(&ring->sq_cond);
+    pthread_mutex_destroy(&ring->sq_mutex);
+    xfree(ring);
+    spec->exspec = NULL;
+  }
+  return rc;
+}
+
+#else /* !USE_LU_DISK_URING */
+
+int istgt_lu_disk_uring_lun_init(ISTGT_LU_DISK* spec,
+                                 ISTGT_Ptr istgt,
+                                 ISTGT_LU_Ptr lu) {
+  ISTGT_WARNLOG("LU%d: LUN%d: io_uring not supported, use raw\n",
+                spec->num,
+                spec->lun);
+  spec->disktype = "RAW";
+  return istgt_lu_disk_raw_lun_init(spec, istgt, lu);
+}
+
+int istgt_lu_disk_uring_lun_shutdown(ISTGT_LU_DISK* spec,
+                                     ISTGT_Ptr istgt,
+                                     ISTGT_LU_Ptr lu) {
+  return istgt_lu_disk_raw_lun_shutdown(spec, istgt, lu);
+}
+
+#endif /* USE_LU_DISK_URING */
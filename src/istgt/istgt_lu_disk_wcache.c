@@ -0,0 +1,677 @@
+/*
+ * Copyright (C) 2008-2012 Daisuke Aoyama <aoyama@peach.ne.jp>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "istgt_log.h"
+#include "istgt_lu.h"
+#include "istgt_misc.h"
+#include "istgt_platform.h"
+#include "istgt_proto.h"
+
+/* largest dirty extent, larger writes go through */
+#define ISTGT_LU_WCACHE_EXTENT (1024 * 1024)
+/* seconds dirty data may stay in memory */
+#define ISTGT_LU_WCACHE_INTERVAL 1
+
+/* first extent ending after offset */
+static int istgt_lu_disk_wmap_find(ISTGT_LU_WMAP* map, uint64_t offset) {
+  int lo, hi, mid;
+
+  lo = 0;
+  hi = map->n;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (map->ext[mid]->offset + map->ext[mid]->nbytes <= offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static int istgt_lu_disk_wmap_overlap(ISTGT_LU_WMAP* map,
+                                      uint64_t nbytes,
+                                      uint64_t offset) {
+  int i;
+
+  i = istgt_lu_disk_wmap_find(map, offset);
+  return i < map->n && map->ext[i]->offset < offset + nbytes;
+}
+
+/* replace ext[i..j) with n extents, the new ones are filled by caller */
+static void istgt_lu_disk_wmap_splice(ISTGT_LU_WMAP* map, int i, int j, int n) {
+  int nmax;
+
+  if (map->n - (j - i) + n > map->max) {
+    nmax = map->max != 0 ? map->max * 2 : 256;
+    while (map->n - (j - i) + n > nmax) {
+      nmax *= 2;
+    }
+    map->ext = xrealloc(map->ext, nmax * sizeof *map->ext);
+    map->max = nmax;
+  }
+  memmove(&map->ext[i + n], &map->ext[j], (map->n - j) * sizeof *map->ext);
+  map->n += n - (j - i);
+}
+
+static ISTGT_LU_WEXT* istgt_lu_disk_wext_alloc(uint64_t nbytes,
+                                               uint64_t offset) {
+  ISTGT_LU_WEXT* ext;
+
+  ext = xmalloc(sizeof *ext);
+  ext->offset = offset;
+  ext->nbytes = nbytes;
+  ext->bufsize = nbytes;
+  ext->buf = xmalloc(nbytes);
+  ext->failed = 0;
+  return ext;
+}
+
+static void istgt_lu_disk_wext_free(ISTGT_LU_WEXT* ext) {
+  xfree(ext->buf);
+  xfree(ext);
+}
+
+/* copy the part of ext inside [offset, offset + nbytes) to buf */
+static void istgt_lu_disk_wext_copy(ISTGT_LU_WEXT* ext,
+                                    uint8_t* buf,
+                                    uint64_t nbytes,
+                                    uint64_t offset) {
+  uint64_t start, end;
+
+  start = DMAX64(ext->offset, offset);
+  end = DMIN64(ext->offset + ext->nbytes, offset + nbytes);
+  if (start < end) {
+    memcpy(buf + (start - offset),
+           ext->buf + (start - ext->offset),
+           end - start);
+  }
+}
+
+/* drop [offset, offset + nbytes) from the map, returns the change of memory */
+static int64_t istgt_lu_disk_wmap_cut(ISTGT_LU_WMAP* map,
+                                      uint64_t nbytes,
+                                      uint64_t offset) {
+  ISTGT_LU_WEXT* ext;
+  ISTGT_LU_WEXT* tail;
+  uint64_t end;
+  int64_t delta;
+  int i;
+
+  end = offset + nbytes;
+  delta = 0;
+  i = istgt_lu_disk_wmap_find(map, offset);
+  while (i < map->n && map->ext[i]->offset < end) {
+    ext = map->ext[i];
+    if (ext->offset < offset && end < ext->offset + ext->nbytes) {
+      /* hole in the middle, the tail becomes a new extent */
+      tail = istgt_lu_disk_wext_alloc(ext->offset + ext->nbytes - end, end);
+      istgt_lu_disk_wext_copy(ext, tail->buf, tail->nbytes, end);
+      tail->failed = ext->failed;
+      ext->nbytes = offset - ext->offset;
+      istgt_lu_disk_wmap_splice(map, i + 1, i + 1, 1);
+      map->ext[i + 1] = tail;
+      delta += (int64_t) tail->bufsize;
+      break;
+    }
+    if (ext->offset < offset) {
+      /* keep the head */
+      ext->nbytes = offset - ext->offset;
+      i++;
+      continue;
+    }
+    if (end < ext->offset + ext->nbytes) {
+      /* keep the tail */
+      memmove(ext->buf,
+              ext->buf + (end - ext->offset),
+              ext->offset + ext->nbytes - end);
+      ext->nbytes = ext->offset + ext->nbytes - end;
+      ext->offset = end;
+      break;
+    }
+    delta -= (int64_t) ext->bufsize;
+    istgt_lu_disk_wext_free(ext);
+    istgt_lu_disk_wmap_splice(map, i, i + 1, 0);
+  }
+  return delta;
+}
+
+/* put ext where nothing overlaps it */
+static void istgt_lu_disk_wmap_put(ISTGT_LU_WMAP* map, ISTGT_LU_WEXT* ext) {
+  int i;
+
+  i = istgt_lu_disk_wmap_find(map, ext->offset);
+  istgt_lu_disk_wmap_splice(map, i, i, 1);
+  map->ext[i] = ext;
+}
+
+/* add a write to the dirty map, returns the change of memory held */
+static int64_t istgt_lu_disk_wmap_insert(ISTGT_LU_WMAP* map,
+                                         const uint8_t* buf,
+                                         uint64_t nbytes,
+                                         uint64_t offset) {
+  ISTGT_LU_WEXT* ext;
+  uint64_t end, ustart, uend;
+  uint64_t bufsize;
+  int64_t delta;
+  int i, j, k;
+
+  end = offset + nbytes;
+
+  /* overwrite inside one extent */
+  i = istgt_lu_disk_wmap_find(map, offset);
+  if (i < map->n && map->ext[i]->offset <= offset &&
+      end <= map->ext[i]->offset + map->ext[i]->nbytes) {
+    ext = map->ext[i];
+    memcpy(ext->buf + (offset - ext->offset), buf, nbytes);
+    return 0;
+  }
+
+  /* extents overlapping or adjacent to the write are ext[i..j) */
+  if (i > 0 && map->ext[i - 1]->offset + map->ext[i - 1]->nbytes == offset) {
+    i--;
+  }
+  for (j = i; j < map->n && map->ext[j]->offset <= end; j++)
+    ;
+  ustart = offset;
+  uend = end;
+  if (j > i) {
+    ustart = DMIN64(ustart, map->ext[i]->offset);
+    uend = DMAX64(uend, map->ext[j - 1]->offset + map->ext[j - 1]->nbytes);
+  }
+
+  if (j > i && uend - ustart <= ISTGT_LU_WCACHE_EXTENT) {
+    /* sequential write, append to the extent in place */
+    ext = map->ext[i];
+    if (j - i == 1 && ext->offset == ustart) {
+      delta = 0;
+      if (uend - ustart > ext->bufsize) {
+        bufsize = DMAX64(ext->bufsize * 2, 65536);
+        bufsize = DMIN64(bufsize, ISTGT_LU_WCACHE_EXTENT);
+        bufsize = DMAX64(bufsize, uend - ustart);
+        ext->buf = xrealloc(ext->buf, bufsize);
+        delta = (int64_t) (bufsize - ext->bufsize);
+        ext->bufsize = bufsize;
+      }
+      memcpy(ext->buf + (offset - ext->offset), buf, nbytes);
+      ext->nbytes = uend - ustart;
+      return delta;
+    }
+
+    /* merge the neighbours into one extent */
+    ext = istgt_lu_disk_wext_alloc(uend - ustart, ustart);
+    delta = (int64_t) ext->bufsize;
+    for (k = i; k < j; k++) {
+      istgt_lu_disk_wext_copy(map->ext[k], ext->buf, ext->nbytes, ustart);
+      delta -= (int64_t) map->ext[k]->bufsize;
+      istgt_lu_disk_wext_free(map->ext[k]);
+    }
+    memcpy(ext->buf + (offset - ustart), buf, nbytes);
+    istgt_lu_disk_wmap_splice(map, i, j, 1);
+    map->ext[i] = ext;
+    return delta;
+  }
+
+  /* too large to merge, cut the overwritten parts off the neighbours */
+  delta = istgt_lu_disk_wmap_cut(map, nbytes, offset);
+  ext = istgt_lu_disk_wext_alloc(nbytes, offset);
+  memcpy(ext->buf, buf, nbytes);
+  istgt_lu_disk_wmap_put(map, ext);
+  delta += (int64_t) ext->bufsize;
+  return delta;
+}
+
+static int istgt_lu_disk_wcache_write_back(ISTGT_LU_DISK* spec,
+                                           const uint8_t* buf,
+                                           uint64_t nbytes,
+                                           uint64_t offset) {
+  ISTGT_LU_RANGE range;
+  int64_t rc;
+
+  /* exclude readers of the media and write through of the same blocks */
+  istgt_lu_disk_range_lock(spec,
+                           &range,
+                           offset / spec->blocklen,
+                           nbytes / spec->blocklen,
+                           1);
+  rc = spec->pwrite(spec, buf, nbytes, offset);
+  istgt_lu_disk_range_unlock(spec, &range);
+  if (rc < 0 || (uint64_t) rc != nbytes) {
+    ISTGT_ERRLOG("LU%d: LUN%d: write-back failed at %" PRIu64 "\n",
+                 spec->num,
+                 spec->lun,
+                 offset);
+    return -1;
+  }
+  return 0;
+}
+
+/* move dirty extents to the flush map, from the cursor in LBA order */
+static void istgt_lu_disk_wcache_select(ISTGT_LU_DISK* spec, int all) {
+  ISTGT_LU_WMAP* dirty = &spec->wdirty;
+  ISTGT_LU_WMAP* flush = &spec->wflush;
+  ISTGT_LU_WEXT* last;
+  uint64_t target, total;
+  int start, n, i;
+
+  start = all ? 0 : istgt_lu_disk_wmap_find(dirty, spec->wcache_cursor);
+  target = all ? spec->wnbytes : (uint64_t) spec->wbufsize / 4;
+  total = 0;
+  for (n = 0; n < dirty->n && total < target; n++) {
+    total += dirty->ext[(start + n) % dirty->n]->bufsize;
+  }
+
+  /* wrapped part has lower offsets and goes first */
+  istgt_lu_disk_wmap_splice(flush, 0, flush->n, n);
+  if (start + n > dirty->n) {
+    i = start + n - dirty->n;
+    memcpy(flush->ext, dirty->ext, i * sizeof *dirty->ext);
+    memcpy(&flush->ext[i], &dirty->ext[start], (n - i) * sizeof *dirty->ext);
+    istgt_lu_disk_wmap_splice(dirty, start, dirty->n, 0);
+    istgt_lu_disk_wmap_splice(dirty, 0, i, 0);
+    last = flush->ext[i - 1];
+  } else {
+    memcpy(flush->ext, &dirty->ext[start], n * sizeof *dirty->ext);
+    istgt_lu_disk_wmap_splice(dirty, start, start + n, 0);
+    last = n != 0 ? flush->ext[n - 1] : NULL;
+  }
+  /* next batch continues behind this one */
+  if (last != NULL) {
+    spec->wcache_cursor = last->offset + last->nbytes;
+  }
+}
+
+static void istgt_lu_disk_wcache_flush_batch(ISTGT_LU_DISK* spec) {
+  ISTGT_LU_WMAP* flush = &spec->wflush;
+  ISTGT_LU_WEXT* ext;
+  uint64_t offset, nbytes;
+  int rc;
+  int i, j, k;
+
+  for (i = 0; i < flush->n; i = j) {
+    /* gather contiguous extents into one write */
+    ext = flush->ext[i];
+    offset = ext->offset;
+    nbytes = ext->nbytes;
+    for (j = i + 1; j < flush->n; j++) {
+      if (flush->ext[j]->offset != offset + nbytes ||
+          nbytes + flush->ext[j]->nbytes > ISTGT_LU_WCACHE_EXTENT)
+        break;
+      nbytes += flush->ext[j]->nbytes;
+    }
+    if (j - i == 1) {
+      rc = istgt_lu_disk_wcache_write_back(spec, ext->buf, nbytes, offset);
+    } else {
+      for (k = i; k < j; k++) {
+        istgt_lu_disk_wext_copy(flush->ext[k], spec->wbuf, nbytes, offset);
+      }
+      rc = istgt_lu_disk_wcache_write_back(spec, spec->wbuf, nbytes, offset);
+    }
+    if (rc < 0) {
+      /* kept in the failed map by the flusher */
+      for (k = i; k < j; k++) {
+        flush->ext[k]->failed = 1;
+      }
+      MTX_LOCK(&spec->wcache_mutex);
+      spec->woffset = offset;
+      spec->err_write_cache = 1;
+      spec->wcache_error++;
+      MTX_UNLOCK(&spec->wcache_mutex);
+    }
+  }
+}
+
+/* write the failed extents again, the ones failing stay marked */
+static void istgt_lu_disk_wcache_retry(ISTGT_LU_DISK* spec) {
+  ISTGT_LU_WMAP* fail = &spec->wfail;
+  ISTGT_LU_WEXT* ext;
+  int rc;
+  int i;
+
+  for (i = 0; i < fail->n; i++) {
+    ext = fail->ext[i];
+    rc = istgt_lu_disk_wcache_write_back(
+        spec, ext->buf, ext->nbytes, ext->offset);
+    ext->failed = (rc < 0);
+  }
+}
+
+/* free what was written, keep the failed data readable, flusher holds lock */
+static void istgt_lu_disk_wcache_settle(ISTGT_LU_DISK* spec) {
+  ISTGT_LU_WMAP* fail = &spec->wfail;
+  ISTGT_LU_WMAP* flush = &spec->wflush;
+  ISTGT_LU_WEXT* ext;
+  int64_t delta;
+  int i;
+
+  delta = 0;
+  for (i = 0; i < fail->n;) {
+    ext = fail->ext[i];
+    if (ext->failed) {
+      i++;
+      continue;
+    }
+    delta -= (int64_t) ext->bufsize;
+    istgt_lu_disk_wext_free(ext);
+    istgt_lu_disk_wmap_splice(fail, i, i + 1, 0);
+  }
+  for (i = 0; i < flush->n; i++) {
+    /* the batch is newer than any failed data */
+    ext = flush->ext[i];
+    delta += istgt_lu_disk_wmap_cut(fail, ext->nbytes, ext->offset);
+    if (ext->failed) {
+      istgt_lu_disk_wmap_put(fail, ext);
+      continue;
+    }
+    delta -= (int64_t) ext->bufsize;
+    istgt_lu_disk_wext_free(ext);
+  }
+  flush->n = 0;
+  spec->wnbytes += delta;
+}
+
+static void* istgt_lu_disk_wcache_flusher(void* arg) {
+  ISTGT_LU_DISK* spec = (ISTGT_LU_DISK*) arg;
+  struct timespec abstime;
+  int timeout;
+  int stopped;
+  int retry;
+  int all;
+  int rc;
+
+  timeout = 0;
+  stopped = 0;
+  MTX_LOCK(&spec->wcache_mutex);
+  while (1) {
+    /* failed data is tried once more before giving up */
+    if (spec->wdirty.n == 0 && spec->wcache_stop &&
+        (spec->wfail.n == 0 || stopped))
+      break;
+    all = timeout || spec->wcache_stop || spec->wcache_sync != 0;
+    retry = (timeout || spec->wcache_stop || spec->wcache_retry) &&
+            spec->wfail.n != 0;
+    if (spec->wdirty.n == 0
+            ? !retry
+            : (!all && spec->wnbytes <= (uint64_t) spec->wbufsize / 2)) {
+      /* below the high water mark, write back when the data gets old */
+      /* time() may lag the clock of the wait, retries would spin */
+      clock_gettime(CLOCK_REALTIME, &abstime);
+      abstime.tv_sec += ISTGT_LU_WCACHE_INTERVAL;
+      rc = pthread_cond_timedwait(
+          &spec->wcache_cond, &spec->wcache_mutex, &abstime);
+      timeout = (rc == ETIMEDOUT);
+      continue;
+    }
+
+    timeout = 0;
+    stopped = spec->wcache_stop;
+    spec->wcache_retry = 0;
+    istgt_lu_disk_wcache_select(spec, all);
+    MTX_UNLOCK(&spec->wcache_mutex);
+
+    /* extents in the flush and failed maps are not modified by writers */
+    if (retry) {
+      istgt_lu_disk_wcache_retry(spec);
+    }
+    istgt_lu_disk_wcache_flush_batch(spec);
+
+    MTX_LOCK(&spec->wcache_mutex);
+    istgt_lu_disk_wcache_settle(spec);
+    spec->wcache_rounds++;
+    pthread_cond_broadcast(&spec->wcache_done_cond);
+  }
+  MTX_UNLOCK(&spec->wcache_mutex);
+  return NULL;
+}
+
+int istgt_lu_disk_wcache_init(ISTGT_LU_DISK* spec, uint64_t size) {
+  int rc;
+
+  if (size == 0) {
+    spec->wbufsize = 0;
+    return 0;
+  }
+  if (size > MAX_LU_WRITE_CACHE) {
+    size = MAX_LU_WRITE_CACHE;
+  }
+  /* room for a few extents at least */
+  if (size < 4 * (uint64_t) spec->blocklen) {
+    size = 4 * spec->blocklen;
+  }
+  spec->wbufsize = (int) size;
+  spec->wbuf = xmalloc(ISTGT_LU_WCACHE_EXTENT);
+  spec->wnbytes = 0;
+  spec->woffset = 0;
+  spec->wcache_stop = 0;
+  spec->wcache_sync = 0;
+  spec->wcache_error = 0;
+  spec->wcache_cursor = 0;
+  spec->wcache_rounds = 0;
+  spec->wcache_retry = 0;
+  memset(&spec->wdirty, 0, sizeof spec->wdirty);
+  memset(&spec->wflush, 0, sizeof spec->wflush);
+  memset(&spec->wfail, 0, sizeof spec->wfail);
+
+  rc = pthread_mutex_init(&spec->wcache_mutex, NULL);
+  if (rc != 0) {
+    ISTGT_ERRLOG("LU%d: mutex_init() failed\n", spec->num);
+    return -1;
+  }
+  rc = pthread_cond_init(&spec->wcache_cond, NULL);
+  if (rc != 0) {
+    ISTGT_ERRLOG("LU%d: cond_init() failed\n", spec->num);
+    return -1;
+  }
+  rc = pthread_cond_init(&spec->wcache_done_cond, NULL);
+  if (rc != 0) {
+    ISTGT_ERRLOG("LU%d: cond_init() failed\n", spec->num);
+    return -1;
+  }
+  rc = pthread_create(
+      &spec->wcache_thread, NULL, &istgt_lu_disk_wcache_flusher, spec);
+  if (rc != 0) {
+    ISTGT_ERRLOG("LU%d: pthread_create() failed\n", spec->num);
+    return -1;
+  }
+#ifdef HAVE_PTHREAD_SET_NAME_NP
+  {
+    char buf[MAX_TMPBUF];
+    snprintf(buf, sizeof buf, "luwcache #%d.%d", spec->num, spec->lun);
+    pthread_set_name_np(spec->wcache_thread, buf);
+  }
+#endif
+  return 0;
+}
+
+int istgt_lu_disk_wcache_shutdown(ISTGT_LU_DISK* spec) {
+  int rc;
+  int i;
+
+  if (spec->wbufsize == 0)
+    return 0;
+
+  /* the flusher writes back everything before it exits */
+  MTX_LOCK(&spec->wcache_mutex);
+  spec->wcache_stop = 1;
+  pthread_cond_signal(&spec->wcache_cond);
+  MTX_UNLOCK(&spec->wcache_mutex);
+  pthread_join(spec->wcache_thread, NULL);
+
+  rc = 0;
+  if (spec->wfail.n != 0) {
+    ISTGT_ERRLOG("LU%d: LUN%d: %d extents could not be written back\n",
+                 spec->num,
+                 spec->lun,
+                 spec->wfail.n);
+    rc = -1;
+  }
+  for (i = 0; i < spec->wfail.n; i++) {
+    istgt_lu_disk_wext_free(spec->wfail.ext[i]);
+  }
+  xfree(spec->wdirty.ext);
+  xfree(spec->wflush.ext);
+  xfree(spec->wfail.ext);
+  (void) pthread_cond_destroy(&spec->wcache_done_cond);
+  (void) pthread_cond_destroy(&spec->wcache_cond);
+  (void) pthread_mutex_destroy(&spec->wcache_mutex);
+  spec->wbufsize = 0;
+  return rc;
+}
+
+/* 1 = cached, 0 = write through, caller flushes the range first */
+int istgt_lu_disk_wcache_write(ISTGT_LU_DISK* spec,
+                               const uint8_t* buf,
+                               uint64_t nbytes,
+                               uint64_t offset) {
+  ISTGT_LU_RANGE range;
+  int64_t delta;
+
+  if (nbytes > ISTGT_LU_WCACHE_EXTENT || nbytes > (uint64_t) spec->wbufsize / 4)
+    return 0;
+
+  /* reserve memory, waits for write-back when over the limit */
+  MTX_LOCK(&spec->wcache_mutex);
+  while (spec->wnbytes + nbytes > (uint64_t) spec->wbufsize) {
+    if (spec->wdirty.n == 0 && spec->wflush.n == 0) {
+      /* held by failed data, nothing to wait for */
+      MTX_UNLOCK(&spec->wcache_mutex);
+      return 0;
+    }
+    pthread_cond_signal(&spec->wcache_cond);
+    pthread_cond_wait(&spec->wcache_done_cond, &spec->wcache_mutex);
+  }
+  spec->wnbytes += nbytes;
+  MTX_UNLOCK(&spec->wcache_mutex);
+
+  /* ordered with readers of the same blocks */
+  istgt_lu_disk_range_lock(spec,
+                           &range,
+                           offset / spec->blocklen,
+                           nbytes / spec->blocklen,
+                           1);
+  MTX_LOCK(&spec->wcache_mutex);
+  delta = istgt_lu_disk_wmap_insert(&spec->wdirty, buf, nbytes, offset);
+  spec->wnbytes += delta - (int64_t) nbytes;
+  if (spec->wnbytes > (uint64_t) spec->wbufsize / 2) {
+    pthread_cond_signal(&spec->wcache_cond);
+  }
+  MTX_UNLOCK(&spec->wcache_mutex);
+  istgt_lu_disk_range_unlock(spec, &range);
+  return 1;
+}
+
+/* caller holds the range, 0 = nothing cached, 1 = buf is filled */
+int istgt_lu_disk_wcache_read(ISTGT_LU_DISK* spec,
+                              uint8_t* buf,
+                              uint64_t nbytes,
+                              uint64_t offset) {
+  ISTGT_LU_WMAP* map;
+  int64_t rc;
+  int i;
+
+  MTX_LOCK(&spec->wcache_mutex);
+  if (!istgt_lu_disk_wmap_overlap(&spec->wdirty, nbytes, offset) &&
+      !istgt_lu_disk_wmap_overlap(&spec->wflush, nbytes, offset) &&
+      !istgt_lu_disk_wmap_overlap(&spec->wfail, nbytes, offset)) {
+    MTX_UNLOCK(&spec->wcache_mutex);
+    return 0;
+  }
+  MTX_UNLOCK(&spec->wcache_mutex);
+
+  /* write-back of the range cannot start while the range is held */
+  rc = spec->pread(spec, buf, nbytes, offset);
+  if (rc < 0 || (uint64_t) rc != nbytes) {
+    ISTGT_ERRLOG("lu_disk_read() failed\n");
+    return -1;
+  }
+
+  /* failed data is older than the one being written back */
+  MTX_LOCK(&spec->wcache_mutex);
+  map = &spec->wfail;
+  for (i = istgt_lu_disk_wmap_find(map, offset);
+       i < map->n && map->ext[i]->offset < offset + nbytes;
+       i++) {
+    istgt_lu_disk_wext_copy(map->ext[i], buf, nbytes, offset);
+  }
+  /* data being written back is older than the dirty one */
+  map = &spec->wflush;
+  for (i = istgt_lu_disk_wmap_find(map, offset);
+       i < map->n && map->ext[i]->offset < offset + nbytes;
+       i++) {
+    istgt_lu_disk_wext_copy(map->ext[i], buf, nbytes, offset);
+  }
+  map = &spec->wdirty;
+  for (i = istgt_lu_disk_wmap_find(map, offset);
+       i < map->n && map->ext[i]->offset < offset + nbytes;
+       i++) {
+    istgt_lu_disk_wext_copy(map->ext[i], buf, nbytes, offset);
+  }
+  MTX_UNLOCK(&spec->wcache_mutex);
+  return 1;
+}
+
+/* write back the range and wait, -1 if data of the range is not written */
+int istgt_lu_disk_wcache_flush(ISTGT_LU_DISK* spec,
+                               uint64_t nbytes,
+                               uint64_t offset) {
+  uint64_t rounds;
+  int error;
+
+  MTX_LOCK(&spec->wcache_mutex);
+  spec->wcache_sync++;
+  /* failed data gets a retry by a batch started after this call */
+  rounds = spec->wcache_rounds;
+  while (istgt_lu_disk_wmap_overlap(&spec->wdirty, nbytes, offset) ||
+         istgt_lu_disk_wmap_overlap(&spec->wflush, nbytes, offset) ||
+         (istgt_lu_disk_wmap_overlap(&spec->wfail, nbytes, offset) &&
+          spec->wcache_rounds - rounds < 2)) {
+    if (istgt_lu_disk_wmap_overlap(&spec->wfail, nbytes, offset)) {
+      spec->wcache_retry = 1;
+    }
+    pthread_cond_signal(&spec->wcache_cond);
+    pthread_cond_wait(&spec->wcache_done_cond, &spec->wcache_mutex);
+  }
+  spec->wcache_sync--;
+  error = istgt_lu_disk_wmap_overlap(&spec->wfail, nbytes, offset);
+  MTX_UNLOCK(&spec->wcache_mutex);
+  return error ? -1 : 0;
+}
@@ -270,6 +270,63 @@ char* escape_string(const char* s) {
   return r;
 }
 
+#if defined(__x86_64__) || defined(__i386__)
+#define ISTGT_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define ISTGT_CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define ISTGT_CPU_RELAX() ((void) 0)
+#endif
+
+/* checks of ready() between two clock readings */
+#define ISTGT_SPIN_CHECKS 16
+
+void istgt_spin_init(ISTGT_SPIN* spin, int usec) {
+  spin->usec = usec;
+  spin->cur = usec;
+}
+
+/*
+ * call ready(arg) until it returns non-zero or the budget runs out,
+ * return 1 if ready. A miss halves the next budget down to 1/16, a hit
+ * restores it, so an idle thread soon goes back to sleeping early.
+ */
+int istgt_spin_wait(ISTGT_SPIN* spin, int (*ready)(void*), void* arg) {
+#ifndef _WIN32
+  struct timespec now;
+  int64_t deadline;
+  int i;
+
+  if (spin->cur <= 0)
+    return 0;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  deadline = (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000 + spin->cur;
+  do {
+    for (i = 0; i < ISTGT_SPIN_CHECKS; i++) {
+      if (ready(arg)) {
+        spin->cur = spin->usec;
+        return 1;
+      }
+      ISTGT_CPU_RELAX();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+  } while ((int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000 < deadline);
+  spin->cur /= 2;
+  if (spin->cur < spin->usec / 16) {
+    spin->cur = spin->usec / 16;
+  }
+  if (spin->cur == 0) {
+    spin->cur = 1;
+  }
+  return 0;
+#else
+  UNUSED(spin);
+  UNUSED(ready);
+  UNUSED(arg);
+  return 0;
+#endif /* !_WIN32 */
+}
+
 int istgt_difftime(time_t a, time_t b) {
   double d;
   /* don't want floating-point format */
@@ -174,6 +174,15 @@ uint32_t arc4random(void);
 int istgt_bin2hex(char* buf, size_t len, const uint8_t* data, size_t data_len);
 int istgt_hex2bin(uint8_t* data, size_t data_len, const char* str);
 
+/* busy polling before sleeping, the budget backs off while it finds nothing */
+typedef struct istgt_spin_t {
+  int usec; /* upper limit, 0=never spin */
+  int cur;  /* budget of the next wait */
+} ISTGT_SPIN;
+
+void istgt_spin_init(ISTGT_SPIN* spin, int usec);
+int istgt_spin_wait(ISTGT_SPIN* spin, int (*ready)(void*), void* arg);
+
 /* other functions */
 int istgt_difftime(time_t a, time_t b);
 void istgt_dump(const char* label, const uint8_t* buf, size_t len);
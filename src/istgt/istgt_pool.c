@@ -0,0 +1,377 @@
+/*
+ * Copyright (C) 2008-2012 Daisuke Aoyama <aoyama@peach.ne.jp>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#include "istgt_core.h"
+#include "istgt_log.h"
+#include "istgt_misc.h"
+#include "istgt_pool.h"
+
+#if defined(_MSC_VER)
+#define ISTGT_POOL_TLS __declspec(thread)
+#else
+#define ISTGT_POOL_TLS __thread
+#endif
+
+#define ISTGT_POOL_MAGIC 0x4c4f4f50U /* POOL */
+#define ISTGT_POOL_HDRLEN ISTGT_POOL_ALIGN
+
+/* header before each block, keeps data aligned to ISTGT_POOL_ALIGN */
+typedef struct istgt_pool_block_t {
+  struct istgt_pool_block_t* next;
+  size_t size; /* usable bytes, counted in g_pool_total */
+  uint32_t magic;
+  int cls;   /* -1 if not pooled */
+  int shard; /* cached in the shard it was allocated from */
+} ISTGT_POOL_BLOCK;
+
+typedef struct istgt_pool_shard_t {
+  pthread_mutex_t mutex;
+  ISTGT_POOL_BLOCK* free[ISTGT_POOL_NCLASS];
+  size_t cached;
+
+  uint64_t alloc;
+  uint64_t hit;
+  uint64_t miss;
+  uint64_t release;
+  uint64_t refused;
+} ISTGT_POOL_SHARD;
+
+/*
+ * Threads are given one of the shards round-robin, which only spreads the
+ * lock contention, a shard may be shared by several threads.
+ */
+static ISTGT_POOL_SHARD g_pool_shards[ISTGT_POOL_NSHARD];
+static pthread_mutex_t g_pool_mutex;
+static size_t g_pool_limit; /* bytes in use and cached, 0=unlimited */
+static size_t g_pool_total;
+static int g_pool_next;
+static int g_pool_init;
+
+static ISTGT_POOL_TLS int g_pool_shard = -1;
+
+#define POOL_ADD(V) __atomic_add_fetch(&g_pool_total, (V), __ATOMIC_SEQ_CST)
+#define POOL_SUB(V) __atomic_sub_fetch(&g_pool_total, (V), __ATOMIC_SEQ_CST)
+#define POOL_TOTAL() __atomic_load_n(&g_pool_total, __ATOMIC_SEQ_CST)
+
+static void* istgt_pool_sysalloc(size_t size) {
+  void* p;
+
+#ifdef _WIN32
+  p = _aligned_malloc(size, ISTGT_POOL_ALIGN);
+#else
+  if (posix_memalign(&p, ISTGT_POOL_ALIGN, size) != 0)
+    p = NULL;
+#endif
+  if (p == NULL)
+    istgt_fatal("no memory\n");
+  return p;
+}
+
+static void istgt_pool_sysfree(void* p) {
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+/*
+ * four classes per power of two, (4 + cls % 4) << (cls / 4 + MIN_SHIFT - 2),
+ * so a block is at most 25% larger than requested
+ */
+static int istgt_pool_class(size_t size) {
+  size_t q;
+  int shift;
+
+  if (size <= ((size_t) 1 << ISTGT_POOL_MIN_SHIFT))
+    return 0;
+  if (size > ((size_t) 1 << ISTGT_POOL_MAX_SHIFT))
+    return -1;
+  size--;
+  for (shift = ISTGT_POOL_MIN_SHIFT; (size >> (shift + 1)) != 0; shift++)
+    ;
+  q = size >> (shift - 2);
+  return (shift - ISTGT_POOL_MIN_SHIFT) * 4 + (int) (q - 4) + 1;
+}
+
+static size_t istgt_pool_class_size(int cls) {
+  return (size_t) (4 + cls % 4) << (cls / 4 + ISTGT_POOL_MIN_SHIFT - 2);
+}
+
+static int istgt_pool_my_shard(void) {
+  if (g_pool_shard < 0) {
+    MTX_LOCK(&g_pool_mutex);
+    g_pool_shard = g_pool_next++ % ISTGT_POOL_NSHARD;
+    MTX_UNLOCK(&g_pool_mutex);
+  }
+  return g_pool_shard;
+}
+
+int istgt_pool_init(size_t limit) {
+  int rc;
+  int i;
+
+  if (sizeof(ISTGT_POOL_BLOCK) > ISTGT_POOL_HDRLEN) {
+    ISTGT_ERRLOG("pool header too large\n");
+    return -1;
+  }
+  rc = pthread_mutex_init(&g_pool_mutex, NULL);
+  if (rc != 0) {
+    ISTGT_ERRLOG("mutex_init() failed\n");
+    return -1;
+  }
+  for (i = 0; i < ISTGT_POOL_NSHARD; i++) {
+    memset(&g_pool_shards[i], 0, sizeof g_pool_shards[i]);
+    rc = pthread_mutex_init(&g_pool_shards[i].mutex, NULL);
+    if (rc != 0) {
+      ISTGT_ERRLOG("mutex_init() failed\n");
+      return -1;
+    }
+  }
+  g_pool_limit = limit;
+  g_pool_next = 0;
+  g_pool_init = 1;
+  return 0;
+}
+
+void istgt_pool_shutdown(void) {
+  ISTGT_POOL_STATS stats;
+  ISTGT_POOL_SHARD* sp;
+  ISTGT_POOL_BLOCK* bp;
+  int i, j;
+
+  if (!g_pool_init)
+    return;
+  istgt_pool_get_stats(&stats);
+  ISTGT_NOTICELOG("pool alloc=%" PRIu64 " hit=%" PRIu64 " miss=%" PRIu64
+                  " release=%" PRIu64 " refused=%" PRIu64
+                  " total=%zu cached=%zu\n",
+                  stats.alloc,
+                  stats.hit,
+                  stats.miss,
+                  stats.release,
+                  stats.refused,
+                  stats.total,
+                  stats.cached);
+
+  /* blocks freed after this go back to the system */
+  g_pool_init = 0;
+  for (i = 0; i < ISTGT_POOL_NSHARD; i++) {
+    sp = &g_pool_shards[i];
+    MTX_LOCK(&sp->mutex);
+    for (j = 0; j < ISTGT_POOL_NCLASS; j++) {
+      while ((bp = sp->free[j]) != NULL) {
+        sp->free[j] = bp->next;
+        POOL_SUB(bp->size);
+        istgt_pool_sysfree(bp);
+      }
+    }
+    sp->cached = 0;
+    MTX_UNLOCK(&sp->mutex);
+    (void) pthread_mutex_destroy(&sp->mutex);
+  }
+  (void) pthread_mutex_destroy(&g_pool_mutex);
+}
+
+/* give cached blocks back to the system until need bytes are released */
+static void istgt_pool_trim(size_t need) {
+  ISTGT_POOL_SHARD* sp;
+  ISTGT_POOL_BLOCK* bp;
+  ISTGT_POOL_BLOCK* list;
+  size_t freed;
+  int i, j;
+
+  list = NULL;
+  freed = 0;
+  for (i = 0; i < ISTGT_POOL_NSHARD && freed < need; i++) {
+    sp = &g_pool_shards[i];
+    MTX_LOCK(&sp->mutex);
+    /* largest first */
+    for (j = ISTGT_POOL_NCLASS - 1; j >= 0 && freed < need; j--) {
+      while ((bp = sp->free[j]) != NULL && freed < need) {
+        sp->free[j] = bp->next;
+        sp->cached -= bp->size;
+        sp->release++;
+        freed += bp->size;
+        bp->next = list;
+        list = bp;
+      }
+    }
+    MTX_UNLOCK(&sp->mutex);
+  }
+  while ((bp = list) != NULL) {
+    list = bp->next;
+    POOL_SUB(bp->size);
+    istgt_pool_sysfree(bp);
+  }
+}
+
+static void* istgt_pool_alloc_internal(size_t size, int bounded) {
+  ISTGT_POOL_SHARD* sp;
+  ISTGT_POOL_BLOCK* bp;
+  size_t total;
+  int shard;
+  int cls;
+
+  cls = istgt_pool_class(size);
+  if (!g_pool_init || cls < 0) {
+    if (g_pool_init && bounded && size <= g_pool_limit &&
+        POOL_TOTAL() + size > g_pool_limit) {
+      return NULL;
+    }
+    bp = istgt_pool_sysalloc(size + ISTGT_POOL_HDRLEN);
+    bp->size = size;
+    bp->magic = ISTGT_POOL_MAGIC;
+    bp->cls = -1;
+    bp->shard = -1;
+    POOL_ADD(size);
+    return (uint8_t*) bp + ISTGT_POOL_HDRLEN;
+  }
+
+  shard = istgt_pool_my_shard();
+  sp = &g_pool_shards[shard];
+  MTX_LOCK(&sp->mutex);
+  sp->alloc++;
+  bp = sp->free[cls];
+  if (bp != NULL) {
+    sp->free[cls] = bp->next;
+    sp->cached -= bp->size;
+    sp->hit++;
+  } else {
+    sp->miss++;
+  }
+  MTX_UNLOCK(&sp->mutex);
+
+  if (bp == NULL) {
+    size = istgt_pool_class_size(cls);
+    total = POOL_ADD(size);
+    if (g_pool_limit != 0 && total > g_pool_limit) {
+      /* make room from the caches before refusing */
+      istgt_pool_trim(total - g_pool_limit);
+      if (bounded && size <= g_pool_limit && POOL_TOTAL() > g_pool_limit) {
+        POOL_SUB(size);
+        MTX_LOCK(&sp->mutex);
+        sp->refused++;
+        MTX_UNLOCK(&sp->mutex);
+        return NULL;
+      }
+    }
+    bp = istgt_pool_sysalloc(size + ISTGT_POOL_HDRLEN);
+    bp->size = size;
+    bp->magic = ISTGT_POOL_MAGIC;
+    bp->cls = cls;
+    bp->shard = shard;
+  }
+  bp->next = NULL;
+  return (uint8_t*) bp + ISTGT_POOL_HDRLEN;
+}
+
+/* always succeeds, may go over the limit */
+void* istgt_pool_alloc(size_t size) {
+  return istgt_pool_alloc_internal(size, 0);
+}
+
+/*
+ * NULL if the bytes in use and cached would exceed the limit, a block larger
+ * than the limit itself is never refused as it could not fit later either
+ */
+void* istgt_pool_try_alloc(size_t size) {
+  return istgt_pool_alloc_internal(size, 1);
+}
+
+void istgt_pool_free(void* p) {
+  ISTGT_POOL_SHARD* sp;
+  ISTGT_POOL_BLOCK* bp;
+  size_t size;
+
+  if (p == NULL)
+    return;
+  bp = (ISTGT_POOL_BLOCK*) ((uint8_t*) p - ISTGT_POOL_HDRLEN);
+  if (bp->magic != ISTGT_POOL_MAGIC) {
+    istgt_fatal("pool_free() invalid block %p\n", p);
+  }
+  size = bp->size;
+  if (!g_pool_init || bp->cls < 0) {
+    POOL_SUB(size);
+    istgt_pool_sysfree(bp);
+    return;
+  }
+
+  /* cached blocks stay counted, only kept while under the limit */
+  sp = &g_pool_shards[bp->shard];
+  MTX_LOCK(&sp->mutex);
+  if (g_pool_limit != 0 && POOL_TOTAL() <= g_pool_limit) {
+    bp->next = sp->free[bp->cls];
+    sp->free[bp->cls] = bp;
+    sp->cached += size;
+    bp = NULL;
+  } else {
+    sp->release++;
+  }
+  MTX_UNLOCK(&sp->mutex);
+
+  if (bp != NULL) {
+    POOL_SUB(size);
+    istgt_pool_sysfree(bp);
+  }
+}
+
+void istgt_pool_get_stats(ISTGT_POOL_STATS* stats) {
+  ISTGT_POOL_SHARD* sp;
+  int i;
+
+  memset(stats, 0, sizeof *stats);
+  if (!g_pool_init)
+    return;
+  for (i = 0; i < ISTGT_POOL_NSHARD; i++) {
+    sp = &g_pool_shards[i];
+    MTX_LOCK(&sp->mutex);
+    stats->alloc += sp->alloc;
+    stats->hit += sp->hit;
+    stats->miss += sp->miss;
+    stats->release += sp->release;
+    stats->refused += sp->refused;
+    stats->cached += sp->cached;
+    MTX_UNLOCK(&sp->mutex);
+  }
+  stats->total = POOL_TOTAL();
+  stats->limit = g_pool_limit;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2008-2012 Daisuke Aoyama <aoyama@peach.ne.jp>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef ISTGT_POOL_H
+#define ISTGT_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ISTGT_POOL_ALIGN 64
+#define ISTGT_POOL_MIN_SHIFT 9  /* 512B */
+#define ISTGT_POOL_MAX_SHIFT 24 /* 16MB */
+/* 512B, then four classes per power of two up to 16MB */
+#define ISTGT_POOL_NCLASS \
+  ((ISTGT_POOL_MAX_SHIFT - ISTGT_POOL_MIN_SHIFT) * 4 + 1)
+#define ISTGT_POOL_NSHARD 16
+
+typedef struct istgt_pool_stats_t {
+  uint64_t alloc;   /* requests */
+  uint64_t hit;     /* reused from pool */
+  uint64_t miss;    /* allocated from system */
+  uint64_t release; /* returned to system over limit */
+  uint64_t refused; /* try_alloc over limit */
+  size_t total;     /* bytes in use and cached */
+  size_t cached;    /* bytes kept in pool */
+  size_t limit;     /* upper limit of total, 0=unlimited */
+} ISTGT_POOL_STATS;
+
+int istgt_pool_init(size_t limit);
+void istgt_pool_shutdown(void);
+void* istgt_pool_alloc(size_t size);
+void* istgt_pool_try_alloc(size_t size);
+void istgt_pool_free(void* p);
+void istgt_pool_get_stats(ISTGT_POOL_STATS* stats);
+
+#endif /* ISTGT_POOL_H */
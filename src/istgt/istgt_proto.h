@@ -67,12 +67,15 @@ int istgt_iscsi_transfer_out(CONN_Ptr conn,
                              uint8_t* data,
                              size_t alloc_len,
                              size_t transfer_len);
+int istgt_iscsi_transfer_out_async(CONN_Ptr conn, ISTGT_LU_TASK_Ptr lu_task);
+int istgt_iscsi_queue_result(CONN_Ptr conn, ISTGT_LU_TASK_Ptr lu_task);
 int istgt_create_sess(ISTGT_Ptr istgt, CONN_Ptr conn, ISTGT_LU_Ptr lu);
 int istgt_create_conn(ISTGT_Ptr istgt,
                       PORTAL_Ptr portal,
                       int sock,
                       struct sockaddr* sa,
-                      socklen_t salen);
+                      socklen_t salen,
+                      int acceptor);
 void istgt_lock_gconns(void);
 void istgt_unlock_gconns(void);
 int istgt_get_gnconns(void);
@@ -125,12 +128,17 @@ int istgt_lu_shutdown(ISTGT_Ptr istgt);
 int istgt_lu_islun2lun(uint64_t islun);
 uint64_t istgt_lu_lun2islun(int lun, int maxlun);
 int istgt_lu_reset(ISTGT_LU_Ptr lu, uint64_t lun);
+int istgt_lu_all_queued(ISTGT_Ptr istgt);
+void istgt_lu_exec_lock(ISTGT_LU_Ptr lu, int shared);
+int istgt_lu_exec_trylock(ISTGT_LU_Ptr lu, int shared);
+void istgt_lu_exec_unlock(ISTGT_LU_Ptr lu, int shared);
 int istgt_lu_execute(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd);
 int istgt_lu_create_task(CONN_Ptr conn,
                          ISTGT_LU_CMD_Ptr lu_cmd,
                          ISTGT_LU_TASK_Ptr lu_task,
                          int lun);
 int istgt_lu_destroy_task(ISTGT_LU_TASK_Ptr lu_task);
+int istgt_lu_queue_ready(ISTGT_LU_TASK_Ptr lu_task);
 int istgt_lu_clear_task_IT(CONN_Ptr conn, ISTGT_LU_Ptr lu);
 int istgt_lu_clear_task_ITL(CONN_Ptr conn, ISTGT_LU_Ptr lu, uint64_t lun);
 int istgt_lu_clear_task_ITLQ(CONN_Ptr conn,
@@ -138,6 +146,8 @@ int istgt_lu_clear_task_ITLQ(CONN_Ptr conn,
                              uint64_t lun,
                              uint32_t CmdSN);
 int istgt_lu_clear_all_task(ISTGT_LU_Ptr lu, uint64_t lun);
+int istgt_lu_bind_reactor(ISTGT_LU_Ptr lu, ISTGT_REACTOR_Ptr reactor);
+void istgt_lu_queue_wakeup(ISTGT_LU_Ptr lu, int all);
 
 /* istgt_lu_ctl.c */
 int istgt_create_uctl(ISTGT_Ptr istgt,
@@ -171,8 +181,18 @@ int istgt_lu_disk_queue_clear_ITLQ(CONN_Ptr conn,
                                    uint32_t CmdSN);
 int istgt_lu_disk_queue_clear_all(ISTGT_LU_Ptr lu, int lun);
 int istgt_lu_disk_queue(CONN_Ptr conn, ISTGT_LU_CMD_Ptr lu_cmd);
+int istgt_lu_disk_queue_ready(ISTGT_LU_TASK_Ptr lu_task);
 int istgt_lu_disk_queue_count(ISTGT_LU_Ptr lu, int* lun);
-int istgt_lu_disk_queue_start(ISTGT_LU_Ptr lu, int lun);
+int istgt_lu_disk_queue_start(ISTGT_LU_Ptr lu, int lun, int nowait);
+void istgt_lu_disk_queue_flush(ISTGT_LU_Ptr lu);
+void istgt_lu_disk_release_task_file(ISTGT_LU_TASK_Ptr lu_task);
+void istgt_lu_disk_queue_unlink(ISTGT_LU_TASK_Ptr lu_task);
+void istgt_lu_disk_range_lock(ISTGT_LU_DISK* spec,
+                              ISTGT_LU_RANGE* range,
+                              uint64_t lba,
+                              uint64_t len,
+                              int write);
+void istgt_lu_disk_range_unlock(ISTGT_LU_DISK* spec, ISTGT_LU_RANGE* range);
 
 /* istgt_lu_disk_raw.c */
 int istgt_lu_disk_raw_lun_init(ISTGT_LU_DISK* spec,
@@ -182,6 +202,29 @@ int istgt_lu_disk_raw_lun_shutdown(ISTGT_LU_DISK* spec,
                                    ISTGT_Ptr istgt,
                                    ISTGT_LU_Ptr lu);
 
+/* istgt_lu_disk_uring.c */
+int istgt_lu_disk_uring_lun_init(ISTGT_LU_DISK* spec,
+                                 ISTGT_Ptr istgt,
+                                 ISTGT_LU_Ptr lu);
+int istgt_lu_disk_uring_lun_shutdown(ISTGT_LU_DISK* spec,
+                                     ISTGT_Ptr istgt,
+                                     ISTGT_LU_Ptr lu);
+
+/* istgt_lu_disk_wcache.c */
+int istgt_lu_disk_wcache_init(ISTGT_LU_DISK* spec, uint64_t size);
+int istgt_lu_disk_wcache_shutdown(ISTGT_LU_DISK* spec);
+int istgt_lu_disk_wcache_write(ISTGT_LU_DISK* spec,
+                               const uint8_t* buf,
+                               uint64_t nbytes,
+                               uint64_t offset);
+int istgt_lu_disk_wcache_read(ISTGT_LU_DISK* spec,
+                              uint8_t* buf,
+                              uint64_t nbytes,
+                              uint64_t offset);
+int istgt_lu_disk_wcache_flush(ISTGT_LU_DISK* spec,
+                               uint64_t nbytes,
+                               uint64_t offset);
+
 /* istgt_lu_disk_vbox.c */
 int istgt_lu_disk_vbox_lun_init(ISTGT_LU_DISK* spec,
                                 ISTGT_Ptr istgt,
@@ -36,8 +36,26 @@
 #include <string.h>
 
 #include "istgt_misc.h"
+#include "istgt_platform.h"
 #include "istgt_queue.h"
 
+#if defined(_MSC_VER)
+#define MPSC_XCHG(P, V) \
+  InterlockedExchangePointer((PVOID volatile*) (P), (PVOID) (V))
+#define MPSC_LOAD(P) (MemoryBarrier(), *(void* volatile*) (P))
+#define MPSC_STORE(P, V) (MemoryBarrier(), *(void* volatile*) (P) = (V))
+#define MPSC_STORE_INT(P, V) InterlockedExchange((LONG volatile*) (P), (V))
+#define MPSC_LOAD_INT(P) (MemoryBarrier(), *(int volatile*) (P))
+#define MPSC_FENCE() MemoryBarrier()
+#else
+#define MPSC_XCHG(P, V) __atomic_exchange_n((P), (V), __ATOMIC_ACQ_REL)
+#define MPSC_LOAD(P) __atomic_load_n((P), __ATOMIC_ACQUIRE)
+#define MPSC_STORE(P, V) __atomic_store_n((P), (V), __ATOMIC_RELEASE)
+#define MPSC_STORE_INT(P, V) __atomic_store_n((P), (V), __ATOMIC_SEQ_CST)
+#define MPSC_LOAD_INT(P) __atomic_load_n((P), __ATOMIC_SEQ_CST)
+#define MPSC_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
 int istgt_queue_init(ISTGT_QUEUE_Ptr head) {
   if (head == NULL)
     return -1;
@@ -45,6 +63,7 @@ int istgt_queue_init(ISTGT_QUEUE_Ptr head) {
   head->next = NULL;
   head->elem = NULL;
   head->num = 0;
+  head->embedded = 0;
   return 0;
 }
 
@@ -56,7 +75,12 @@ void istgt_queue_destroy(ISTGT_QUEUE_Ptr head) {
     return;
   for (qp = head->next; qp != NULL && qp != head; qp = next) {
     next = qp->next;
-    free(qp);
+    if (qp->embedded) {
+      qp->next = NULL;
+      qp->prev = NULL;
+    } else {
+      free(qp);
+    }
   }
   head->next = NULL;
   head->prev = NULL;
@@ -81,17 +105,9 @@ int istgt_queue_count(ISTGT_QUEUE_Ptr head) {
 #endif
 }
 
-int istgt_queue_enqueue(ISTGT_QUEUE_Ptr head, void* elem) {
-  ISTGT_QUEUE_Ptr qp;
+static void istgt_queue_link_tail(ISTGT_QUEUE_Ptr head, ISTGT_QUEUE_Ptr qp) {
   ISTGT_QUEUE_Ptr tail;
 
-  if (head == NULL)
-    return -1;
-  qp = xmalloc(sizeof *qp);
-  memset(qp, 0, sizeof *qp);
-
-  qp->elem = elem;
-
   tail = head->prev;
   if (tail == NULL) {
     head->next = qp;
@@ -105,6 +121,51 @@ int istgt_queue_enqueue(ISTGT_QUEUE_Ptr head, void* elem) {
     qp->prev = tail;
   }
   head->num++;
+}
+
+static void istgt_queue_link_head(ISTGT_QUEUE_Ptr head, ISTGT_QUEUE_Ptr qp) {
+  ISTGT_QUEUE_Ptr first;
+
+  first = head->next;
+  if (first == NULL || first == head) {
+    head->next = qp;
+    head->prev = qp;
+    qp->next = head;
+    qp->prev = head;
+  } else {
+    head->next = qp;
+    first->prev = qp;
+    qp->next = first;
+    qp->prev = head;
+  }
+  head->num++;
+}
+
+int istgt_queue_enqueue(ISTGT_QUEUE_Ptr head, void* elem) {
+  ISTGT_QUEUE_Ptr qp;
+
+  if (head == NULL)
+    return -1;
+  qp = xmalloc(sizeof *qp);
+  memset(qp, 0, sizeof *qp);
+
+  qp->elem = elem;
+  istgt_queue_link_tail(head, qp);
+  return 0;
+}
+
+int istgt_queue_enqueue_node(ISTGT_QUEUE_Ptr head,
+                             ISTGT_QUEUE_Ptr node,
+                             void* elem) {
+  if (head == NULL || node == NULL)
+    return -1;
+  if (node->next != NULL) {
+    /* already linked to a queue */
+    return -1;
+  }
+  node->elem = elem;
+  node->embedded = 1;
+  istgt_queue_link_tail(head, node);
   return 0;
 }
 
@@ -121,8 +182,13 @@ void* istgt_queue_dequeue(ISTGT_QUEUE_Ptr head) {
   } else {
     elem = first->elem;
     next = first->next;
-    xfree(first);
-    if (next == NULL) {
+    if (first->embedded) {
+      first->next = NULL;
+      first->prev = NULL;
+    } else {
+      xfree(first);
+    }
+    if (next == NULL || next == head) {
       head->next = NULL;
       head->prev = NULL;
     } else {
@@ -134,9 +200,39 @@ void* istgt_queue_dequeue(ISTGT_QUEUE_Ptr head) {
   return elem;
 }
 
+/* unlink an embedded node from anywhere in the queue */
+int istgt_queue_remove_node(ISTGT_QUEUE_Ptr head, ISTGT_QUEUE_Ptr node) {
+  if (head == NULL || node == NULL)
+    return -1;
+  if (node->next == NULL) {
+    /* not linked */
+    return -1;
+  }
+  node->prev->next = node->next;
+  node->next->prev = node->prev;
+  if (head->next == head) {
+    head->next = NULL;
+    head->prev = NULL;
+  }
+  node->next = NULL;
+  node->prev = NULL;
+  head->num--;
+  return 0;
+}
+
+void* istgt_queue_first(ISTGT_QUEUE_Ptr head) {
+  ISTGT_QUEUE_Ptr first;
+
+  if (head == NULL)
+    return NULL;
+  first = head->next;
+  if (first == NULL || first == head)
+    return NULL;
+  return first->elem;
+}
+
 int istgt_queue_enqueue_first(ISTGT_QUEUE_Ptr head, void* elem) {
   ISTGT_QUEUE_Ptr qp;
-  ISTGT_QUEUE_Ptr first;
 
   if (head == NULL)
     return -1;
@@ -144,19 +240,88 @@ int istgt_queue_enqueue_first(ISTGT_QUEUE_Ptr head, void* elem) {
   memset(qp, 0, sizeof *qp);
 
   qp->elem = elem;
+  istgt_queue_link_head(head, qp);
+  return 0;
+}
 
-  first = head->next;
-  if (first == NULL || first == head) {
-    head->next = qp;
-    head->prev = qp;
-    qp->next = head;
-    qp->prev = head;
-  } else {
-    head->next = qp;
-    first->prev = qp;
-    qp->next = first;
-    qp->prev = head;
+int istgt_queue_enqueue_first_node(ISTGT_QUEUE_Ptr head,
+                                   ISTGT_QUEUE_Ptr node,
+                                   void* elem) {
+  if (head == NULL || node == NULL)
+    return -1;
+  if (node->next != NULL) {
+    /* already linked to a queue */
+    return -1;
   }
-  head->num++;
+  node->elem = elem;
+  node->embedded = 1;
+  istgt_queue_link_head(head, node);
   return 0;
 }
+
+void istgt_mpsc_init(ISTGT_MPSC_QUEUE_Ptr q) {
+  memset(q, 0, sizeof *q);
+  q->head = &q->stub;
+  q->tail = &q->stub;
+}
+
+static void istgt_mpsc_link(ISTGT_MPSC_QUEUE_Ptr q, ISTGT_QUEUE_Ptr node) {
+  ISTGT_QUEUE_Ptr prev;
+
+  node->next = NULL;
+  prev = MPSC_XCHG(&q->head, node);
+  MPSC_STORE(&prev->next, node);
+}
+
+/* returns 1 if the consumer is idle and must be woken up */
+int istgt_mpsc_push(ISTGT_MPSC_QUEUE_Ptr q, ISTGT_QUEUE_Ptr node, void* elem) {
+  node->elem = elem;
+  node->embedded = 1;
+  istgt_mpsc_link(q, node);
+  MPSC_FENCE();
+  return MPSC_LOAD_INT(&q->idle);
+}
+
+void* istgt_mpsc_pop(ISTGT_MPSC_QUEUE_Ptr q) {
+  ISTGT_QUEUE_Ptr tail;
+  ISTGT_QUEUE_Ptr next;
+
+  tail = q->tail;
+  next = MPSC_LOAD(&tail->next);
+  if (tail == &q->stub) {
+    if (next == NULL)
+      return NULL;
+    q->tail = next;
+    tail = next;
+    next = MPSC_LOAD(&tail->next);
+  }
+  if (next == NULL) {
+    if (tail != MPSC_LOAD(&q->head)) {
+      /* producer is linking, not visible yet */
+      return NULL;
+    }
+    istgt_mpsc_link(q, &q->stub);
+    next = MPSC_LOAD(&tail->next);
+    if (next == NULL)
+      return NULL;
+  }
+  q->tail = next;
+  /* node can be linked again */
+  tail->next = NULL;
+  tail->prev = NULL;
+  return tail->elem;
+}
+
+void istgt_mpsc_set_idle(ISTGT_MPSC_QUEUE_Ptr q, int idle) {
+  MPSC_STORE_INT(&q->idle, idle);
+  /* idle must be visible before the consumer checks the queue again */
+  MPSC_FENCE();
+}
+
+/*
+ * consumer only; a push in progress may be missed, its producer sees the
+ * idle flag set before this check
+ */
+int istgt_mpsc_empty(ISTGT_MPSC_QUEUE_Ptr q) {
+  return q->tail == &q->stub && MPSC_LOAD(&q->stub.next) == NULL;
+}
@@ -35,14 +35,38 @@ typedef struct istgt_queue_t {
   struct istgt_queue_t* next;
   void* elem;
   int num;
+  int embedded; /* node is part of elem, not freed */
 } ISTGT_QUEUE;
 typedef ISTGT_QUEUE* ISTGT_QUEUE_Ptr;
 
+/* lock-free multi producer, single consumer queue of embedded nodes */
+typedef struct istgt_mpsc_queue_t {
+  ISTGT_QUEUE_Ptr head; /* last pushed, swapped by producers */
+  ISTGT_QUEUE_Ptr tail; /* next to pop, consumer only */
+  ISTGT_QUEUE stub;
+  int idle; /* consumer is going to sleep */
+} ISTGT_MPSC_QUEUE;
+typedef ISTGT_MPSC_QUEUE* ISTGT_MPSC_QUEUE_Ptr;
+
 int istgt_queue_init(ISTGT_QUEUE_Ptr head);
 void istgt_queue_destroy(ISTGT_QUEUE_Ptr head);
 int istgt_queue_count(ISTGT_QUEUE_Ptr head);
 int istgt_queue_enqueue(ISTGT_QUEUE_Ptr head, void* elem);
 void* istgt_queue_dequeue(ISTGT_QUEUE_Ptr head);
+void* istgt_queue_first(ISTGT_QUEUE_Ptr head);
 int istgt_queue_enqueue_first(ISTGT_QUEUE_Ptr head, void* elem);
+int istgt_queue_enqueue_node(ISTGT_QUEUE_Ptr head,
+                             ISTGT_QUEUE_Ptr node,
+                             void* elem);
+int istgt_queue_enqueue_first_node(ISTGT_QUEUE_Ptr head,
+                                   ISTGT_QUEUE_Ptr node,
+                                   void* elem);
+int istgt_queue_remove_node(ISTGT_QUEUE_Ptr head, ISTGT_QUEUE_Ptr node);
+
+void istgt_mpsc_init(ISTGT_MPSC_QUEUE_Ptr q);
+int istgt_mpsc_push(ISTGT_MPSC_QUEUE_Ptr q, ISTGT_QUEUE_Ptr node, void* elem);
+void* istgt_mpsc_pop(ISTGT_MPSC_QUEUE_Ptr q);
+void istgt_mpsc_set_idle(ISTGT_MPSC_QUEUE_Ptr q, int idle);
+int istgt_mpsc_empty(ISTGT_MPSC_QUEUE_Ptr q);
 
 #endif /* ISTGT_QUEUE_H */
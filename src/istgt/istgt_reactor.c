@@ -0,0 +1,1370 @@
+/*
+ * Copyright (C) 2008-2012 Daisuke Aoyama <aoyama@peach.ne.jp>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "istgt_core.h"
+#include "istgt_log.h"
+#include "istgt_misc.h"
+#include "istgt_platform.h"
+#include "istgt_reactor.h"
+
+#ifdef ISTGT_USE_REACTOR
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+/* multishot receive came with 6.0, after the provided buffer rings */
+#if defined(__NR_io_uring_setup) && defined(IORING_RECV_MULTISHOT)
+#define ISTGT_USE_REACTOR_URING 1
+#endif
+#endif
+#endif
+
+#define ISTGT_REACTOR_MAXEVENTS 64
+#define ISTGT_REACTOR_WAIT 1000 /* msec. */
+
+static ISTGT_REACTOR* g_reactors;
+static int g_nreactors;
+static int g_stats_interval;
+
+int istgt_reactor_self(ISTGT_REACTOR_Ptr reactor) {
+  return pthread_equal(pthread_self(), reactor->thread);
+}
+
+static void istgt_reactor_wakeup(ISTGT_REACTOR_Ptr reactor) {
+  uint64_t val = 1;
+  ssize_t rc;
+
+  do {
+    rc = write(reactor->evfd, &val, sizeof val);
+  } while (rc < 0 && errno == EINTR);
+  /* EAGAIN means the counter is signaled already */
+}
+
+#ifdef ISTGT_USE_REACTOR_URING
+/*
+ * io_uring engine: each socket has a multishot receive armed, which fills
+ * the buffers of the reactor buffer ring. Received chunks are queued on the
+ * event and copied out by istgt_reactor_recv(). Sends and re-arms are only
+ * prepared by the callbacks, one io_uring_enter() per loop submits all of
+ * them and waits for the next completions.
+ */
+#define ISTGT_REACTOR_URING_ENTRIES 256
+#define ISTGT_REACTOR_URING_CQ_ENTRIES 4096
+#define ISTGT_REACTOR_RXBUFS 256 /* power of 2 */
+#define ISTGT_REACTOR_RXBUF_SIZE (16 * 1024)
+
+/* request type in the low bits of user_data */
+#define ISTGT_REACTOR_OP_WAKEUP 0
+#define ISTGT_REACTOR_OP_RECV 1
+#define ISTGT_REACTOR_OP_SEND 2
+#define ISTGT_REACTOR_OP_CANCEL 3
+#define ISTGT_REACTOR_OP_MASK 3
+
+typedef struct istgt_reactor_chunk_t {
+  int len;
+  int off;
+  int next;
+} ISTGT_REACTOR_CHUNK;
+
+typedef struct istgt_reactor_uring_t {
+  int ring_fd;
+  unsigned int sq_entries;
+
+  void* sq_ptr;
+  size_t sq_len;
+  void* cq_ptr;
+  size_t cq_len;
+  struct io_uring_sqe* sqes;
+  size_t sqes_len;
+
+  unsigned int* sq_head;
+  unsigned int* sq_tail;
+  unsigned int* sq_mask;
+  unsigned int* sq_array;
+  unsigned int* cq_head;
+  unsigned int* cq_tail;
+  unsigned int* cq_mask;
+  struct io_uring_cqe* cqes;
+
+  /* provided buffers, indexed by buffer id */
+  struct io_uring_buf_ring* br;
+  size_t br_len;
+  unsigned int br_tail;
+  uint8_t* rxbufs;
+  ISTGT_REACTOR_CHUNK chunks[ISTGT_REACTOR_RXBUFS];
+
+  /* events with completions, dispatched by the loop */
+  ISTGT_REACTOR_EVENT_Ptr ready;
+  ISTGT_REACTOR_EVENT_Ptr ready_tail;
+} ISTGT_REACTOR_URING;
+
+static int istgt_reactor_uring_setup(unsigned int entries,
+                                     struct io_uring_params* p) {
+  return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int istgt_reactor_uring_register(int fd,
+                                        unsigned int opcode,
+                                        void* arg,
+                                        unsigned int nr_args) {
+  return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* submit prepared requests, wait for one completion up to msec if wait */
+static int istgt_reactor_uring_enter(ISTGT_REACTOR_URING* u,
+                                     int wait,
+                                     int msec) {
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  unsigned int to_submit;
+  unsigned int flags;
+  int rc;
+
+  to_submit = *u->sq_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+  if (to_submit == 0 && !wait) {
+    return 0;
+  }
+  memset(&arg, 0, sizeof arg);
+  flags = IORING_ENTER_EXT_ARG;
+  if (wait) {
+    ts.tv_sec = msec / 1000;
+    ts.tv_nsec = (long long) (msec % 1000) * 1000000;
+    arg.ts = (uint64_t) (uintptr_t) &ts;
+    flags |= IORING_ENTER_GETEVENTS;
+  }
+  rc = (int) syscall(__NR_io_uring_enter,
+                     u->ring_fd,
+                     to_submit,
+                     wait ? 1 : 0,
+                     flags,
+                     &arg,
+                     sizeof arg);
+  if (rc < 0) {
+    /* EBUSY: completions must be reaped before submitting more */
+    if (errno == ETIME || errno == EINTR || errno == EAGAIN ||
+        errno == EBUSY) {
+      return 0;
+    }
+    return -1;
+  }
+  return 0;
+}
+
+/* next free SQE, submitted by the next istgt_reactor_uring_enter() */
+static struct io_uring_sqe* istgt_reactor_uring_sqe(ISTGT_REACTOR_URING* u) {
+  struct io_uring_sqe* sqe;
+  unsigned int tail, idx;
+
+  tail = *u->sq_tail;
+  if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries) {
+    (void) istgt_reactor_uring_enter(u, 0, 0);
+    if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >=
+        u->sq_entries) {
+      return NULL;
+    }
+  }
+  /* the kernel reads SQEs on enter only, the tail may move first */
+  idx = tail & *u->sq_mask;
+  sqe = &u->sqes[idx];
+  memset(sqe, 0, sizeof *sqe);
+  u->sq_array[idx] = idx;
+  __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  return sqe;
+}
+
+static void istgt_reactor_uring_recycle(ISTGT_REACTOR_URING* u, int bid) {
+  struct io_uring_buf* buf;
+
+  buf = &u->br->bufs[u->br_tail & (ISTGT_REACTOR_RXBUFS - 1)];
+  buf->addr = (uint64_t) (uintptr_t) (u->rxbufs +
+                                      (size_t) bid * ISTGT_REACTOR_RXBUF_SIZE);
+  buf->len = ISTGT_REACTOR_RXBUF_SIZE;
+  buf->bid = (uint16_t) bid;
+  u->br_tail++;
+  __atomic_store_n(&u->br->tail, (uint16_t) u->br_tail, __ATOMIC_RELEASE);
+}
+
+static void istgt_reactor_uring_ready(ISTGT_REACTOR_URING* u,
+                                      ISTGT_REACTOR_EVENT_Ptr ev,
+                                      int events) {
+  if (ev->ready == 0) {
+    ev->ready_next = NULL;
+    if (u->ready_tail == NULL) {
+      u->ready = ev;
+    } else {
+      u->ready_tail->ready_next = ev;
+    }
+    u->ready_tail = ev;
+  }
+  ev->ready |= events;
+}
+
+static int istgt_reactor_uring_arm_wakeup(ISTGT_REACTOR_Ptr reactor) {
+  struct io_uring_sqe* sqe;
+
+  sqe = istgt_reactor_uring_sqe(reactor->uring);
+  if (sqe == NULL) {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = reactor->evfd;
+  sqe->poll32_events = POLLIN;
+  sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->user_data = ISTGT_REACTOR_OP_WAKEUP;
+  return 0;
+}
+
+static int istgt_reactor_uring_arm_recv(ISTGT_REACTOR_URING* u,
+                                        ISTGT_REACTOR_EVENT_Ptr ev) {
+  struct io_uring_sqe* sqe;
+
+  sqe = istgt_reactor_uring_sqe(u);
+  if (sqe == NULL) {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = ev->fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  sqe->user_data = (uint64_t) (uintptr_t) ev | ISTGT_REACTOR_OP_RECV;
+  ev->recv_armed = 1;
+  ev->recv_rearm = 0;
+  ev->inflight++;
+  return 0;
+}
+
+static int istgt_reactor_uring_push_send(ISTGT_REACTOR_URING* u,
+                                         ISTGT_REACTOR_EVENT_Ptr ev) {
+  struct io_uring_sqe* sqe;
+
+  sqe = istgt_reactor_uring_sqe(u);
+  if (sqe == NULL) {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = ev->fd;
+  sqe->addr = (uint64_t) (uintptr_t) (ev->send_buf + ev->send_off);
+  sqe->len = (uint32_t) (ev->send_len - ev->send_off);
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = (uint64_t) (uintptr_t) ev | ISTGT_REACTOR_OP_SEND;
+  ev->inflight++;
+  return 0;
+}
+
+static int istgt_reactor_uring_cancel(ISTGT_REACTOR_URING* u,
+                                      ISTGT_REACTOR_EVENT_Ptr ev,
+                                      int op) {
+  struct io_uring_sqe* sqe;
+
+  sqe = istgt_reactor_uring_sqe(u);
+  if (sqe == NULL) {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = (uint64_t) (uintptr_t) ev | op;
+  sqe->user_data = ISTGT_REACTOR_OP_CANCEL;
+  return 0;
+}
+
+static void istgt_reactor_uring_recv_done(ISTGT_REACTOR_Ptr reactor,
+                                          ISTGT_REACTOR_EVENT_Ptr ev,
+                                          int res,
+                                          unsigned int flags) {
+  ISTGT_REACTOR_URING* u = reactor->uring;
+  ISTGT_REACTOR_CHUNK* chunk;
+  int bid;
+
+  if ((flags & IORING_CQE_F_MORE) == 0) {
+    /* multishot ended, the socket is read directly until re-armed */
+    ev->recv_armed = 0;
+    ev->inflight--;
+    if (res > 0 || res == -ENOBUFS) {
+      ev->recv_rearm = 1;
+    }
+  }
+  if (flags & IORING_CQE_F_BUFFER) {
+    bid = (int) (flags >> IORING_CQE_BUFFER_SHIFT);
+    if (res <= 0 || ev->state == ISTGT_REACTOR_EVENT_REMOVED) {
+      istgt_reactor_uring_recycle(u, bid);
+    } else {
+      chunk = &u->chunks[bid];
+      chunk->len = res;
+      chunk->off = 0;
+      chunk->next = -1;
+      if (ev->rxq_tail < 0) {
+        ev->rxq_head = bid;
+      } else {
+        u->chunks[ev->rxq_tail].next = bid;
+      }
+      ev->rxq_tail = bid;
+    }
+  }
+  if (ev->state == ISTGT_REACTOR_EVENT_REMOVED) {
+    return;
+  }
+  if (res == 0) {
+    ev->recv_eof = 1;
+  } else if (res < 0 && res != -ENOBUFS && res != -ECANCELED) {
+    ev->recv_error = -res;
+  }
+  istgt_reactor_uring_ready(u,
+                            ev,
+                            ISTGT_REACTOR_READ |
+                                (ev->recv_error ? ISTGT_REACTOR_ERROR : 0));
+}
+
+static void istgt_reactor_uring_send_done(ISTGT_REACTOR_Ptr reactor,
+                                          ISTGT_REACTOR_EVENT_Ptr ev,
+                                          int res) {
+  ISTGT_REACTOR_URING* u = reactor->uring;
+
+  ev->inflight--;
+  if (res > 0) {
+    ev->send_off += res;
+  }
+  if (ev->state == ISTGT_REACTOR_EVENT_REMOVED) {
+    /* the owner writes the rest directly */
+    return;
+  }
+  if (res <= 0) {
+    ev->send_error = res < 0 ? -res : EPIPE;
+    istgt_reactor_uring_ready(u, ev, ISTGT_REACTOR_ERROR);
+    return;
+  }
+  if (ev->send_off < ev->send_len) {
+    /* short send, the socket buffer was full */
+    if (istgt_reactor_uring_push_send(u, ev) < 0) {
+      ev->send_error = EIO;
+      istgt_reactor_uring_ready(u, ev, ISTGT_REACTOR_ERROR);
+    }
+    return;
+  }
+  ev->send_buf = NULL;
+  ev->send_len = 0;
+  ev->send_off = 0;
+  istgt_reactor_uring_ready(u, ev, ISTGT_REACTOR_WRITE);
+}
+
+/* handle completions, callbacks are deferred to the ready list */
+static int istgt_reactor_uring_reap(ISTGT_REACTOR_Ptr reactor) {
+  ISTGT_REACTOR_URING* u = reactor->uring;
+  ISTGT_REACTOR_EVENT_Ptr ev;
+  struct io_uring_cqe* cqe;
+  unsigned int head, tail;
+  unsigned int flags;
+  uint64_t user_data;
+  uint64_t val;
+  int res;
+  int n;
+
+  n = 0;
+  head = *u->cq_head;
+  tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+  while (head != tail) {
+    cqe = &u->cqes[head & *u->cq_mask];
+    user_data = cqe->user_data;
+    res = cqe->res;
+    flags = cqe->flags;
+    head++;
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    n++;
+
+    ev = (ISTGT_REACTOR_EVENT_Ptr) (uintptr_t) (user_data &
+                                                ~(uint64_t)
+                                                    ISTGT_REACTOR_OP_MASK);
+    switch (user_data & ISTGT_REACTOR_OP_MASK) {
+      case ISTGT_REACTOR_OP_WAKEUP:
+        (void) read(reactor->evfd, &val, sizeof val);
+        if ((flags & IORING_CQE_F_MORE) == 0 && reactor->exit == 0) {
+          (void) istgt_reactor_uring_arm_wakeup(reactor);
+        }
+        break;
+      case ISTGT_REACTOR_OP_RECV:
+        istgt_reactor_uring_recv_done(reactor, ev, res, flags);
+        break;
+      case ISTGT_REACTOR_OP_SEND:
+        istgt_reactor_uring_send_done(reactor, ev, res);
+        break;
+      default:
+        break;
+    }
+  }
+  return n;
+}
+
+/* cancel the requests of a removed event and wait for their completion */
+static void istgt_reactor_uring_drain(ISTGT_REACTOR_Ptr reactor,
+                                      ISTGT_REACTOR_EVENT_Ptr ev) {
+  ISTGT_REACTOR_URING* u = reactor->uring;
+  ISTGT_REACTOR_EVENT_Ptr* evp;
+  ISTGT_REACTOR_EVENT_Ptr prev;
+  int next;
+  int bid;
+
+  if (ev->ready != 0) {
+    prev = NULL;
+    for (evp = &u->ready; *evp != NULL; evp = &(*evp)->ready_next) {
+      if (*evp == ev) {
+        *evp = ev->ready_next;
+        if (u->ready_tail == ev) {
+          u->ready_tail = prev;
+        }
+        break;
+      }
+      prev = *evp;
+    }
+    ev->ready_next = NULL;
+    ev->ready = 0;
+  }
+  if (ev->inflight != 0) {
+    (void) istgt_reactor_uring_cancel(u, ev, ISTGT_REACTOR_OP_RECV);
+    (void) istgt_reactor_uring_cancel(u, ev, ISTGT_REACTOR_OP_SEND);
+  }
+  while (ev->inflight != 0) {
+    if (istgt_reactor_uring_enter(u, 1, ISTGT_REACTOR_WAIT) < 0) {
+      ISTGT_ERRLOG("io_uring_enter() failed (errno=%d)\n", errno);
+      break;
+    }
+    (void) istgt_reactor_uring_reap(reactor);
+  }
+  for (bid = ev->rxq_head; bid >= 0; bid = next) {
+    next = u->chunks[bid].next;
+    istgt_reactor_uring_recycle(u, bid);
+  }
+  ev->rxq_head = ev->rxq_tail = -1;
+}
+
+static int istgt_reactor_uring_wait(ISTGT_REACTOR_EVENT_Ptr ev,
+                                    int events,
+                                    int msec) {
+  ISTGT_REACTOR_Ptr reactor = ev->reactor;
+  ISTGT_REACTOR_URING* u = reactor->uring;
+  struct pollfd fds[2];
+  time_t deadline;
+  time_t now;
+  int rc;
+
+  deadline = time(NULL) + (msec + 999) / 1000;
+  while (1) {
+    if ((events & ISTGT_REACTOR_READ) &&
+        (ev->rxq_head >= 0 || ev->recv_eof || ev->recv_error)) {
+      return 0;
+    }
+    if ((events & ISTGT_REACTOR_WRITE) &&
+        (ev->send_len == 0 || ev->send_error)) {
+      return 0;
+    }
+    now = time(NULL);
+    if (now >= deadline) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+    if ((events & ISTGT_REACTOR_READ) && !ev->recv_armed) {
+      /* nothing in flight reads the socket, watch both */
+      if (istgt_reactor_uring_enter(u, 0, 0) < 0) {
+        return -1;
+      }
+      fds[0].fd = ev->fd;
+      fds[0].events = POLLIN;
+      fds[1].fd = u->ring_fd;
+      fds[1].events = POLLIN;
+      rc = poll(fds, 2, (int) (deadline - now) * 1000);
+      if (rc < 0 && errno != EINTR) {
+        return -1;
+      }
+      (void) istgt_reactor_uring_reap(reactor);
+      if (rc > 0 && fds[0].revents != 0) {
+        return 0;
+      }
+      continue;
+    }
+    if (istgt_reactor_uring_enter(u, 1, (int) (deadline - now) * 1000) < 0) {
+      return -1;
+    }
+    (void) istgt_reactor_uring_reap(reactor);
+  }
+}
+
+static void istgt_reactor_uring_destroy(ISTGT_REACTOR_URING* u) {
+  if (u->sqes != NULL && u->sqes != MAP_FAILED)
+    munmap(u->sqes, u->sqes_len);
+  if (u->cq_ptr != NULL && u->cq_ptr != MAP_FAILED && u->cq_ptr != u->sq_ptr)
+    munmap(u->cq_ptr, u->cq_len);
+  if (u->sq_ptr != NULL && u->sq_ptr != MAP_FAILED)
+    munmap(u->sq_ptr, u->sq_len);
+  if (u->ring_fd >= 0)
+    close(u->ring_fd);
+  /* buffer ring is unregistered by close */
+  if (u->br != NULL && u->br != MAP_FAILED)
+    munmap(u->br, u->br_len);
+  xfree(u->rxbufs);
+  xfree(u);
+}
+
+static int istgt_reactor_uring_create(ISTGT_REACTOR_Ptr reactor) {
+  ISTGT_REACTOR_URING* u;
+  struct io_uring_params p;
+  struct io_uring_buf_reg reg;
+  uint8_t* sq;
+  uint8_t* cq;
+  int rc;
+  int i;
+
+  u = xmalloc(sizeof *u);
+  memset(u, 0, sizeof *u);
+  memset(&p, 0, sizeof p);
+  p.flags = IORING_SETUP_CQSIZE;
+  p.cq_entries = ISTGT_REACTOR_URING_CQ_ENTRIES;
+  u->ring_fd = istgt_reactor_uring_setup(ISTGT_REACTOR_URING_ENTRIES, &p);
+  if (u->ring_fd < 0) {
+    goto error_return;
+  }
+  /* timed wait on enter, and no CQE is dropped by multishot */
+  if ((p.features & IORING_FEAT_EXT_ARG) == 0 ||
+      (p.features & IORING_FEAT_NODROP) == 0) {
+    errno = ENOTSUP;
+    goto error_return;
+  }
+  u->sq_entries = p.sq_entries;
+
+  u->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  u->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (u->cq_len > u->sq_len)
+      u->sq_len = u->cq_len;
+    u->cq_len = u->sq_len;
+  }
+  u->sq_ptr = mmap(NULL,
+                   u->sq_len,
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE,
+                   u->ring_fd,
+                   IORING_OFF_SQ_RING);
+  if (u->sq_ptr == MAP_FAILED) {
+    goto error_return;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    u->cq_ptr = u->sq_ptr;
+  } else {
+    u->cq_ptr = mmap(NULL,
+                     u->cq_len,
+                     PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE,
+                     u->ring_fd,
+                     IORING_OFF_CQ_RING);
+    if (u->cq_ptr == MAP_FAILED) {
+      goto error_return;
+    }
+  }
+  u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  u->sqes = mmap(NULL,
+                 u->sqes_len,
+                 PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE,
+                 u->ring_fd,
+                 IORING_OFF_SQES);
+  if (u->sqes == MAP_FAILED) {
+    goto error_return;
+  }
+  sq = (uint8_t*) u->sq_ptr;
+  cq = (uint8_t*) u->cq_ptr;
+  u->sq_head = (unsigned int*) (sq + p.sq_off.head);
+  u->sq_tail = (unsigned int*) (sq + p.sq_off.tail);
+  u->sq_mask = (unsigned int*) (sq + p.sq_off.ring_mask);
+  u->sq_array = (unsigned int*) (sq + p.sq_off.array);
+  u->cq_head = (unsigned int*) (cq + p.cq_off.head);
+  u->cq_tail = (unsigned int*) (cq + p.cq_off.tail);
+  u->cq_mask = (unsigned int*) (cq + p.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+
+  /* the ring must be page aligned, take it from mmap */
+  u->br_len = ISTGT_REACTOR_RXBUFS * sizeof(struct io_uring_buf);
+  u->br = mmap(NULL,
+               u->br_len,
+               PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS,
+               -1,
+               0);
+  if (u->br == MAP_FAILED) {
+    goto error_return;
+  }
+  u->rxbufs = xmalloc((size_t) ISTGT_REACTOR_RXBUFS * ISTGT_REACTOR_RXBUF_SIZE);
+  memset(&reg, 0, sizeof reg);
+  reg.ring_addr = (uint64_t) (uintptr_t) u->br;
+  reg.ring_entries = ISTGT_REACTOR_RXBUFS;
+  reg.bgid = 0;
+  rc = istgt_reactor_uring_register(
+      u->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1);
+  if (rc < 0) {
+    goto error_return;
+  }
+  for (i = 0; i < ISTGT_REACTOR_RXBUFS; i++) {
+    istgt_reactor_uring_recycle(u, i);
+  }
+
+  reactor->uring = u;
+  if (istgt_reactor_uring_arm_wakeup(reactor) < 0) {
+    reactor->uring = NULL;
+    goto error_return;
+  }
+  return 0;
+
+error_return:
+  rc = errno;
+  istgt_reactor_uring_destroy(u);
+  errno = rc;
+  return -1;
+}
+#endif /* ISTGT_USE_REACTOR_URING */
+
+static int istgt_reactor_register(ISTGT_REACTOR_Ptr reactor,
+                                  ISTGT_REACTOR_EVENT_Ptr ev) {
+  struct epoll_event epev;
+  int rc;
+
+  if (ev->fd < 0) {
+    /* posts only, no I/O and no timer */
+    ev->state = ISTGT_REACTOR_EVENT_ACTIVE;
+    return 0;
+  }
+#ifdef ISTGT_USE_REACTOR_URING
+  if (reactor->engine == ISTGT_REACTOR_ENGINE_URING) {
+    rc = istgt_reactor_uring_arm_recv(reactor->uring, ev);
+    if (rc < 0) {
+      ISTGT_ERRLOG("io_uring submission queue is full\n");
+      return -1;
+    }
+  } else
+#endif /* ISTGT_USE_REACTOR_URING */
+  {
+    memset(&epev, 0, sizeof epev);
+    epev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    epev.data.ptr = ev;
+    rc = epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, ev->fd, &epev);
+    if (rc < 0) {
+      ISTGT_ERRLOG("epoll_ctl() failed (errno=%d)\n", errno);
+      return -1;
+    }
+  }
+  ev->prev = NULL;
+  ev->next = reactor->events;
+  if (reactor->events != NULL) {
+    reactor->events->prev = ev;
+  }
+  reactor->events = ev;
+  ev->state = ISTGT_REACTOR_EVENT_ACTIVE;
+  return 0;
+}
+
+static ISTGT_REACTOR_EVENT_Ptr istgt_reactor_next_posted(
+    ISTGT_REACTOR_Ptr reactor) {
+  ISTGT_REACTOR_EVENT_Ptr ev;
+
+  ev = istgt_mpsc_pop(&reactor->posted);
+  if (ev != NULL) {
+    /* posts from now on run the callback again */
+    __atomic_store_n(&ev->posted, 0, __ATOMIC_SEQ_CST);
+  }
+  return ev;
+}
+
+static void istgt_reactor_log_stats(ISTGT_REACTOR_Ptr reactor, time_t now) {
+  time_t sec;
+
+  if (reactor->stats_tick == 0) {
+    reactor->stats_tick = now;
+    return;
+  }
+  sec = now - reactor->stats_tick;
+  if (sec < g_stats_interval)
+    return;
+  ISTGT_NOTICELOG("reactor #%d: %" PRIu64 " cmds/s, %" PRIu64
+                  " tasks/s, %d events\n",
+                  reactor->id,
+                  (reactor->ncommands - reactor->last_ncommands) / sec,
+                  (reactor->ntasks - reactor->last_ntasks) / sec,
+                  __atomic_load_n(&reactor->nevents, __ATOMIC_RELAXED));
+  reactor->last_ncommands = reactor->ncommands;
+  reactor->last_ntasks = reactor->ntasks;
+  reactor->stats_tick = now;
+}
+
+static void istgt_reactor_run_timer(ISTGT_REACTOR_Ptr reactor) {
+  ISTGT_REACTOR_EVENT_Ptr ev;
+  ISTGT_REACTOR_EVENT_Ptr next;
+  time_t now;
+
+  now = time(NULL);
+  if (now != reactor->tick) {
+    reactor->tick = now;
+    if (g_stats_interval > 0) {
+      istgt_reactor_log_stats(reactor, now);
+    }
+    /* callback may remove only its own event */
+    for (ev = reactor->events; ev != NULL; ev = next) {
+      next = ev->next;
+      ev->cb(ev, ISTGT_REACTOR_TIMER);
+    }
+  }
+}
+
+static void istgt_reactor_run_posted(ISTGT_REACTOR_Ptr reactor) {
+  ISTGT_REACTOR_EVENT_Ptr ev;
+
+  /* posted events, also posted by the callbacks */
+  while ((ev = istgt_reactor_next_posted(reactor)) != NULL) {
+    if (ev->state == ISTGT_REACTOR_EVENT_NEW) {
+      if (istgt_reactor_register(reactor, ev) < 0) {
+        __atomic_store_n(
+            &ev->state, ISTGT_REACTOR_EVENT_REMOVED, __ATOMIC_SEQ_CST);
+        __atomic_sub_fetch(&reactor->nevents, 1, __ATOMIC_RELAXED);
+        ev->cb(ev, ISTGT_REACTOR_ERROR);
+        continue;
+      }
+    }
+    ev->cb(ev, ISTGT_REACTOR_POST);
+  }
+}
+
+typedef struct istgt_reactor_epoll_poll_t {
+  ISTGT_REACTOR_Ptr reactor;
+  struct epoll_event* events;
+  int n;
+} ISTGT_REACTOR_EPOLL_POLL;
+
+static int istgt_reactor_epoll_ready(void* arg) {
+  ISTGT_REACTOR_EPOLL_POLL* p = (ISTGT_REACTOR_EPOLL_POLL*) arg;
+
+  p->n = epoll_wait(
+      p->reactor->epfd, p->events, ISTGT_REACTOR_MAXEVENTS, 0);
+  return p->n != 0 || !istgt_mpsc_empty(&p->reactor->posted);
+}
+
+static void istgt_reactor_epoll_loop(ISTGT_REACTOR_Ptr reactor) {
+  ISTGT_REACTOR_EVENT_Ptr ev;
+  ISTGT_REACTOR_EPOLL_POLL ready;
+  struct epoll_event events[ISTGT_REACTOR_MAXEVENTS];
+  uint64_t val;
+  int flags;
+  int msec;
+  int n;
+  int i;
+
+  ready.reactor = reactor;
+  ready.events = events;
+  while (reactor->exit == 0) {
+    /* BusyPoll: posts are seen without the eventfd while spinning */
+    ready.n = 0;
+    if (istgt_mpsc_empty(&reactor->posted)) {
+      (void) istgt_spin_wait(&reactor->spin, istgt_reactor_epoll_ready, &ready);
+    }
+    n = ready.n;
+    if (n == 0) {
+      /* posts wake the loop up only while it is idle */
+      istgt_mpsc_set_idle(&reactor->posted, 1);
+      msec = istgt_mpsc_empty(&reactor->posted) ? ISTGT_REACTOR_WAIT : 0;
+      n = epoll_wait(reactor->epfd, events, ISTGT_REACTOR_MAXEVENTS, msec);
+      istgt_mpsc_set_idle(&reactor->posted, 0);
+    }
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      ISTGT_ERRLOG("epoll_wait() failed (errno=%d)\n", errno);
+      break;
+    }
+    for (i = 0; i < n; i++) {
+      ev = (ISTGT_REACTOR_EVENT_Ptr) events[i].data.ptr;
+      if (ev == NULL) {
+        /* wakeup by post */
+        (void) read(reactor->evfd, &val, sizeof val);
+        continue;
+      }
+      flags = 0;
+      if (events[i].events & EPOLLIN)
+        flags |= ISTGT_REACTOR_READ;
+      if (events[i].events & EPOLLOUT)
+        flags |= ISTGT_REACTOR_WRITE;
+      if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+        flags |= ISTGT_REACTOR_ERROR;
+      ev->cb(ev, flags);
+    }
+    istgt_reactor_run_timer(reactor);
+    istgt_reactor_run_posted(reactor);
+  }
+}
+
+#ifdef ISTGT_USE_REACTOR_URING
+/* completions or posts to handle */
+static int istgt_reactor_uring_pending(void* arg) {
+  ISTGT_REACTOR_Ptr reactor = (ISTGT_REACTOR_Ptr) arg;
+  ISTGT_REACTOR_URING* u = reactor->uring;
+
+  return __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE) != *u->cq_head ||
+         !istgt_mpsc_empty(&reactor->posted);
+}
+
+static void istgt_reactor_uring_loop(ISTGT_REACTOR_Ptr reactor) {
+  ISTGT_REACTOR_URING* u = reactor->uring;
+  ISTGT_REACTOR_EVENT_Ptr ev;
+  int events;
+  int wait;
+  int rc;
+
+  while (reactor->exit == 0) {
+    if (u->ready == NULL && reactor->spin.usec > 0 &&
+        !istgt_reactor_uring_pending(reactor)) {
+      /* BusyPoll: submit, then watch the completion ring without a syscall */
+      if (istgt_reactor_uring_enter(u, 0, 0) < 0) {
+        ISTGT_ERRLOG("io_uring_enter() failed (errno=%d)\n", errno);
+        break;
+      }
+      (void) istgt_spin_wait(
+          &reactor->spin, istgt_reactor_uring_pending, reactor);
+    }
+    /* one system call submits everything prepared by the last round */
+    istgt_mpsc_set_idle(&reactor->posted, 1);
+    wait = u->ready == NULL && !istgt_reactor_uring_pending(reactor);
+    rc = istgt_reactor_uring_enter(u, wait, ISTGT_REACTOR_WAIT);
+    istgt_mpsc_set_idle(&reactor->posted, 0);
+    if (rc < 0) {
+      ISTGT_ERRLOG("io_uring_enter() failed (errno=%d)\n", errno);
+      break;
+    }
+    (void) istgt_reactor_uring_reap(reactor);
+    while ((ev = u->ready) != NULL) {
+      u->ready = ev->ready_next;
+      if (u->ready == NULL) {
+        u->ready_tail = NULL;
+      }
+      ev->ready_next = NULL;
+      events = ev->ready;
+      ev->ready = 0;
+      if (ev->recv_rearm && !ev->recv_armed) {
+        /* on failure the socket is read directly */
+        (void) istgt_reactor_uring_arm_recv(u, ev);
+      }
+      ev->cb(ev, events);
+    }
+    istgt_reactor_run_timer(reactor);
+    istgt_reactor_run_posted(reactor);
+  }
+}
+#endif /* ISTGT_USE_REACTOR_URING */
+
+static void* istgt_reactor_loop(void* arg) {
+  ISTGT_REACTOR_Ptr reactor = (ISTGT_REACTOR_Ptr) arg;
+  ISTGT_CPUSET cpus;
+
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "reactor #%d start\n", reactor->id);
+  if (reactor->cpu >= 0) {
+    /* before the connections touch their buffers from here */
+    istgt_cpuset_zero(&cpus);
+    istgt_cpuset_add(&cpus, reactor->cpu);
+    if (istgt_set_affinity(&cpus) < 0) {
+      ISTGT_WARNLOG("reactor #%d: CPU %d not set (errno=%d)\n",
+                    reactor->id,
+                    reactor->cpu,
+                    errno);
+    }
+  }
+  reactor->tick = time(NULL);
+#ifdef ISTGT_USE_REACTOR_URING
+  if (reactor->engine == ISTGT_REACTOR_ENGINE_URING) {
+    istgt_reactor_uring_loop(reactor);
+  } else
+#endif /* ISTGT_USE_REACTOR_URING */
+    istgt_reactor_epoll_loop(reactor);
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "reactor #%d end\n", reactor->id);
+  return NULL;
+}
+
+/* ev->fd, cb and arg must be set, the callback runs on the reactor thread */
+int istgt_reactor_add(ISTGT_REACTOR_Ptr reactor, ISTGT_REACTOR_EVENT_Ptr ev) {
+  ev->reactor = reactor;
+  ev->state = ISTGT_REACTOR_EVENT_NEW;
+  ev->prev = NULL;
+  ev->next = NULL;
+  memset(&ev->post_node, 0, sizeof ev->post_node);
+  ev->posted = 0;
+  ev->ready = 0;
+  ev->ready_next = NULL;
+  ev->inflight = 0;
+  ev->recv_armed = 0;
+  ev->recv_rearm = 0;
+  ev->recv_eof = 0;
+  ev->recv_error = 0;
+  ev->rxq_head = ev->rxq_tail = -1;
+  ev->send_buf = NULL;
+  ev->send_len = 0;
+  ev->send_off = 0;
+  ev->send_error = 0;
+
+  __atomic_add_fetch(&reactor->nevents, 1, __ATOMIC_RELAXED);
+  /* registered by the reactor thread */
+  return istgt_reactor_post(ev);
+}
+
+/*
+ * take a posted ev off the queue, called on the reactor thread after ev is
+ * marked removed. A post racing with the removal either sees the mark and
+ * backs out or is linked before posted is seen here.
+ */
+static void istgt_reactor_unpost(ISTGT_REACTOR_Ptr reactor,
+                                 ISTGT_REACTOR_EVENT_Ptr ev) {
+  ISTGT_REACTOR_EVENT_Ptr p;
+
+  while (__atomic_load_n(&ev->posted, __ATOMIC_SEQ_CST)) {
+    p = istgt_mpsc_pop(&reactor->posted);
+    if (p == NULL) {
+      /* the producer is linking ev */
+      sched_yield();
+      continue;
+    }
+    if (p == ev) {
+      __atomic_store_n(&ev->posted, 0, __ATOMIC_SEQ_CST);
+      break;
+    }
+    /* others run later, still marked as posted */
+    (void) istgt_mpsc_push(&reactor->posted, &p->post_node, p);
+  }
+}
+
+/* called on the reactor thread, ev is not referenced after return */
+void istgt_reactor_del(ISTGT_REACTOR_EVENT_Ptr ev) {
+  ISTGT_REACTOR_Ptr reactor = ev->reactor;
+  int state;
+
+  state = __atomic_load_n(&ev->state, __ATOMIC_SEQ_CST);
+  if (state == ISTGT_REACTOR_EVENT_REMOVED)
+    return;
+  if (state == ISTGT_REACTOR_EVENT_ACTIVE && ev->fd >= 0) {
+    if (reactor->engine == ISTGT_REACTOR_ENGINE_EPOLL) {
+      (void) epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, ev->fd, NULL);
+    }
+    if (ev->prev != NULL) {
+      ev->prev->next = ev->next;
+    } else {
+      reactor->events = ev->next;
+    }
+    if (ev->next != NULL) {
+      ev->next->prev = ev->prev;
+    }
+    ev->prev = NULL;
+    ev->next = NULL;
+  }
+
+  __atomic_store_n(&ev->state, ISTGT_REACTOR_EVENT_REMOVED, __ATOMIC_SEQ_CST);
+  istgt_reactor_unpost(reactor, ev);
+  __atomic_sub_fetch(&reactor->nevents, 1, __ATOMIC_RELAXED);
+
+#ifdef ISTGT_USE_REACTOR_URING
+  if (reactor->engine == ISTGT_REACTOR_ENGINE_URING) {
+    istgt_reactor_uring_drain(reactor, ev);
+  }
+#endif /* ISTGT_USE_REACTOR_URING */
+}
+
+/* run callback with ISTGT_REACTOR_POST on the reactor thread, any thread */
+int istgt_reactor_post(ISTGT_REACTOR_EVENT_Ptr ev) {
+  ISTGT_REACTOR_Ptr reactor = ev->reactor;
+
+  if (__atomic_exchange_n(&ev->posted, 1, __ATOMIC_SEQ_CST)) {
+    /* queued, the callback has not run yet */
+    return 0;
+  }
+  if (__atomic_load_n(&ev->state, __ATOMIC_SEQ_CST) ==
+      ISTGT_REACTOR_EVENT_REMOVED) {
+    __atomic_store_n(&ev->posted, 0, __ATOMIC_SEQ_CST);
+    return 0;
+  }
+  if (istgt_mpsc_push(&reactor->posted, &ev->post_node, ev)) {
+    /* the loop is about to sleep or sleeping */
+    istgt_reactor_wakeup(reactor);
+  }
+  return 0;
+}
+
+/*
+ * readv(2) of the socket for the reactor thread, EAGAIN if nothing has been
+ * received. Removed events read the socket directly.
+ */
+ssize_t istgt_reactor_recv(ISTGT_REACTOR_EVENT_Ptr ev,
+                           const struct iovec* iovec,
+                           int iovcnt) {
+#ifdef ISTGT_USE_REACTOR_URING
+  ISTGT_REACTOR_URING* u = ev->reactor->uring;
+  ISTGT_REACTOR_CHUNK* chunk;
+  size_t total;
+  size_t off;
+  size_t n;
+  int bid;
+  int i;
+
+  if (ev->reactor->engine == ISTGT_REACTOR_ENGINE_URING &&
+      ev->state != ISTGT_REACTOR_EVENT_REMOVED) {
+    if (ev->rxq_head < 0) {
+      if (ev->recv_error != 0) {
+        errno = ev->recv_error;
+        return -1;
+      }
+      if (ev->recv_eof) {
+        return 0;
+      }
+      if (ev->recv_armed) {
+        errno = EAGAIN;
+        return -1;
+      }
+      /* out of buffers, nothing in flight reads the socket */
+      return readv(ev->fd, iovec, iovcnt);
+    }
+    total = 0;
+    off = 0;
+    i = 0;
+    while (ev->rxq_head >= 0 && i < iovcnt) {
+      if (off == iovec[i].iov_len) {
+        i++;
+        off = 0;
+        continue;
+      }
+      bid = ev->rxq_head;
+      chunk = &u->chunks[bid];
+      n = DMIN64(chunk->len - chunk->off, iovec[i].iov_len - off);
+      memcpy((uint8_t*) iovec[i].iov_base + off,
+             u->rxbufs + (size_t) bid * ISTGT_REACTOR_RXBUF_SIZE + chunk->off,
+             n);
+      off += n;
+      chunk->off += n;
+      total += n;
+      if (chunk->off == chunk->len) {
+        ev->rxq_head = chunk->next;
+        if (ev->rxq_head < 0) {
+          ev->rxq_tail = -1;
+        }
+        istgt_reactor_uring_recycle(u, bid);
+      }
+    }
+    return (ssize_t) total;
+  }
+#endif /* ISTGT_USE_REACTOR_URING */
+  return readv(ev->fd, iovec, iovcnt);
+}
+
+/*
+ * io_uring engine only: send len bytes of buf with the next submission.
+ * buf must stay until ev->send_len is cleared, then WRITE is dispatched.
+ */
+int istgt_reactor_send(ISTGT_REACTOR_EVENT_Ptr ev,
+                       const uint8_t* buf,
+                       size_t len) {
+#ifdef ISTGT_USE_REACTOR_URING
+  if (ev->reactor->engine == ISTGT_REACTOR_ENGINE_URING) {
+    ev->send_buf = buf;
+    ev->send_len = len;
+    ev->send_off = 0;
+    if (istgt_reactor_uring_push_send(ev->reactor->uring, ev) < 0) {
+      ev->send_buf = NULL;
+      ev->send_len = 0;
+      errno = EAGAIN;
+      return -1;
+    }
+    return 0;
+  }
+#else
+  UNUSED(buf);
+  UNUSED(len);
+#endif /* ISTGT_USE_REACTOR_URING */
+  UNUSED(ev);
+  errno = EOPNOTSUPP;
+  return -1;
+}
+
+/* wait for events of ev in the blocking paths, reactor thread only */
+int istgt_reactor_wait(ISTGT_REACTOR_EVENT_Ptr ev, int events, int msec) {
+  struct pollfd fds[1];
+  int rc;
+
+#ifdef ISTGT_USE_REACTOR_URING
+  if (ev->reactor->engine == ISTGT_REACTOR_ENGINE_URING) {
+    return istgt_reactor_uring_wait(ev, events, msec);
+  }
+#endif /* ISTGT_USE_REACTOR_URING */
+  fds[0].fd = ev->fd;
+  fds[0].events = 0;
+  if (events & ISTGT_REACTOR_READ)
+    fds[0].events |= POLLIN;
+  if (events & ISTGT_REACTOR_WRITE)
+    fds[0].events |= POLLOUT;
+  do {
+    rc = poll(fds, 1, msec);
+  } while (rc < 0 && errno == EINTR);
+  if (rc < 0) {
+    return -1;
+  }
+  if (rc == 0) {
+    errno = ETIMEDOUT;
+    return -1;
+  }
+  return 0;
+}
+
+/* reactor of the acceptor or least loaded one if hint < 0, NULL if disabled */
+ISTGT_REACTOR_Ptr istgt_reactor_get(int hint) {
+  ISTGT_REACTOR_Ptr reactor;
+  int nevents;
+  int min;
+  int i;
+
+  if (hint >= 0 && g_nreactors > 0) {
+    return &g_reactors[hint % g_nreactors];
+  }
+  reactor = NULL;
+  min = 0;
+  for (i = 0; i < g_nreactors; i++) {
+    nevents = __atomic_load_n(&g_reactors[i].nevents, __ATOMIC_RELAXED);
+    if (reactor == NULL || nevents < min) {
+      reactor = &g_reactors[i];
+      min = nevents;
+    }
+  }
+  return reactor;
+}
+
+/* reactor on cpu, else the least loaded one on its node, NULL if none */
+ISTGT_REACTOR_Ptr istgt_reactor_get_cpu(int cpu) {
+  ISTGT_REACTOR_Ptr reactor;
+  int nevents;
+  int node;
+  int min;
+  int i;
+
+  if (cpu < 0)
+    return NULL;
+  for (i = 0; i < g_nreactors; i++) {
+    if (g_reactors[i].cpu == cpu)
+      return &g_reactors[i];
+  }
+  node = istgt_cpu_node(cpu);
+  if (node < 0)
+    return NULL;
+  reactor = NULL;
+  min = 0;
+  for (i = 0; i < g_nreactors; i++) {
+    if (g_reactors[i].node != node)
+      continue;
+    nevents = __atomic_load_n(&g_reactors[i].nevents, __ATOMIC_RELAXED);
+    if (reactor == NULL || nevents < min) {
+      reactor = &g_reactors[i];
+      min = nevents;
+    }
+  }
+  return reactor;
+}
+
+static void istgt_reactor_close(ISTGT_REACTOR_Ptr reactor) {
+#ifdef ISTGT_USE_REACTOR_URING
+  if (reactor->uring != NULL) {
+    istgt_reactor_uring_destroy(reactor->uring);
+    reactor->uring = NULL;
+  }
+#endif /* ISTGT_USE_REACTOR_URING */
+  if (reactor->epfd >= 0) {
+    close(reactor->epfd);
+    reactor->epfd = -1;
+  }
+  close(reactor->evfd);
+}
+
+static int istgt_reactor_open(ISTGT_REACTOR_Ptr reactor,
+                              ISTGT_REACTOR_ENGINE engine) {
+  struct epoll_event epev;
+  int rc;
+
+  reactor->engine = ISTGT_REACTOR_ENGINE_EPOLL;
+  reactor->epfd = -1;
+  reactor->uring = NULL;
+  reactor->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (reactor->evfd < 0) {
+    ISTGT_ERRLOG("eventfd() failed (errno=%d)\n", errno);
+    return -1;
+  }
+  if (engine == ISTGT_REACTOR_ENGINE_URING) {
+#ifdef ISTGT_USE_REACTOR_URING
+    rc = istgt_reactor_uring_create(reactor);
+    if (rc == 0) {
+      reactor->engine = ISTGT_REACTOR_ENGINE_URING;
+      return 0;
+    }
+    ISTGT_WARNLOG("reactor #%d: io_uring not available (errno=%d), use epoll\n",
+                  reactor->id,
+                  errno);
+#else
+    ISTGT_WARNLOG("reactor #%d: io_uring is not supported, use epoll\n",
+                  reactor->id);
+#endif /* ISTGT_USE_REACTOR_URING */
+  }
+
+  reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (reactor->epfd < 0) {
+    ISTGT_ERRLOG("epoll_create1() failed (errno=%d)\n", errno);
+    close(reactor->evfd);
+    return -1;
+  }
+  memset(&epev, 0, sizeof epev);
+  epev.events = EPOLLIN;
+  epev.data.ptr = NULL;
+  rc = epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->evfd, &epev);
+  if (rc < 0) {
+    ISTGT_ERRLOG("epoll_ctl() failed (errno=%d)\n", errno);
+    istgt_reactor_close(reactor);
+    return -1;
+  }
+  return 0;
+}
+
+int istgt_reactor_init(int nreactors,
+                       ISTGT_REACTOR_ENGINE engine,
+                       int stats_interval,
+                       int busy_poll,
+                       const ISTGT_CPUSET* cpus) {
+  ISTGT_REACTOR_Ptr reactor;
+#ifdef HAVE_PTHREAD_SET_NAME_NP
+  char buf[MAX_TMPBUF];
+#endif
+  int rc;
+  int i;
+
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "istgt_reactor_init\n");
+  g_reactors = NULL;
+  g_nreactors = 0;
+  g_stats_interval = stats_interval;
+  if (nreactors <= 0) {
+    return 0;
+  }
+  g_reactors = xmalloc(sizeof *g_reactors * nreactors);
+  memset(g_reactors, 0, sizeof *g_reactors * nreactors);
+  for (i = 0; i < nreactors; i++) {
+    reactor = &g_reactors[i];
+    reactor->id = i;
+    rc = istgt_reactor_open(reactor, engine);
+    if (rc < 0) {
+      goto error_return;
+    }
+    istgt_mpsc_init(&reactor->posted);
+    istgt_spin_init(&reactor->spin, busy_poll);
+    reactor->cpu = istgt_cpuset_nth(cpus, i);
+    reactor->node = istgt_cpu_node(reactor->cpu);
+    rc = pthread_create(
+        &reactor->thread, NULL, &istgt_reactor_loop, (void*) reactor);
+    if (rc != 0) {
+      ISTGT_ERRLOG("pthread_create() failed\n");
+      istgt_reactor_close(reactor);
+      goto error_return;
+    }
+#ifdef HAVE_PTHREAD_SET_NAME_NP
+    snprintf(buf, sizeof buf, "reactor #%d", i);
+    pthread_set_name_np(reactor->thread, buf);
+#endif
+    g_nreactors++;
+  }
+  return 0;
+
+error_return:
+  istgt_reactor_shutdown();
+  return -1;
+}
+
+void istgt_reactor_shutdown(void) {
+  ISTGT_REACTOR_Ptr reactor;
+  int i;
+
+  ISTGT_TRACELOG(ISTGT_TRACE_DEBUG, "istgt_reactor_shutdown\n");
+  for (i = 0; i < g_nreactors; i++) {
+    reactor = &g_reactors[i];
+    reactor->exit = 1;
+    istgt_reactor_wakeup(reactor);
+    pthread_join(reactor->thread, NULL);
+    istgt_reactor_close(reactor);
+  }
+  xfree(g_reactors);
+  g_reactors = NULL;
+  g_nreactors = 0;
+}
+
+#else /* !ISTGT_USE_REACTOR */
+
+int istgt_reactor_init(int nreactors,
+                       ISTGT_REACTOR_ENGINE engine,
+                       int stats_interval,
+                       int busy_poll,
+                       const ISTGT_CPUSET* cpus) {
+  UNUSED(engine);
+  UNUSED(stats_interval);
+  UNUSED(busy_poll);
+  UNUSED(cpus);
+
+  if (nreactors > 0) {
+    ISTGT_WARNLOG("reactor is not supported, use connection threads\n");
+  }
+  return 0;
+}
+
+void istgt_reactor_shutdown(void) {}
+
+ISTGT_REACTOR_Ptr istgt_reactor_get(int hint) {
+  UNUSED(hint);
+
+  return NULL;
+}
+
+ISTGT_REACTOR_Ptr istgt_reactor_get_cpu(int cpu) {
+  UNUSED(cpu);
+
+  return NULL;
+}
+
+#endif /* ISTGT_USE_REACTOR */
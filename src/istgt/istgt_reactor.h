@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2008-2012 Daisuke Aoyama <aoyama@peach.ne.jp>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef ISTGT_REACTOR_H
+#define ISTGT_REACTOR_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "istgt_affinity.h"
+#include "istgt_misc.h"
+#include "istgt_platform.h"
+#include "istgt_queue.h"
+
+#ifdef __linux__
+#define ISTGT_USE_REACTOR 1
+#endif
+
+/* events passed to the callback */
+#define ISTGT_REACTOR_READ 0x01
+#define ISTGT_REACTOR_WRITE 0x02
+#define ISTGT_REACTOR_ERROR 0x04
+#define ISTGT_REACTOR_POST 0x08  /* istgt_reactor_post() */
+#define ISTGT_REACTOR_TIMER 0x10 /* about once per second */
+
+typedef enum {
+  ISTGT_REACTOR_ENGINE_EPOLL = 0,
+  ISTGT_REACTOR_ENGINE_URING = 1,
+} ISTGT_REACTOR_ENGINE;
+
+typedef enum {
+  ISTGT_REACTOR_EVENT_NEW = 0,
+  ISTGT_REACTOR_EVENT_ACTIVE = 1,
+  ISTGT_REACTOR_EVENT_REMOVED = 2,
+} ISTGT_REACTOR_EVENT_STATE;
+
+struct istgt_reactor_t;
+
+/* one file descriptor or, with fd < 0, a target of posts only */
+typedef struct istgt_reactor_event_t {
+  struct istgt_reactor_t* reactor;
+  int fd;
+  void (*cb)(struct istgt_reactor_event_t* ev, int events);
+  void* arg;
+
+  ISTGT_REACTOR_EVENT_STATE state;
+  /* registered events, touched by the reactor thread only */
+  struct istgt_reactor_event_t* prev;
+  struct istgt_reactor_event_t* next;
+  /* posted events, lock-free; posted is set while post_node is queued */
+  ISTGT_QUEUE post_node;
+  int posted;
+
+  /* io_uring engine, touched by the reactor thread only */
+  int ready; /* events for the next dispatch */
+  struct istgt_reactor_event_t* ready_next;
+  int inflight;
+  int recv_armed;
+  int recv_rearm;
+  int recv_eof;
+  int recv_error;
+  int rxq_head; /* received chunks, -1 if empty */
+  int rxq_tail;
+  const uint8_t* send_buf; /* owned by the caller until send_len is 0 */
+  size_t send_len;
+  size_t send_off;
+  int send_error;
+} ISTGT_REACTOR_EVENT;
+typedef ISTGT_REACTOR_EVENT* ISTGT_REACTOR_EVENT_Ptr;
+
+struct istgt_reactor_uring_t;
+
+typedef struct istgt_reactor_t {
+  int id;
+  ISTGT_REACTOR_ENGINE engine;
+  int epfd;
+  int evfd;
+  pthread_t thread;
+  int exit;
+
+  ISTGT_MPSC_QUEUE posted;
+  int nevents; /* atomic, read by istgt_reactor_get() */
+  ISTGT_SPIN spin;
+  int cpu;  /* pinned CPU, -1 if not */
+  int node; /* NUMA node of cpu */
+
+  ISTGT_REACTOR_EVENT_Ptr events;
+  time_t tick;
+
+  /* counted on the reactor thread, logged every stats_interval seconds */
+  uint64_t ncommands;
+  uint64_t ntasks;
+  uint64_t last_ncommands;
+  uint64_t last_ntasks;
+  time_t stats_tick;
+
+  struct istgt_reactor_uring_t* uring;
+} ISTGT_REACTOR;
+typedef ISTGT_REACTOR* ISTGT_REACTOR_Ptr;
+
+int istgt_reactor_init(int nreactors,
+                       ISTGT_REACTOR_ENGINE engine,
+                       int stats_interval,
+                       int busy_poll,
+                       const ISTGT_CPUSET* cpus);
+void istgt_reactor_shutdown(void);
+ISTGT_REACTOR_Ptr istgt_reactor_get(int hint);
+ISTGT_REACTOR_Ptr istgt_reactor_get_cpu(int cpu);
+int istgt_reactor_add(ISTGT_REACTOR_Ptr reactor, ISTGT_REACTOR_EVENT_Ptr ev);
+void istgt_reactor_del(ISTGT_REACTOR_EVENT_Ptr ev);
+int istgt_reactor_post(ISTGT_REACTOR_EVENT_Ptr ev);
+int istgt_reactor_self(ISTGT_REACTOR_Ptr reactor);
+ssize_t istgt_reactor_recv(ISTGT_REACTOR_EVENT_Ptr ev,
+                           const struct iovec* iovec,
+                           int iovcnt);
+int istgt_reactor_send(ISTGT_REACTOR_EVENT_Ptr ev,
+                       const uint8_t* buf,
+                       size_t len);
+int istgt_reactor_wait(ISTGT_REACTOR_EVENT_Ptr ev, int events, int msec);
+
+#endif /* ISTGT_REACTOR_H */
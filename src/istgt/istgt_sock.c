@@ -40,6 +40,10 @@
 #include "istgt_platform.h"
 #include "istgt_sock.h"
 
+#ifdef ISTGT_USE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+
 //#define USE_POLLWAIT
 #undef USE_POLLWAIT
 #define TIMEOUT_RW 60
@@ -86,7 +90,7 @@ int istgt_getaddr(int sock, char* saddr, int slen, char* caddr, int clen) {
   return 0;
 }
 
-int istgt_listen(const char* ip, int port) {
+static int istgt_listen_internal(const char* ip, int port, int reuseport) {
   char buf[MAX_TMPBUF];
   char portnum[PORTNUMLEN];
   char* p;
@@ -140,6 +144,19 @@ int istgt_listen(const char* ip, int port) {
       /* error */
       continue;
     }
+    if (reuseport) {
+#ifdef SO_REUSEPORT
+      rc = setsockopt(
+          sock, SOL_SOCKET, SO_REUSEPORT, (void*) &val, sizeof val);
+#else
+      rc = -1;
+#endif /* SO_REUSEPORT */
+      if (rc != 0) {
+        close(sock);
+        sock = -1;
+        continue;
+      }
+    }
     rc = setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (void*) &val, sizeof val);
     if (rc != 0) {
       /* error */
@@ -158,8 +175,8 @@ int istgt_listen(const char* ip, int port) {
       sock = -1;
       continue;
     }
-    /* bind OK */
-    rc = listen(sock, 1);
+    /* bind OK, queue a login storm rather than refusing it */
+    rc = listen(sock, SOMAXCONN);
     if (rc != 0) {
       close(sock);
       sock = -1;
@@ -175,6 +192,15 @@ int istgt_listen(const char* ip, int port) {
   return sock;
 }
 
+int istgt_listen(const char* ip, int port) {
+  return istgt_listen_internal(ip, port, 0);
+}
+
+/* one of several sockets on ip:port, the kernel spreads connections over them */
+int istgt_listen_shared(const char* ip, int port) {
+  return istgt_listen_internal(ip, port, 1);
+}
+
 int istgt_connect(const char* host, int port) {
   char buf[MAX_TMPBUF];
   char portnum[PORTNUMLEN];
@@ -277,6 +303,34 @@ int istgt_set_sendtimeout(int s, int msec) {
   return 0;
 }
 
+int istgt_set_busy_poll(int s, int usec) {
+#ifdef SO_BUSY_POLL
+  int val = usec;
+  return setsockopt(s, SOL_SOCKET, SO_BUSY_POLL, (void*) &val, sizeof val);
+#else
+  UNUSED(s);
+  UNUSED(usec);
+  errno = ENOPROTOOPT;
+  return -1;
+#endif /* SO_BUSY_POLL */
+}
+
+/* CPU that received the last packets of s, -1 if unknown */
+int istgt_get_incoming_cpu(int s) {
+#ifdef SO_INCOMING_CPU
+  socklen_t len;
+  int cpu;
+
+  len = sizeof cpu;
+  if (getsockopt(s, SOL_SOCKET, SO_INCOMING_CPU, (void*) &cpu, &len) != 0)
+    return -1;
+  return cpu;
+#else
+  UNUSED(s);
+  return -1;
+#endif /* SO_INCOMING_CPU */
+}
+
 int istgt_set_recvlowat(int s, int nbytes) {
 #ifndef _WIN32
   int val = nbytes;
@@ -291,6 +345,26 @@ int istgt_set_recvlowat(int s, int nbytes) {
 #endif  // _WIN32
 }
 
+int istgt_set_nonblock(int s, int on) {
+#ifndef _WIN32
+  int flags;
+
+  flags = fcntl(s, F_GETFL, 0);
+  if (flags < 0)
+    return -1;
+  if (on) {
+    flags |= O_NONBLOCK;
+  } else {
+    flags &= ~O_NONBLOCK;
+  }
+  return fcntl(s, F_SETFL, flags);
+
+#else   // _WIN32
+  u_long val = on;
+  return ioctlsocket(s, FIONBIO, &val);
+#endif  // _WIN32
+}
+
 #ifdef USE_POLLWAIT
 static int can_read_socket(int s, int msec) {
   struct pollfd fds[1];
@@ -696,6 +770,17 @@ ssize_t istgt_writev_socket(int fd, const struct iovec* iov, int iovcnt) {
 #endif  // _WIN32
 }
 
+#ifdef ISTGT_USE_SENDFILE
+ssize_t istgt_sendfile_socket(int sock,
+                              int fd,
+                              uint64_t offset,
+                              size_t nbytes) {
+  off_t off = (off_t) offset;
+
+  return sendfile(sock, fd, &off, nbytes);
+}
+#endif /* ISTGT_USE_SENDFILE */
+
 void istgt_close_socket(int fd) {
 #ifdef _WIN32
   closesocket(fd);
@@ -29,14 +29,23 @@
 #define ISTGT_SOCK_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include "istgt_platform.h"
 
+#ifdef __linux__
+#define ISTGT_USE_SENDFILE 1
+#endif
+
 int istgt_getaddr(int sock, char* saddr, int slen, char* caddr, int clen);
 int istgt_listen(const char* ip, int port);
+int istgt_listen_shared(const char* ip, int port);
 int istgt_connect(const char* host, int port);
 int istgt_set_recvtimeout(int s, int msec);
 int istgt_set_sendtimeout(int s, int msec);
 int istgt_set_recvlowat(int s, int nbytes);
+int istgt_set_nonblock(int s, int on);
+int istgt_set_busy_poll(int s, int usec);
+int istgt_get_incoming_cpu(int s);
 ssize_t istgt_read_socket(int s, void* buf, size_t nbytes, int timeout);
 ssize_t istgt_write_socket(int s, const void* buf, size_t nbytes, int timeout);
 ssize_t istgt_readline_socket(int sock,
@@ -50,6 +59,9 @@ ssize_t istgt_readline_socket(int sock,
 ssize_t istgt_writeline_socket(int sock, const char* buf, int timeout);
 ssize_t istgt_readv_socket(int fd, const struct iovec* iov, int iovcnt);
 ssize_t istgt_writev_socket(int fildes, const struct iovec* iov, int iovcnt);
+#ifdef ISTGT_USE_SENDFILE
+ssize_t istgt_sendfile_socket(int sock, int fd, uint64_t offset, size_t nbytes);
+#endif
 void istgt_close_socket(int fd);
 
 #endif /* ISTGT_SOCK_H */